@@ -1,8 +1,9 @@
 #include "ECalls.hpp"
 
 #include <VirtualMachine.hpp>
+#include <InputLog.hpp>
 
-#include "Framebuffer.hpp"
+#include "Screen.hpp"
 #include "VirtualMachines.hpp"
 
 #include <iostream>
@@ -10,11 +11,32 @@
 #include <format>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <functional>
+#include <optional>
 
 using VM = VirtualMachine;
 using Regs = std::array<VM::Reg, VM::REGISTER_COUNT>;
 using FRegs = std::array<Float, VM::REGISTER_COUNT>;
 
+static std::function<void(SWord)> exit_handler = [](SWord exit_code) { std::exit(exit_code); };
+static InputLog* input_log = nullptr;
+
+static std::optional<std::string> ReadLine(Hart hart) {
+    auto read = []() -> std::optional<std::string> {
+        std::string str;
+        if (!std::getline(std::cin, str))
+            return std::nullopt;
+
+        return str;
+    };
+
+    if (!input_log)
+        return read();
+
+    return input_log->Log(InputLog::Event::ConsoleInput, hart, vms[hart]->GetCycles(), read);
+}
+
 void ECallCOut(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     std::string str = "";
 
@@ -26,8 +48,10 @@ void ECallCOut(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     if (is_32_bit_mode) size = regs[VM::REG_A2].u32;
     else size = regs[VM::REG_A2].u64;
 
+    auto host = memory.HostPointer(addr, size);
+
     for (Address i = 0; i < size; addr++, i++) {
-        Byte byte = memory.ReadByte(addr);
+        Byte byte = host ? host[i] : memory.ReadByte(addr);
         if (std::isprint(byte) || std::isspace(byte))
             str += static_cast<char>(byte);
     }
@@ -35,15 +59,16 @@ void ECallCOut(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     std::cout << str << std::flush;
 }
 
-void ECallCIn(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
-    std::string str = "";
+void ECallCIn(Hart hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
+    auto line = ReadLine(hart);
 
-    if (!std::getline(std::cin, str)) {
+    if (!line) {
         if (is_32_bit_mode) regs[VM::REG_A0].u32 = 0;
         else regs[VM::REG_A0].u64 = 0;
         return;
     }
 
+    auto& str = *line;
     Address i, addr;
 
     if (is_32_bit_mode) addr = regs[VM::REG_A1].u32;
@@ -54,8 +79,18 @@ void ECallCIn(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     if (is_32_bit_mode) size = regs[VM::REG_A2].u32;
     else size = regs[VM::REG_A2].u64;
 
-    for (i = 0, addr = addr; i < str.size() && i < size && addr < memory.GetTotalMemory(); i++, addr++) {
-        memory.WriteByte(addr, str[i]);
+    Address count = std::min<Address>(str.size(), size);
+    auto host = memory.HostPointer(addr, count);
+
+    if (host) {
+        std::memcpy(host, str.data(), count);
+        memory.NotifyHostWrite(addr, count);
+        i = count;
+    }
+    else {
+        for (i = 0, addr = addr; i < str.size() && i < size && addr < memory.GetTotalMemory(); i++, addr++) {
+            memory.WriteByte(addr, str[i]);
+        }
     }
 
     if (is_32_bit_mode) regs[VM::REG_A0].u32 = static_cast<uint32_t>(i);
@@ -134,7 +169,15 @@ void ECallExit(Hart, bool, Memory&, Regs& regs, FRegs&) {
 
     S32U32 value;
     value.u = regs[VM::REG_A1].u32;
-    std::exit(value.s);
+    exit_handler(value.s);
+}
+
+void SetExitHandler(std::function<void(SWord)> handler) {
+    exit_handler = handler;
+}
+
+void SetInputLog(InputLog* log) {
+    input_log = log;
 }
 
 void RegisterECalls() {
@@ -2,9 +2,12 @@
 #define APP_ECALLS_HPP
 
 #include <cstdint>
+#include <functional>
 
 #include <Types.hpp>
 
+class InputLog;
+
 // void ecall_cout(const char* buffer, Long count);
 constexpr Long ECALL_COUT = 0ULL;
 
@@ -31,4 +34,11 @@ constexpr Long ECALL_EXIT = -1ULL;
 
 void RegisterECalls();
 
+// ecall_exit ends the process unless a front end handles it
+void SetExitHandler(std::function<void(SWord)> handler);
+
+// ecall_cin records its lines into the log or replays them from it, nullptr
+// reads stdin directly
+void SetInputLog(InputLog* log);
+
 #endif
\ No newline at end of file
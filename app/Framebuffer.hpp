@@ -8,9 +8,7 @@
 #include <Types.hpp>
 #include <Memory.hpp>
 
-inline Word framebuffer_width;
-inline Word framebuffer_height;
-inline Address framebuffer_address;
+#include "Screen.hpp"
 
 class MemoryFramebuffer : public MemoryRegion {
 private:
@@ -1,6 +1,7 @@
 #include "GUIAssembly.hpp"
 
 #include "GUIConstants.hpp"
+#include "GUIProfiler.hpp"
 
 #include <imgui.h>
 
@@ -35,7 +36,13 @@ void GUIAssembly::Draw() {
 
         auto instrs = memory.PeekWords(window_pc, WINDOW);
 
+        auto profiler = vm->GetProfiler();
+        Long max_count = profiler ? profiler->GetMaxCount() : 0;
+
         for (Address addr = window_pc, i = 0; i < WINDOW; addr += 4, i++) {
+            if (profiler)
+                GUIProfiler::ShadeLine(profiler->GetCount(addr), max_count);
+
             if (instrs[i].second) {
                 RVInstruction instr = RVInstruction::FromUInt32(instrs[i].first);
                 std::string s_addr;
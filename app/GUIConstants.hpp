@@ -7,4 +7,7 @@ inline constexpr ImVec4 gui_pc_highlight_color(0.379, 0.578, 1.0, 1.0);
 inline constexpr ImVec4 gui_sp_highlight_color(0.578, 0.379, 1.0, 1.0);
 inline constexpr ImVec4 gui_break_highlight_color(0.379, 1.0, 0.578, 1.0);
 
+// Hot instructions are shaded with this color, more opaque the hotter
+inline constexpr ImVec4 gui_hot_color(1.0, 0.379, 0.2, 0.6);
+
 #endif
\ No newline at end of file
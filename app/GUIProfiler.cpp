@@ -0,0 +1,59 @@
+#include "GUIProfiler.hpp"
+
+#include "GUIConstants.hpp"
+
+#include <imgui.h>
+
+#include <format>
+
+void GUIProfiler::ShadeLine(Long count, Long max_count) {
+    if (count == 0 || max_count == 0)
+        return;
+
+    ImVec4 color = gui_hot_color;
+    color.w *= static_cast<float>(count) / max_count;
+
+    auto begin = ImGui::GetCursorScreenPos();
+    auto end = ImVec2(begin.x + ImGui::GetContentRegionAvail().x, begin.y + ImGui::GetTextLineHeight());
+
+    ImGui::GetWindowDrawList()->AddRectFilled(begin, end, ImGui::GetColorU32(color));
+}
+
+void GUIProfiler::Draw() {
+    if (ImGui::Begin("Profiler")) {
+        auto profiler = vm->GetProfiler();
+
+        if (!profiler) {
+            ImGui::Text("Profiling is off, start with --profile");
+            ImGui::End();
+            return;
+        }
+
+        if (ImGui::Button("Clear"))
+            profiler->Clear();
+
+        auto total = profiler->GetTotal();
+        ImGui::Text("%s", std::format("{} instructions counted", total).c_str());
+
+        auto hot_spots = profiler->GetHotSpots(HOT_SPOTS);
+        Long max_count = hot_spots.empty() ? 0 : hot_spots[0].count;
+
+        for (auto& hot_spot : hot_spots) {
+            auto [word, valid] = memory.PeekWord(hot_spot.pc);
+
+            std::string s_addr;
+            if (vm->Is32BitMode())
+                s_addr = std::format("0x{:0>8x}", hot_spot.pc);
+            
+            else
+                s_addr = std::format("0x{:0>16x}", hot_spot.pc);
+
+            std::string instr = valid ? std::string(RVInstruction::FromUInt32(word)) : "Unmapped Memory";
+
+            ShadeLine(hot_spot.count, max_count);
+            ImGui::Text("%6.2f%% %s %s", 100.0 * hot_spot.count / total, s_addr.c_str(), instr.c_str());
+        }
+    }
+
+    ImGui::End();
+}
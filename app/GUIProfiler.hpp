@@ -0,0 +1,27 @@
+#ifndef GUI_PROFILER_HPP
+#define GUI_PROFILER_HPP
+
+#include "VirtualMachine.hpp"
+#include "Memory.hpp"
+
+#include <memory>
+
+class GUIProfiler {
+    Memory& memory;
+
+    static constexpr size_t HOT_SPOTS = 64;
+
+public:
+    std::shared_ptr<VirtualMachine> vm;
+
+    GUIProfiler(std::shared_ptr<VirtualMachine> vm, Memory& memory) : memory{memory}, vm{vm} {}
+    ~GUIProfiler() = default;
+
+    // Shades the background of the next line by its share of the hottest
+    // instruction
+    static void ShadeLine(Long count, Long max_count);
+
+    void Draw();
+};
+
+#endif
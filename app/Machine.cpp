@@ -6,9 +6,12 @@
 
 #include <Memory.hpp>
 #include <RV64.hpp>
+#include <Scheduler.hpp>
+#include <Lockstep.hpp>
 
 #include "GUIMemoryViewer.hpp"
 #include "GUIAssembly.hpp"
+#include "GUIProfiler.hpp"
 #include "GUIInfo.hpp"
 #include "GUIRegs.hpp"
 #include "GUIHart.hpp"
@@ -24,6 +27,9 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <memory>
+#include <functional>
+#include <algorithm>
 
 #include "GDB.hpp"
 #include "ECalls.hpp"
@@ -68,7 +74,7 @@ int RunMachine(ArgsParser& args_parser) {
 
         Memory memory;
         {
-            auto ram = MemoryRAM::Create(BIOS_RAM_ADDRESS, 16 * 1024 * 1024);
+            auto ram = MemoryMappedRAM::Create(BIOS_RAM_ADDRESS, 16 * 1024 * 1024);
             memory.AddMemoryRegion(std::move(ram));
         }
         memory.ReadFileInto(bios_path, BIOS_RAM_ADDRESS);
@@ -82,6 +88,10 @@ int RunMachine(ArgsParser& args_parser) {
             harts.push_back(i);
         }
 
+        // Timer interrupts follow retired instructions instead of the host clock
+        if (args_parser.HasFlag("icount"))
+            Timer::Get(memory)->SetSource(Timer::Source::Instructions, 0);
+
         //GDBServer gdb_server(memory);
         //gdb_server.Run(8000);
 
@@ -99,6 +109,7 @@ int RunMachine(ArgsParser& args_parser) {
 
         GUIMemoryViewer mem_viewer(memory, vms[0], 0x0);
         GUIAssembly assembly(vms[0], memory);
+        GUIProfiler profiler(vms[0], memory);
         GUIInfo info(memory, vms[0]);
         GUIHart gui_harts(vms, harts);
         GUIRegs state(vms[0]);
@@ -114,6 +125,15 @@ int RunMachine(ArgsParser& args_parser) {
             if (args_parser.HasFlag("pause_on_restart"))
                 vm->SetPauseOnRestart(true);
 
+            if (args_parser.HasFlag("blocks"))
+                vm->SetExecutionEngine(VirtualMachine::ExecutionEngine::Block);
+
+            if (args_parser.HasFlag("jit"))
+                vm->SetExecutionEngine(VirtualMachine::ExecutionEngine::JIT);
+
+            if (args_parser.HasFlag("profile"))
+                vm->EnableProfiling(true);
+
             vm->Start();
         }
 
@@ -122,32 +142,64 @@ int RunMachine(ArgsParser& args_parser) {
 
         delta_time.Update();
 
-        std::vector<std::jthread> workers;
-        for (size_t i = 0; i < vms.size(); i++) {
-            workers.emplace_back(std::jthread([&args_parser](size_t i) {
-                try {
-                    vms[i]->Run();
+        auto RunGuarded = [&args_parser](const std::function<void()>& run) {
+            try {
+                run();
+            }
+            catch (VirtualMachine::VMException& e) {
+                auto dump_path = args_parser.GetValueOr<std::string>("dump_path", "dump.txt");
+
+                std::ofstream file(dump_path, std::ios_base::binary);
+                if (!file) {
+                    std::cerr << "Cannot open " << dump_path << " for writing\n";
+                    return -1;
                 }
-                catch (VirtualMachine::VMException& e) {
-                    auto dump_path = args_parser.GetValueOr<std::string>("dump_path", "dump.txt");
 
-                    std::ofstream file(dump_path, std::ios_base::binary);
-                    if (!file) {
-                        std::cerr << "Cannot open " << dump_path << " for writing\n";
-                        return -1;
-                    }
+                auto dump = e.dump();
 
-                    auto dump = e.dump();
+                file.write(dump.c_str(), dump.size());
+                file.close();
 
-                    file.write(dump.c_str(), dump.size());
-                    file.close();
+                throw e;
+            }
+            catch (...) {
+                std::rethrow_exception(std::current_exception());
+            }
 
-                    throw e;
-                }
-                catch (...) {
-                    std::rethrow_exception(std::current_exception());
-                }
-            }, i));
+            return 0;
+        };
+
+        // --lockstep interleaves the harts reproducibly on one thread,
+        // --workers=M multiplexes them onto M host threads
+        std::vector<VirtualMachine*> scheduled_harts;
+        for (auto& vm : vms)
+            scheduled_harts.push_back(vm.get());
+
+        std::unique_ptr<Lockstep> lockstep;
+        std::unique_ptr<Scheduler> scheduler;
+        if (args_parser.HasFlag("lockstep"))
+            lockstep = std::make_unique<Lockstep>(memory, scheduled_harts, std::max<Long>(args_parser.GetValueOr<Long>("quantum", Lockstep::QUANTUM), 1), args_parser.GetValueOr<Long>("seed", 0));
+
+        else if (args_parser.HasValue("workers"))
+            scheduler = std::make_unique<Scheduler>(scheduled_harts, std::max<size_t>(args_parser.GetValue<size_t>("workers"), 1));
+
+        std::vector<std::jthread> workers;
+        if (lockstep) {
+            workers.emplace_back(std::jthread([&RunGuarded, &lockstep]() {
+                RunGuarded([&lockstep]() { lockstep->Run(); });
+            }));
+        }
+        else if (scheduler) {
+            workers.emplace_back(std::jthread([&RunGuarded, &scheduler]() {
+                RunGuarded([&scheduler]() { scheduler->Run(); });
+            }));
+        }
+        else {
+            for (size_t i = 0; i < vms.size(); i++) {
+                workers.emplace_back(std::jthread([&RunGuarded](size_t i) {
+                    RunGuarded([i]() { vms[i]->Run(); });
+                }, i));
+            }
         }
 
         while (!window.ShouldClose()) {
@@ -159,11 +211,12 @@ int RunMachine(ArgsParser& args_parser) {
             ImGui::NewFrame();
 
             for (auto& vm : vms)
-                vm->UpdateTime(delta_time());
+                vm->UpdateStatistics(delta_time());
 
             auto vm = vms[gui_harts.GetSelectedHart()];
             mem_viewer.vm = vm;
             assembly.vm = vm;
+            profiler.vm = vm;
             info.vm = vm;
             state.vm = vm;
             stack.vm = vm;
@@ -184,6 +237,7 @@ int RunMachine(ArgsParser& args_parser) {
 
             mem_viewer.Draw();
             assembly.Draw();
+            profiler.Draw();
             info.Draw();
             gui_harts.Draw();
             state.Draw();
@@ -0,0 +1,10 @@
+#ifndef APP_SCREEN_HPP
+#define APP_SCREEN_HPP
+
+#include <Types.hpp>
+
+inline Word framebuffer_width;
+inline Word framebuffer_height;
+inline Address framebuffer_address;
+
+#endif
\ No newline at end of file
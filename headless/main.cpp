@@ -0,0 +1,375 @@
+#include <VirtualMachine.hpp>
+#include <Memory.hpp>
+#include <Timer.hpp>
+#include <Scheduler.hpp>
+#include <Lockstep.hpp>
+#include <Snapshot.hpp>
+#include <ForkRunner.hpp>
+#include <InputLog.hpp>
+#include <Profiler.hpp>
+
+#include "ArgsParser.hpp"
+#include "ECalls.hpp"
+#include "Screen.hpp"
+#include "VirtualMachines.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <format>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <sstream>
+
+// One line per child, empty lines and lines starting with # are skipped
+static std::vector<std::string> ReadForkInputs(const std::string& path) {
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for reading", path));
+
+    std::vector<std::string> inputs;
+    std::string line;
+
+    while (std::getline(file, line))
+        if (!line.empty() && line[0] != '#')
+            inputs.push_back(line);
+
+    return inputs;
+}
+
+// Patches are separated by spaces. xN=VALUE sets a register of hart 0,
+// H:xN=VALUE one of hart H and @ADDRESS=VALUE stores a long.
+static void ApplyPatches(Memory& memory, const std::string& line) {
+    std::istringstream patches(line);
+    std::string patch;
+
+    while (patches >> patch) {
+        auto equals = patch.find('=');
+        if (equals == std::string::npos)
+            throw std::runtime_error(std::format("Patch {} has no value", patch));
+
+        auto target = patch.substr(0, equals);
+        auto value = std::stoull(patch.substr(equals + 1), nullptr, 0);
+
+        if (target.starts_with('@')) {
+            memory.WriteLong(std::stoull(target.substr(1), nullptr, 0), value);
+            continue;
+        }
+
+        size_t hart = 0;
+        if (auto colon = target.find(':'); colon != std::string::npos) {
+            hart = std::stoull(target.substr(0, colon));
+            target = target.substr(colon + 1);
+        }
+
+        if (hart >= vms.size() || !target.starts_with('x'))
+            throw std::runtime_error(std::format("Cannot apply patch {}", patch));
+
+        auto reg = vms[hart]->GetRegister(std::stoull(target.substr(1)));
+        if (!reg)
+            throw std::runtime_error(std::format("Cannot apply patch {}", patch));
+
+        reg.Value().u64 = value;
+    }
+}
+
+// Runs the harts without a window, GUI or OpenGL. The machine stops when a
+// hart calls ecall_exit or reaches --max_cycles, --save_snapshot then keeps
+// it for --load_snapshot. --record logs the console input of a lockstep run,
+// --replay runs it again from that log without reading stdin. --profile
+// writes the hottest instructions of all harts and a listing to a file.
+int main(int argc, const char** argv) {
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++)
+        args.push_back(argv[i]);
+
+    ArgsParser args_parser(args);
+
+    if (!args_parser.HasValue("bios_file")) {
+        std::cerr << "--bios_file is required" << std::endl;
+        return -1;
+    }
+
+    auto bios_path = args_parser.GetValue<std::string>("bios_file");
+
+    Hart cores = args_parser.GetValueOr<Hart>("cores", 1);
+    Long max_cycles = args_parser.GetValueOr<Long>("max_cycles", -1ULL);
+
+    if (cores == 0) cores = 1;
+
+    bool lockstep = args_parser.HasFlag("lockstep");
+    Long quantum = std::max<Long>(args_parser.GetValueOr<Long>("quantum", Lockstep::QUANTUM), 1);
+    Long seed = args_parser.GetValueOr<Long>("seed", 0);
+
+    std::unique_ptr<InputLog> input_log;
+
+    try {
+        if (args_parser.HasValue("replay")) {
+            input_log = InputLog::Replay(args_parser.GetValue<std::string>("replay"));
+
+            auto& header = input_log->GetHeader();
+            cores = std::max<Long>(header.cores, 1);
+            quantum = std::max<Long>(header.quantum, 1);
+            seed = header.seed;
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Only a lockstep run depends on nothing but its inputs
+    if (input_log || args_parser.HasValue("record"))
+        lockstep = true;
+
+    framebuffer_width = 800;
+    framebuffer_height = 600;
+    framebuffer_address = 0xffe00000;
+
+    std::atomic<SWord> exit_code = 0;
+
+    auto StopAll = []() {
+        for (auto& vm : vms)
+            vm->Stop();
+    };
+
+    RegisterECalls();
+
+    std::atomic<bool> exited = false;
+
+    SetExitHandler([&exit_code, &exited, StopAll](SWord code) {
+        exit_code = code;
+        exited = true;
+        StopAll();
+    });
+
+    constexpr Address BIOS_RAM_ADDRESS = 0x1000;
+
+    Memory memory;
+    {
+        auto ram = MemoryMappedRAM::Create(BIOS_RAM_ADDRESS, 16 * 1024 * 1024);
+        memory.AddMemoryRegion(std::move(ram));
+    }
+    memory.ReadFileInto(bios_path, BIOS_RAM_ADDRESS);
+
+    // Nothing is displayed, the guest draws into plain memory
+    {
+        auto framebuffer = MemoryMappedRAM::Create(framebuffer_address, framebuffer_width * framebuffer_height * sizeof(Word));
+        memory.AddMemoryRegion(std::move(framebuffer));
+    }
+
+    // Children of --fork_inputs do not inherit the host clock thread
+    if (lockstep || args_parser.HasFlag("icount") || args_parser.HasValue("fork_inputs"))
+        Timer::Get(memory)->SetSource(Timer::Source::Instructions, 0);
+
+    for (Hart i = 0; i < cores; i++) {
+        auto vm = std::make_shared<VirtualMachine>(memory, BIOS_RAM_ADDRESS, i);
+
+        if (args_parser.HasFlag("blocks"))
+            vm->SetExecutionEngine(VirtualMachine::ExecutionEngine::Block);
+
+        if (args_parser.HasFlag("jit"))
+            vm->SetExecutionEngine(VirtualMachine::ExecutionEngine::JIT);
+
+        if (args_parser.HasValue("profile"))
+            vm->EnableProfiling(true);
+
+        // Other harts wait for ecall_start_cpu
+        if (i != 0)
+            vm->Pause();
+
+        vm->Start();
+        vms.push_back(vm);
+    }
+
+    std::vector<VirtualMachine*> harts;
+    for (auto& vm : vms)
+        harts.push_back(vm.get());
+
+    // Continues from a warmed up machine instead of booting
+    if (args_parser.HasValue("load_snapshot")) {
+        try {
+            Snapshot::Load(args_parser.GetValue<std::string>("load_snapshot")).Restore(memory, harts);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // A recording starts at whatever mtime the snapshot left, a replay has
+    // to start at the same one
+    try {
+        auto timer = Timer::Get(memory);
+
+        if (input_log)
+            timer->SetSource(Timer::Source::Instructions, input_log->GetHeader().time);
+        else if (args_parser.HasValue("record"))
+            input_log = InputLog::Record(args_parser.GetValue<std::string>("record"), { cores, quantum, seed, timer->Time() });
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    SetInputLog(input_log.get());
+
+    auto ReportFailure = [&args_parser, &exit_code](VirtualMachine::VMException& e) {
+        auto dump_path = args_parser.GetValueOr<std::string>("dump_path", "dump.txt");
+
+        std::ofstream file(dump_path, std::ios_base::binary);
+        if (file) {
+            auto dump = e.dump();
+            file.write(dump.c_str(), dump.size());
+        }
+
+        std::cerr << std::format("Hart {} failed: {}, state dumped to {}", e.hart_id, e.what(), dump_path) << std::endl;
+        exit_code = EXIT_FAILURE;
+    };
+
+    // --lockstep interleaves the harts on this thread and is reproducible,
+    // --workers=M multiplexes them onto M host threads, otherwise every hart
+    // gets its own
+    auto RunHarts = [&](Long max_cycles) {
+        if (lockstep) {
+            Lockstep runner(memory, harts, quantum, seed);
+
+            try {
+                runner.Run(max_cycles);
+            }
+            catch (VirtualMachine::VMException& e) {
+                ReportFailure(e);
+            }
+        }
+        else if (args_parser.HasValue("workers")) {
+            Scheduler scheduler(harts, std::max<size_t>(args_parser.GetValue<size_t>("workers"), 1));
+
+            try {
+                scheduler.Run(max_cycles);
+            }
+            catch (VirtualMachine::VMException& e) {
+                ReportFailure(e);
+            }
+        }
+        else {
+            std::vector<std::jthread> workers;
+            for (size_t i = 0; i < vms.size(); i++) {
+                workers.emplace_back([&ReportFailure, max_cycles, StopAll](size_t i) {
+                    try {
+                        vms[i]->Run(max_cycles);
+                    }
+                    catch (VirtualMachine::VMException& e) {
+                        ReportFailure(e);
+                    }
+
+                    StopAll();
+                }, i);
+            }
+        }
+    };
+
+    auto CountInstructions = []() {
+        Long instructions = 0;
+        for (auto& vm : vms)
+            instructions += vm->GetCycles();
+
+        return instructions;
+    };
+
+    // --fork_inputs runs the machine up to --fork_at, then continues it in
+    // one child process per line of the file, with that line's patches
+    if (args_parser.HasValue("fork_inputs")) {
+        std::vector<std::string> inputs;
+
+        try {
+            inputs = ReadForkInputs(args_parser.GetValue<std::string>("fork_inputs"));
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        RunHarts(args_parser.GetValueOr<Long>("fork_at", 0));
+
+        if (exited || exit_code != 0) {
+            std::cerr << std::format("Machine exited with {} before it could fork", exit_code.load()) << std::endl;
+            return exit_code;
+        }
+
+        auto parallel = args_parser.GetValueOr<size_t>("fork_parallel", std::thread::hardware_concurrency());
+
+        auto results = ForkRunner::Run(inputs.size(), [&](size_t child) {
+            for (auto& vm : vms)
+                vm->Start();
+
+            ApplyPatches(memory, inputs[child]);
+            RunHarts(max_cycles);
+
+            return std::format("exit {}, {} instructions", exit_code.load(), CountInstructions());
+        }, parallel);
+
+        int status = 0;
+
+        for (size_t i = 0; i < results.size(); i++) {
+            std::cout << std::format("Child {} {}: {}", i, results[i].completed ? "finished" : "failed", results[i].output) << std::endl;
+
+            if (!results[i].completed)
+                status = EXIT_FAILURE;
+        }
+
+        vms.clear();
+
+        return status;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    RunHarts(max_cycles);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto instructions = CountInstructions();
+
+    std::cerr << std::format("Executed {} instructions in {:.3f} s, {:.2f} MIPS", instructions, elapsed.count(), instructions / elapsed.count() / 1e6) << std::endl;
+
+    if (args_parser.HasValue("save_snapshot")) {
+        try {
+            Snapshot::Capture(memory, harts).Save(args_parser.GetValue<std::string>("save_snapshot"));
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            exit_code = EXIT_FAILURE;
+        }
+    }
+
+    if (args_parser.HasValue("profile")) {
+        auto profile_path = args_parser.GetValue<std::string>("profile");
+
+        Profiler profiler;
+        for (auto& vm : vms)
+            profiler.Merge(*vm->GetProfiler());
+
+        std::ofstream file(profile_path);
+        file << profiler.HotSpotReport(memory, args_parser.GetValueOr<size_t>("profile_top", 50)) << std::endl;
+        file << profiler.Listing(memory);
+
+        if (!file) {
+            std::cerr << std::format("Could not write the profile to {}", profile_path) << std::endl;
+            exit_code = EXIT_FAILURE;
+        }
+    }
+
+    if (input_log && input_log->IsReplaying() && input_log->GetRemaining() != 0)
+        std::cerr << std::format("Replay stopped with {} recorded inputs left", input_log->GetRemaining()) << std::endl;
+
+    SetInputLog(nullptr);
+    vms.clear();
+
+    return exit_code;
+}
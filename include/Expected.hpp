@@ -2,7 +2,8 @@
 #define EXPECTED_HPP
 
 #include <type_traits>
-#include <memory>
+#include <optional>
+#include <utility>
 
 template <typename ErrorType>
 class Unexpected {
@@ -32,49 +33,53 @@ public:
     using ErrorTypeValue = Unexpected<ErrorType>::ErrorTypeValue;
 
 private:
-    std::unique_ptr<TypeValue> value = nullptr;
-    std::unique_ptr<Unexpected<ErrorType>> error = nullptr;
+    // Stored inline so hot paths such as guest memory accesses do not
+    // allocate
+    std::optional<TypeValue> value;
+    std::optional<Unexpected<ErrorType>> error;
 
 public:
-    Expected(const TypeValue& val) : value{std::make_unique<TypeValue>(val)} {}
-    Expected(TypeValue&& val) : value{std::make_unique<TypeValue>(std::move(val))} {}
+    Expected(const TypeValue& val) : value{val} {}
+    Expected(TypeValue&& val) : value{std::move(val)} {}
     
-    Expected(const Unexpected<ErrorType>& err) : error{std::make_unique<Unexpected<ErrorType>>(err)} {}
-    Expected(Unexpected<ErrorType>&& err) : error{std::make_unique<Unexpected<ErrorType>>(std::move(err))} {}
-
-    Expected(const Expected& exp) {
-        if (exp.value)
-            value = std::make_unique<TypeValue>(*exp.value);
-        
-        if (exp.error)
-            error = std::make_unique<Unexpected<ErrorType>>(*exp.error);
-    }
+    Expected(const Unexpected<ErrorType>& err) : error{err} {}
+    Expected(Unexpected<ErrorType>&& err) : error{std::move(err)} {}
 
+    Expected(const Expected& exp) : value{exp.value}, error{exp.error} {}
     Expected(Expected&& exp) : value{std::move(exp.value)}, error{std::move(exp.error)} {}
 
     Expected& operator=(const Expected& exp) {
+        value.reset();
+        error.reset();
+
         if (exp.value)
-            value = std::make_unique<TypeValue>(*exp.value);
+            value.emplace(*exp.value);
         
         if (exp.error)
-            error = std::make_unique<Unexpected<ErrorType>>(*exp.error);
+            error.emplace(*exp.error);
         
         return *this;
     }
 
     Expected& operator=(Expected&& exp) {
-        value = std::move(exp.value);
-        error = std::move(exp.error);
+        value.reset();
+        error.reset();
+
+        if (exp.value)
+            value.emplace(std::move(*exp.value));
+        
+        if (exp.error)
+            error.emplace(std::move(*exp.error));
 
         return *this;
     }
 
     bool HasValue() const {
-        return value != nullptr;
+        return value.has_value();
     }
 
     bool HasErrorType() const {
-        return error != nullptr;
+        return error.has_value();
     }
 
     TypeValue Value() const {
@@ -108,38 +113,34 @@ public:
 
 private:
     TypeValue* value = nullptr;
-    std::unique_ptr<Unexpected<ErrorType>> error = nullptr;
+    std::optional<Unexpected<ErrorType>> error;
 
 public:
     Expected(TypeValue& val) : value{&val} {}
     Expected(TypeValue&& val) = delete;
     
-    Expected(const Unexpected<ErrorType>& err) : error{std::make_unique<Unexpected<ErrorType>>(err)} {}
-    Expected(Unexpected<ErrorType>&& err) : error{std::make_unique<Unexpected<ErrorType>>(std::move(err))} {}
+    Expected(const Unexpected<ErrorType>& err) : error{err} {}
+    Expected(Unexpected<ErrorType>&& err) : error{std::move(err)} {}
 
-    Expected(const Expected& exp) {
-        if (exp.value)
-            value = exp.value;
-        
-        if (exp.error)
-            error = std::make_unique<Unexpected<ErrorType>>(*exp.error);
-    }
-
-    Expected(Expected&& exp) : value{std::move(exp.value)}, error{std::move(exp.error)} {}
+    Expected(const Expected& exp) : value{exp.value}, error{exp.error} {}
+    Expected(Expected&& exp) : value{exp.value}, error{std::move(exp.error)} {}
 
     Expected& operator=(const Expected& exp) {
-        if (exp.value)
-            value = exp.value;
-        
+        value = exp.value;
+        error.reset();
+
         if (exp.error)
-            error = std::make_unique<Unexpected<ErrorType>>(*exp.error);
+            error.emplace(*exp.error);
         
         return *this;
     }
 
     Expected& operator=(Expected&& exp) {
-        value = std::move(exp.value);
-        error = std::move(exp.error);
+        value = exp.value;
+        error.reset();
+
+        if (exp.error)
+            error.emplace(std::move(*exp.error));
 
         return *this;
     }
@@ -149,7 +150,7 @@ public:
     }
 
     bool HasErrorType() const {
-        return error != nullptr;
+        return error.has_value();
     }
 
     TypeValue& Value() const {
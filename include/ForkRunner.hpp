@@ -0,0 +1,27 @@
+#ifndef FORK_RUNNER_HPP
+#define FORK_RUNNER_HPP
+
+#include "Types.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Fans a warmed up machine out into child processes. Every child is a fork
+// of the caller, so it shares all RAM the caller had touched copy on write
+// with the others and only pays for the pages it writes itself.
+class ForkRunner {
+public:
+    struct Result {
+        // The child returned from run instead of crashing or throwing
+        bool completed = false;
+        std::string output;
+    };
+
+    // Calls run(i) in child i, at most parallel children at a time, and
+    // collects what it returns over a pipe. Children only inherit the calling
+    // thread, so no other thread may hold a lock the children need.
+    static std::vector<Result> Run(size_t children, const std::function<std::string(size_t child)>& run, size_t parallel);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef INPUT_LOG_HPP
+#define INPUT_LOG_HPP
+
+#include "Types.hpp"
+
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Inputs a machine takes from outside of the guest, in the order the guest
+// consumed them. Recording writes them to a file, replaying hands them back
+// instead of asking the host. The schedule itself is not logged: under
+// Lockstep with the same quantum and seed, hart interleaving, LR/SC and AMO
+// order and timer interrupts only depend on these inputs and the mtime the
+// run started at.
+class InputLog {
+public:
+    static constexpr Long MAGIC = 0x594c505234365652; // "RV64RPLY"
+    static constexpr Long VERSION = 2;
+
+    enum class Event : Byte {
+        ConsoleInput = 1
+    };
+
+    // What the recorded machine looked like, replay has to match it
+    struct Header {
+        Long cores = 1;
+        Long quantum = 0;
+        Long seed = 0;
+
+        // mtime when the run started, replay continues instruction time from it
+        Long time = 0;
+    };
+
+private:
+    struct Entry {
+        Event event;
+        Hart hart;
+        Long cycles;
+        std::optional<std::string> data;
+    };
+
+    Header header;
+
+    std::ofstream file;
+    std::deque<Entry> entries;
+    bool replaying = false;
+
+    std::mutex lock;
+
+    InputLog() = default;
+
+public:
+    static std::unique_ptr<InputLog> Record(const std::string& path, const Header& header);
+    static std::unique_ptr<InputLog> Replay(const std::string& path);
+
+    // Recording asks read for the input and logs it, replaying returns the
+    // logged one. Throws when the replayed run asks at another point than
+    // the recorded one did.
+    std::optional<std::string> Log(Event event, Hart hart, Long cycles, const std::function<std::optional<std::string>()>& read);
+
+    inline const Header& GetHeader() const { return header; }
+    inline bool IsReplaying() const { return replaying; }
+
+    // Inputs that were recorded but not asked for yet
+    inline size_t GetRemaining() const { return entries.size(); }
+};
+
+#endif
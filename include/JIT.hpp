@@ -0,0 +1,50 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <vector>
+#include <memory>
+
+#include "Types.hpp"
+#include "RV64.hpp"
+
+// Translates decoded blocks into x86-64 host code. Integer register
+// arithmetic is emitted inline and operates directly on the guest register
+// file. Every other instruction calls back into the interpreter through the
+// fallback, which returns true when the block has to be left early.
+class JIT {
+public:
+    using BlockFunction = size_t (*)(void* context, Long* regs);
+    using Fallback = bool (*)(void* context, size_t index);
+
+    static constexpr size_t CODE_CACHE_SIZE = 16 * 1024 * 1024;
+
+private:
+    Byte* code_cache;
+    const size_t code_cache_size;
+    size_t code_cache_used = 0;
+
+    const Fallback fallback;
+
+    JIT(Byte* code_cache, size_t code_cache_size, Fallback fallback) : code_cache{code_cache}, code_cache_size{code_cache_size}, fallback{fallback} {}
+
+public:
+    JIT(const JIT&) = delete;
+    JIT(JIT&&) = delete;
+    ~JIT();
+
+    static bool IsSupported();
+    static bool CanInline(const RVInstruction& instr);
+
+    // Returns nullptr once the code cache is full. The cache stays writable
+    // only while a block is copied into it.
+    BlockFunction Compile(const std::vector<const RVInstruction*>& instrs);
+
+    inline void Reset() { code_cache_used = 0; }
+
+    inline size_t GetCodeCacheUsed() const { return code_cache_used; }
+
+    // Returns nullptr when the host cannot run generated code
+    static std::unique_ptr<JIT> Create(Fallback fallback, size_t code_cache_size = CODE_CACHE_SIZE);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include "Types.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <vector>
+
+class Memory;
+class VirtualMachine;
+
+// Interleaves all harts on the calling thread, each one running a fixed
+// quantum of instructions per turn. Timer interrupts follow retired
+// instructions, so a run only depends on the program, the quantum and the
+// seed that shuffles the turn order of every round.
+class Lockstep {
+public:
+    static constexpr Long QUANTUM = 1000;
+
+private:
+    Memory& memory;
+    const std::vector<VirtualMachine*> harts;
+
+    const Long quantum;
+    std::mt19937_64 random;
+
+    std::vector<size_t> order;
+
+    // Lets harts paused or asleep in WFI be woken by other threads
+    std::mutex wake_lock;
+    std::condition_variable wake_condition;
+    bool woken = false;
+
+    void Shuffle();
+    bool IsFinished() const;
+    void WaitForWake();
+
+public:
+    Lockstep(Memory& memory, const std::vector<VirtualMachine*>& harts, Long quantum = QUANTUM, Long seed = 0);
+    Lockstep(const Lockstep&) = delete;
+    Lockstep(Lockstep&&) = delete;
+    ~Lockstep();
+
+    // Returns once every hart has stopped. A hart reaching max_cycles stops
+    // all of them.
+    void Run(Long max_cycles = -1ULL);
+};
+
+#endif
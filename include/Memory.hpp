@@ -3,14 +3,25 @@
 
 #include <array>
 #include <vector>
+#include <map>
 #include <memory>
 #include <functional>
 #include <unordered_map>
 #include <type_traits>
 #include <mutex>
+#include <atomic>
 #include <utility>
+#include <cstring>
+#include <bit>
 
 #include "Types.hpp"
+#include "Expected.hpp"
+
+enum class MemoryFault : Byte {
+    Misaligned,
+    Unmapped,
+    Protected
+};
 
 class MemoryRegion {
 public:
@@ -28,9 +39,74 @@ public:
     static constexpr Long TYPE_SIMPLE_DEVICE_CONTROLLER = 6;
     static constexpr Long TYPE_FRAMEBUFFER = 8;
 
-    MemoryRegion(Long type, Long flags, Address base, Address size, bool readable, bool writable) : type{type}, flags{flags}, base{base}, size{size}, readable{readable}, writable{writable} {}
+    static constexpr Long CODE_PAGE_SIZE = 0x1000;
+
+private:
+    // One bit per page of this region that a hart has decoded instructions
+    // from. Stores into a marked page must invalidate the decoded copies.
+    const size_t code_pages_count;
+    std::unique_ptr<std::atomic<Long>[]> code_pages;
+
+    // One bit per page written since Memory last captured or restored an
+    // image of this region
+    std::unique_ptr<std::atomic<Long>[]> dirty_pages;
+
+protected:
+    // Set by regions whose contents live directly in host memory
+    Byte* host_memory = nullptr;
+
+public:
+    MemoryRegion(Long type, Long flags, Address base, Address size, bool readable, bool writable) : type{type}, flags{flags}, base{base}, size{size}, readable{readable}, writable{writable}, code_pages_count{((size + CODE_PAGE_SIZE - 1) / CODE_PAGE_SIZE + 63) / 64}, code_pages{std::make_unique<std::atomic<Long>[]>(code_pages_count)}, dirty_pages{std::make_unique<std::atomic<Long>[]>(code_pages_count)} {}
     virtual ~MemoryRegion() = default;
 
+    // Returns true when the page was not marked before
+    inline bool MarkCodePage(Address address) {
+        auto page = address / CODE_PAGE_SIZE;
+        auto bit = 1ULL << (page & 63);
+        return !(code_pages[page >> 6].fetch_or(bit, std::memory_order_relaxed) & bit);
+    }
+
+    inline bool IsCodePage(Address address) const {
+        auto page = address / CODE_PAGE_SIZE;
+        return (code_pages[page >> 6].load(std::memory_order_relaxed) >> (page & 63)) & 1;
+    }
+
+    inline bool ClearCodePage(Address address) {
+        auto page = address / CODE_PAGE_SIZE;
+        auto bit = 1ULL << (page & 63);
+        return code_pages[page >> 6].fetch_and(~bit, std::memory_order_relaxed) & bit;
+    }
+
+    inline void MarkDirtyPage(Address address) {
+        auto page = address / CODE_PAGE_SIZE;
+        auto bit = 1ULL << (page & 63);
+        auto& bits = dirty_pages[page >> 6];
+
+        if (!(bits.load(std::memory_order_relaxed) & bit))
+            bits.fetch_or(bit, std::memory_order_relaxed);
+    }
+
+    // Calls function with the offset of every dirty page
+    template <typename Function>
+    inline void ForEachDirtyPage(Function function) const {
+        for (size_t i = 0; i < code_pages_count; i++) {
+            auto bits = dirty_pages[i].load(std::memory_order_relaxed);
+
+            for (; bits; bits &= bits - 1)
+                function((i * 64 + std::countr_zero(bits)) * CODE_PAGE_SIZE);
+        }
+    }
+
+    inline void ClearDirtyPages() {
+        for (size_t i = 0; i < code_pages_count; i++)
+            dirty_pages[i].store(0, std::memory_order_relaxed);
+    }
+
+    // Returns nullptr when the region is not backed by host memory
+    inline Byte* HostPointer(Address offset) const {
+        return host_memory ? host_memory + offset : nullptr;
+    }
+
     virtual Long ReadLong(Address) const { return 0; }
     virtual Word ReadWord(Address) const;
     virtual Half ReadHalf(Address) const;
@@ -103,6 +179,52 @@ public:
     static std::unique_ptr<MemoryRAM> Create(Address base, Address size);
 };
 
+// RAM backed by a single anonymous host mapping. Only address space is
+// reserved up front, so even very large RAM sizes commit no host memory
+// until the guest touches it. On Windows the pages are committed by an
+// exception handler on first access.
+class MemoryMappedRAM : public MemoryRegion {
+public:
+    static constexpr Long PAGE_SIZE = 0x1000;
+
+private:
+    mutable std::mutex lock;
+
+    MemoryMappedRAM(Byte* memory, Address base, Address size);
+
+public:
+    MemoryMappedRAM(const MemoryMappedRAM&) = delete;
+    MemoryMappedRAM(MemoryMappedRAM&&) = delete;
+    ~MemoryMappedRAM();
+
+    Long ReadLong(Address address) const override { return Read<Long>(address); }
+    Word ReadWord(Address address) const override { return Read<Word>(address); }
+    Half ReadHalf(Address address) const override { return Read<Half>(address); }
+    Byte ReadByte(Address address) const override { return Read<Byte>(address); }
+
+    void WriteLong(Address address, Long vlong) override { Write(address, vlong); }
+    void WriteWord(Address address, Word word) override { Write(address, word); }
+    void WriteHalf(Address address, Half half) override { Write(address, half); }
+    void WriteByte(Address address, Byte byte) override { Write(address, byte); }
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    template <typename Type>
+    inline Type Read(Address address) const {
+        Type value;
+        std::memcpy(&value, host_memory + address, sizeof(Type));
+        return value;
+    }
+
+    template <typename Type>
+    inline void Write(Address address, Type value) {
+        std::memcpy(host_memory + address, &value, sizeof(Type));
+    }
+
+    static std::unique_ptr<MemoryMappedRAM> Create(Address base, Address size);
+};
+
 class Memory {
 public:
     static constexpr Long TOTAL_MEMORY = 0x100000000;
@@ -110,18 +232,121 @@ public:
     static constexpr Long TOTAL_PAGES = TOTAL_MEMORY / PAGE_SIZE;
     static constexpr Long WORDS_PER_PAGE = PAGE_SIZE / sizeof(Word);
 
+    static constexpr Hart MAX_HARTS = 64;
+    static constexpr Address RESERVATION_GRANULE = 8;
+
 private:
     std::vector<std::shared_ptr<MemoryRegion>> regions;
 
-    mutable std::unordered_map<Hart, Address> reservations;
-    mutable std::mutex lock;
+    static constexpr Address NO_RESERVATION = ~0ULL;
+
+    // Each hart owns one slot on its own cache line, so taking and checking
+    // reservations does not contend between harts. Only the owner sets its
+    // slot, any store clears the slots holding the granule it wrote. SC also
+    // compares the value the LR read, so a clear racing with it can at most
+    // let a store of the same value through.
+    struct alignas(64) ReservationSlot {
+        std::atomic<Address> granule = NO_RESERVATION;
+        Long value = 0;
+    };
 
-    MemoryRegion* GetMemoryRegion(Address address);
-    const MemoryRegion* GetMemoryRegion(Address address) const;
+    mutable std::array<ReservationSlot, MAX_HARTS> reservations;
+    mutable std::atomic<Long> active_reservations = 0;
+
+    // Set while all harts run on one thread, atomics then use plain loads
+    // and stores
+    bool single_threaded = false;
+
+    template<typename Type>
+    Expected<Type, MemoryFault> LoadReserved(Address address, Hart hart_id) const;
+
+    template<typename Type>
+    Expected<bool, MemoryFault> StoreConditional(Address address, Type value, Hart hart_id);
+
+    // Min and Max compare signed or unsigned following Type
+    enum class AtomicOperation : Byte { Swap, Add, And, Or, Xor, Min, Max };
+
+    template<typename Type>
+    Expected<Type, MemoryFault> Atomic(Address address, Type operand, AtomicOperation operation);
+
+    // Physical addresses are dispatched to regions through a radix tree
+    // over the 64 bit address space, down to page granularity. A slot maps
+    // straight to its region when a single region covers all of it, and only
+    // gets children when regions start or end inside of it. Pages that are
+    // shared by several regions or only partly mapped are resolved by
+    // scanning the regions in the order they were added.
+    struct DispatchSlot {
+        MemoryRegion* region = nullptr;
+        bool mixed = false;
+        std::unique_ptr<DispatchSlot[]> children;
+    };
+
+    static constexpr std::array<Byte, 5> DISPATCH_SHIFTS = {52, 42, 32, 22, 12};
+    static constexpr size_t DISPATCH_PAGE_LEVEL = DISPATCH_SHIFTS.size() - 1;
+
+    static constexpr size_t DispatchChildren(size_t level) {
+        return 1ULL << (DISPATCH_SHIFTS[level - 1] - DISPATCH_SHIFTS[level]);
+    }
+
+    struct DispatchTable {
+        Long id;
+        std::vector<MemoryRegion*> regions;
+        std::unique_ptr<DispatchSlot[]> root;
+    };
+
+    // Tables are never modified once published. Replaced tables are kept
+    // alive because other harts may still be looking up through them.
+    std::vector<std::unique_ptr<DispatchTable>> dispatch_tables;
+    std::atomic<const DispatchTable*> dispatch = nullptr;
+
+    void InsertDispatch(DispatchSlot& slot, MemoryRegion* region, Address start, size_t level);
+    void RebuildDispatch();
+
+    MemoryRegion* FindMemoryRegion(Address address) const;
+
+    inline MemoryRegion* GetMemoryRegion(Address address) { return FindMemoryRegion(address); }
+    inline const MemoryRegion* GetMemoryRegion(Address address) const { return FindMemoryRegion(address); }
 
     Address max_address = 0;
     Address memory_size = 0;
 
+    std::atomic<Long> code_generation = 0;
+    std::atomic<Long> code_mark_generation = 0;
+
+    inline void NotifyWrite(MemoryRegion* region, Address address) {
+        if (HasReservations())
+            ClearReservations(address);
+
+        address -= region->base;
+        region->MarkDirtyPage(address);
+
+        if (region->IsCodePage(address) && region->ClearCodePage(address))
+            code_generation.fetch_add(1, std::memory_order_release);
+    }
+
+public:
+    using PageImage = std::shared_ptr<const std::array<Byte, PAGE_SIZE>>;
+
+    // The contents of a host backed RAM region by page offset. Pages holding
+    // only zeros are left out, pages that did not change are shared between
+    // images.
+    struct RegionImage {
+        Address base;
+        Address size;
+        std::map<Address, PageImage> pages;
+    };
+
+private:
+    // The pages of the image last captured or restored, the dirty bits of
+    // each region are relative to it
+    std::unordered_map<const MemoryRegion*, std::map<Address, PageImage>> image_pages;
+
+    template<typename Type>
+    Expected<Type, MemoryFault> Load(Address address) const;
+
+    template<typename Type>
+    Expected<bool, MemoryFault> Store(Address address, Type value);
+
     class MemoryPMARom : public MemoryRegion {
     private:
         const std::vector<std::shared_ptr<MemoryRegion>>& regions;
@@ -176,6 +401,18 @@ public:
     Memory& operator=(const Memory&) = delete;
     Memory& operator=(Memory&&) = delete;
 
+    // Guest accesses report faults instead of throwing so they can be
+    // turned into precise traps
+    Expected<Long, MemoryFault> LoadLong(Address address) const;
+    Expected<Word, MemoryFault> LoadWord(Address address) const;
+    Expected<Half, MemoryFault> LoadHalf(Address address) const;
+    Expected<Byte, MemoryFault> LoadByte(Address address) const;
+
+    Expected<bool, MemoryFault> StoreLong(Address address, Long vlong);
+    Expected<bool, MemoryFault> StoreWord(Address address, Word word);
+    Expected<bool, MemoryFault> StoreHalf(Address address, Half half);
+    Expected<bool, MemoryFault> StoreByte(Address address, Byte byte);
+
     Long ReadLong(Address address) const;
     Word ReadWord(Address address) const;
     Half ReadHalf(Address address) const;
@@ -191,25 +428,25 @@ public:
     void WriteHalf(Address address, Half half);
     void WriteByte(Address address, Byte byte);
 
-    Long AtomicSwapL(Address address, Long vlong);
-    Long AtomicAddL(Address address, Long vlong);
-    Long AtomicAndL(Address address, Long vlong);
-    Long AtomicOrL(Address address, Long vlong);
-    Long AtomicXorL(Address address, Long vlong);
-    SLong AtomicMinL(Address address, SLong vlong);
-    Long AtomicMinUL(Address address, Long vlong);
-    SLong AtomicMaxL(Address address, SLong vlong);
-    Long AtomicMaxUL(Address address, Long vlong);
-
-    Word AtomicSwapW(Address address, Word word);
-    Word AtomicAddW(Address address, Word word);
-    Word AtomicAndW(Address address, Word word);
-    Word AtomicOrW(Address address, Word word);
-    Word AtomicXorW(Address address, Word word);
-    SWord AtomicMinW(Address address, SWord word);
-    Word AtomicMinUW(Address address, Word word);
-    SWord AtomicMaxW(Address address, SWord word);
-    Word AtomicMaxUW(Address address, Word word);
+    Expected<Long, MemoryFault> AtomicSwapL(Address address, Long vlong);
+    Expected<Long, MemoryFault> AtomicAddL(Address address, Long vlong);
+    Expected<Long, MemoryFault> AtomicAndL(Address address, Long vlong);
+    Expected<Long, MemoryFault> AtomicOrL(Address address, Long vlong);
+    Expected<Long, MemoryFault> AtomicXorL(Address address, Long vlong);
+    Expected<SLong, MemoryFault> AtomicMinL(Address address, SLong vlong);
+    Expected<Long, MemoryFault> AtomicMinUL(Address address, Long vlong);
+    Expected<SLong, MemoryFault> AtomicMaxL(Address address, SLong vlong);
+    Expected<Long, MemoryFault> AtomicMaxUL(Address address, Long vlong);
+
+    Expected<Word, MemoryFault> AtomicSwapW(Address address, Word word);
+    Expected<Word, MemoryFault> AtomicAddW(Address address, Word word);
+    Expected<Word, MemoryFault> AtomicAndW(Address address, Word word);
+    Expected<Word, MemoryFault> AtomicOrW(Address address, Word word);
+    Expected<Word, MemoryFault> AtomicXorW(Address address, Word word);
+    Expected<SWord, MemoryFault> AtomicMinW(Address address, SWord word);
+    Expected<Word, MemoryFault> AtomicMinUW(Address address, Word word);
+    Expected<SWord, MemoryFault> AtomicMaxW(Address address, SWord word);
+    Expected<Word, MemoryFault> AtomicMaxUW(Address address, Word word);
 
     void WriteLongs(Address address, const std::vector<Long>& longs);
     void WriteWords(Address address, const std::vector<Word>& words);
@@ -220,11 +457,65 @@ public:
     std::vector<std::pair<Long, bool>> PeekLongs(Address address, Address cont) const;
     std::vector<std::pair<Word, bool>> PeekWords(Address address, Address count) const;
 
-    Long ReadLongReserved(Address address, Hart hart_id) const;
-    Word ReadWordReserved(Address address, Hart hart_id) const;
+    Expected<Long, MemoryFault> LoadLongReserved(Address address, Hart hart_id) const;
+    Expected<Word, MemoryFault> LoadWordReserved(Address address, Hart hart_id) const;
+
+    // The value is false when the reservation was lost and nothing was stored
+    Expected<bool, MemoryFault> StoreLongConditional(Address address, Long vlong, Hart hart_id);
+    Expected<bool, MemoryFault> StoreWordConditional(Address address, Word word, Hart hart_id);
+
+    // Only change while no hart is running
+    inline void SetSingleThreaded(bool single_threaded) { this->single_threaded = single_threaded; }
+    inline bool IsSingleThreaded() const { return single_threaded; }
+
+    inline bool HasReservations() const {
+        return active_reservations.load(std::memory_order_acquire) != 0;
+    }
+
+    // Stores that bypass Memory, such as through HostPointer, report their
+    // physical range here while HasReservations is true
+    void ClearReservations(Address address, Address bytes = 1) const;
+
+    void MarkCodePage(Address address);
 
-    bool WriteLongConditional(Address address, Long vlong, Hart hart_id);
-    bool WriteWordConditional(Address address, Word word, Hart hart_id);
+    // Shares the region mapped at the address, nullptr when there is none
+    inline std::shared_ptr<MemoryRegion> GetSharedRegion(Address address) const {
+        auto region = FindMemoryRegion(address);
+
+        for (auto& cur_region : regions)
+            if (cur_region.get() == region)
+                return cur_region;
+
+        return nullptr;
+    }
+
+    // Returns a pointer to guest RAM when [address, address + bytes) lies in
+    // a single host backed region, nullptr otherwise. Stores through it are
+    // not seen by the decoded instruction caches, report them with
+    // NotifyHostWrite.
+    Byte* HostPointer(Address address, Address bytes = 1);
+    void NotifyHostWrite(Address address, Address bytes);
+
+    // Like HostPointer, but also nullptr while the range holds decoded
+    // code. The pointer may only be stored through while the code mark
+    // generation read before the call is current.
+    Byte* HostStorePointer(Address address, Address bytes);
+
+    inline Long GetCodeGeneration() const {
+        return code_generation.load(std::memory_order_acquire);
+    }
+
+    // Advances whenever a page starts holding decoded code, or images are
+    // captured or restored
+    inline Long GetCodeMarkGeneration() const {
+        return code_mark_generation.load(std::memory_order_acquire);
+    }
+
+    // Only while no hart is running. Capturing copies the pages written
+    // since the last image, restoring copies back the pages written since
+    // and the pages that differ between the two images.
+    std::vector<RegionImage> CaptureImage();
+    void RestoreImage(const std::vector<RegionImage>& image);
 
     Address ReadFileInto(const std::string& path, Address address);
     void WriteToFile(const std::string& path, Address address, Address bytes);
@@ -262,6 +553,8 @@ public:
 
         if (end > max_address)
             max_address = end;
+        
+        RebuildDispatch();
     }
 
     template <typename T>
@@ -277,6 +570,8 @@ public:
 
         if (end > max_address)
             max_address = end;
+        
+        RebuildDispatch();
     }
 };
 
@@ -0,0 +1,75 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counts how often each instruction ran, by physical pc. The counters of a
+// page are allocated the first time it runs code. Only the owning hart
+// counts, other threads may read or clear while it runs.
+class Profiler {
+public:
+    struct HotSpot {
+        Address pc;
+        Long count;
+    };
+
+private:
+    using PageCounts = std::array<std::atomic<Long>, Memory::PAGE_SIZE / sizeof(Word)>;
+
+    std::map<Address, std::unique_ptr<PageCounts>> pages;
+    mutable std::mutex pages_lock;
+
+    // Execution rarely leaves a page, so it is only looked up on a change
+    Address last_page = -1ULL;
+    PageCounts* last_counts = nullptr;
+
+    PageCounts& GetPage(Address page);
+
+public:
+    // A load and store would write back a count that Clear reset in
+    // between, the add has to be atomic
+    inline void Count(Address physical_pc, Long hits = 1) {
+        Address page = physical_pc & ~(Memory::PAGE_SIZE - 1);
+
+        if (page != last_page) {
+            last_counts = &GetPage(page);
+            last_page = page;
+        }
+
+        auto& counter = (*last_counts)[(physical_pc & (Memory::PAGE_SIZE - 1)) / sizeof(Word)];
+        counter.fetch_add(hits, std::memory_order_relaxed);
+    }
+
+    // A block never crosses a page
+    inline void CountBlock(Address physical_pc, size_t instructions) {
+        for (size_t i = 0; i < instructions; i++)
+            Count(physical_pc + i * sizeof(Word));
+    }
+
+    Long GetCount(Address physical_pc) const;
+    Long GetTotal() const;
+    Long GetMaxCount() const;
+
+    // Sorted by count, the hottest first
+    std::vector<HotSpot> GetHotSpots(size_t max = -1ULL) const;
+
+    void Merge(const Profiler& other);
+    void Clear();
+
+    // The hottest instructions with their share of all counted ones
+    std::string HotSpotReport(const Memory& memory, size_t max) const;
+
+    // Every instruction that ran, in address order, with its count. Gaps in
+    // between are marked.
+    std::string Listing(const Memory& memory) const;
+};
+
+#endif
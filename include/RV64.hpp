@@ -118,6 +118,7 @@ struct RVInstruction {
         OR,
         AND,
         FENCE,
+        FENCE_I,
         ECALL,
         EBREAK,
         LWU,
@@ -430,6 +431,7 @@ struct RVInstruction {
 
     static constexpr Byte OP_FENCE = 0b0001111;
     static constexpr Byte FUNCT3_FENCE = 0b000;
+    static constexpr Byte FUNCT3_FENCE_I = 0b001;
 
     static constexpr Byte OP_SYSTEM = 0b1110011;
     static constexpr Byte FUNCT3_SYSTEM = 0b000;
@@ -482,7 +484,7 @@ struct RVInstruction {
     Byte rm;
     Byte rs3;
 
-    operator std::string();
+    operator std::string() const;
 
     static RVInstruction FromUInt32(Word instr);
 };
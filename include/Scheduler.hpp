@@ -0,0 +1,76 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "Types.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class VirtualMachine;
+
+// Runs N harts on a fixed pool of M host workers. A worker runs a hart for
+// one time slice, then requeues it on its own queue. Idle workers steal from
+// the other queues. Harts that cannot run (stopped, paused, asleep in WFI)
+// are parked outside of the queues until their wake handler requeues them.
+class Scheduler {
+public:
+    static constexpr Long TIME_SLICE = 10000;
+
+private:
+    enum class HartState : Byte {
+        Parked,
+        Queued,
+        Running
+    };
+
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<size_t> harts;
+    };
+
+    const std::vector<VirtualMachine*> harts;
+    std::unique_ptr<std::atomic<HartState>[]> states;
+    std::unique_ptr<std::atomic<bool>[]> pending;
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    const Long time_slice;
+
+    std::atomic<size_t> next_queue = 0;
+    std::atomic<size_t> queued = 0;
+
+    std::mutex idle_lock;
+    std::condition_variable idle_condition;
+    std::atomic<bool> finished = false;
+
+    std::mutex error_lock;
+    std::exception_ptr error;
+
+    void Enqueue(size_t hart, size_t queue);
+    bool Dequeue(size_t worker, size_t& hart);
+
+    void Unpark(size_t hart);
+    void Park(size_t hart, size_t worker);
+    void CheckFinished();
+
+    void StopAll();
+    void Work(size_t worker, Long max_cycles);
+
+public:
+    Scheduler(const std::vector<VirtualMachine*>& harts, size_t workers, Long time_slice = TIME_SLICE);
+    Scheduler(const Scheduler&) = delete;
+    Scheduler(Scheduler&&) = delete;
+    ~Scheduler();
+
+    // Returns once every hart has stopped. A hart reaching max_cycles stops
+    // all of them. Rethrows the first exception a hart raised.
+    void Run(Long max_cycles = -1ULL);
+
+    inline size_t GetWorkerCount() const { return queues.size(); }
+};
+
+#endif
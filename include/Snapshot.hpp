@@ -0,0 +1,38 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "Memory.hpp"
+#include "VirtualMachine.hpp"
+
+#include <string>
+#include <vector>
+
+// The whole machine at one point in time: the harts, the timer and RAM. RAM
+// pages are shared copy on write with Memory and other snapshots, so taking
+// and restoring a snapshot only copies the pages written in between.
+class Snapshot {
+public:
+    static constexpr Long MAGIC = 0x50414e5334365652; // "RV64SNAP"
+    static constexpr Long VERSION = 1;
+
+private:
+    std::vector<VirtualMachine::HartState> harts;
+
+    Long time = 0;
+    std::vector<Long> compares;
+
+    std::vector<Memory::RegionImage> memory_image;
+
+public:
+    // Only while none of the harts is running
+    static Snapshot Capture(Memory& memory, const std::vector<VirtualMachine*>& harts);
+    void Restore(Memory& memory, const std::vector<VirtualMachine*>& harts) const;
+
+    // The file is only meant to be read on the same kind of host
+    void Save(const std::string& path) const;
+    static Snapshot Load(const std::string& path);
+
+    inline size_t GetHartCount() const { return harts.size(); }
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TIMER_HPP
+#define TIMER_HPP
+
+#include "Memory.hpp"
+#include "Types.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class VirtualMachine;
+
+// CLINT style machine timer shared by every hart of a memory. mtime counts
+// either from the host monotonic clock or from retired instructions, and each
+// hart raises a machine timer interrupt once mtime reaches its own mtimecmp.
+//
+// Layout: mtime at offset 0, mtimecmp of hart N at offset 8 + N * 8.
+class Timer : public MemoryRegion {
+public:
+    enum class Source {
+        HostClock,
+        Instructions
+    };
+
+    static constexpr Address BASE = 0xd00;
+    static constexpr Address SIZE = 0x300;
+
+    static constexpr Address MTIME_OFFSET = 0x0;
+    static constexpr Address MTIMECMP_OFFSET = 0x8;
+
+    static constexpr Long TICKS_PER_SECOND = 32768;
+    static constexpr Long NO_DEADLINE = -1ULL;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Ticks = std::chrono::duration<SLong, std::ratio<1, TICKS_PER_SECOND>>;
+
+    // Far away deadlines are waited for in steps so the conversion cannot overflow
+    static constexpr Ticks MAX_WAIT = std::chrono::hours(1);
+
+    // Entries go stale when a hart programs a new mtimecmp, they are dropped
+    // once they come up and no longer match
+    using Deadline = std::pair<Long, Hart>;
+
+    mutable std::mutex lock;
+    std::condition_variable_any deadline_changed;
+    bool changed = false;
+
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+    std::atomic<Long> next_deadline = NO_DEADLINE;
+
+    std::array<Long, Memory::MAX_HARTS> compare;
+    std::array<VirtualMachine*, Memory::MAX_HARTS> harts{};
+
+    // Instruction time only jumps ahead once every attached hart is idle
+    std::array<bool, Memory::MAX_HARTS> idle{};
+    size_t attached = 0;
+    size_t idle_count = 0;
+
+    void SetIdle(Hart hart, bool is_idle);
+
+    std::atomic<Source> source = Source::HostClock;
+    Clock::time_point start;
+    std::atomic<Long> offset = 0;
+    std::atomic<Long> retired = 0;
+
+    // Only started once a hart waits for the host clock
+    std::jthread worker;
+
+    Timer() : MemoryRegion{TYPE_MAPPED_CSRS, 0, BASE, SIZE, true, true}, start{Clock::now()} {
+        compare.fill(NO_DEADLINE);
+    }
+
+    Long CurrentTime() const;
+    void SwitchSource(Source source, Long time);
+    void Schedule(Hart hart, Long time);
+    void RaiseExpired(Long time);
+    void Work(std::stop_token stop);
+
+public:
+    Timer(const Timer&) = delete;
+    Timer(Timer&&) = delete;
+
+    // Returns the timer of the memory, adding one when there is none yet
+    static std::shared_ptr<Timer> Get(Memory& memory);
+
+    void Attach(Hart hart, VirtualMachine* vm);
+    void Detach(Hart hart, VirtualMachine* vm);
+
+    // Rereads whether the hart is idle, after its state may have changed
+    void UpdateIdle(Hart hart);
+
+    void SetSource(Source source);
+
+    // Switches and starts mtime at time, so host time that passed before
+    // cannot leak into a run that only counts instructions
+    void SetSource(Source source, Long time);
+    inline Source GetSource() const { return source; }
+
+    Long Time() const;
+    void SetTime(Long time);
+
+    Long GetCompare(Hart hart) const;
+    void SetCompare(Hart hart, Long value);
+
+    // Counts instructions retired by a hart while the time follows them
+    void Retire(Long instructions);
+
+    // Nothing advances instruction time while every hart sleeps, so the last
+    // one to go idle lets it jump to the next deadline. Does nothing while
+    // another hart still runs.
+    void SkipToDeadline();
+
+    Long ReadLong(Address address) const override;
+    void WriteLong(Address address, Long value) override;
+
+    void Lock() const override {}
+    void Unlock() const override {}
+};
+
+#endif
@@ -4,18 +4,27 @@
 #include "Memory.hpp"
 #include "Float.hpp"
 #include "Expected.hpp"
+#include "RV64.hpp"
+#include "JIT.hpp"
+#include "Timer.hpp"
+#include "Profiler.hpp"
 
 #include <cstdint>
+#include <cfenv>
 #include <array>
+#include <bitset>
 #include <vector>
 #include <set>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <format>
 #include <stdexcept>
 #include <unordered_map>
+#include <exception>
 
 class VirtualMachine {
     friend class TLBEntry;
@@ -72,15 +81,40 @@ private:
     std::array<Reg, REGISTER_COUNT> regs;
     std::array<Float, REGISTER_COUNT> fregs;
 
-    std::unordered_map<Long, Long> csrs;
+    static constexpr size_t CSR_COUNT = 4096;
+
+    std::array<Long, CSR_COUNT> csrs{};
+
+    // Every CSR number has an entry, a missing reader or writer makes the
+    // access an illegal instruction. Stored CSRs live in csrs, the others
+    // are computed by their handlers.
+    struct CSRHandler {
+        Long (*read)(VirtualMachine& vm, Long csr) = nullptr;
+        void (*write)(VirtualMachine& vm, Long csr, Long value) = nullptr;
+        Byte privileges = 0;
+        bool stored = false;
+    };
+
+    static constexpr std::array<CSRHandler, CSR_COUNT> BuildCSRHandlers();
+    static const std::array<CSRHandler, CSR_COUNT> csr_handlers;
 
-    bool CSRPrivilegeCheck(Long csr);
     Long ReadCSR(Long csr, bool is_internal_read = false);
     void WriteCSR(Long csr, Long value);
 
     static const int default_rounding_mode;
+
+    // The rounding mode last set on this host thread, for all harts it runs
+    static thread_local int host_rounding_mode;
+
+    // Host mode selected by frm, -1 while frm is invalid. Updated on writes
+    // to fcsr and frm.
+    int dynamic_rounding_mode = FE_TONEAREST;
+
+    void UpdateDynamicRoundingMode();
     bool ChangeRoundingMode(Byte rm = 0xff);
-    bool CheckFloatErrors();
+
+    // Folds the host exception flags raised since the last call into fflags
+    void AccrueFloatFlags();
 
 public:
     static constexpr Half CSR_FFLAGS = 0x001;
@@ -239,6 +273,10 @@ public:
     };
     PrivilegeLevel privilege_level;
 
+    static constexpr Byte PrivilegeBit(PrivilegeLevel level) {
+        return 1 << static_cast<Byte>(level);
+    }
+
     static constexpr size_t REG_ZERO = 0;
     static constexpr size_t REG_RA = 1;
     static constexpr size_t REG_SP = 2;
@@ -317,12 +355,16 @@ public:
             Long A : 1;
             Long D : 1;
             Long RSW : 2;
-            Long PPN_0 : 10;
-            Long PPN_1 : 12;
+            Long PPN_0 : 9;
+            Long PPN_1 : 9;
+            Long PPN_2 : 26;
+            Long _reserved : 7;
+            Long PBMT : 2;
+            Long N : 1;
         };
         struct {
             Long _unused : 10;
-            Long PPN : 22;
+            Long PPN : 44;
         };
         Long raw;
 
@@ -336,18 +378,56 @@ public:
     static constexpr Long INTERRUPT_SUPERVISOR_TIMER = 0x5;
     static constexpr Long INTERRUPT_MACHINE_TIMER = 0x7;
     static constexpr Long INTERRUPT_SUPERVISOR_EXTERNAL = 0x9;
-    static constexpr Long INTERRUPT_MACHINE_EXTERNAL = 0xa;
+    static constexpr Long INTERRUPT_MACHINE_EXTERNAL = 0xb;
 
     void RaiseInterrupt(Long cause);
 
+    inline void ClearInterrupt(Long cause) {
+        mip.fetch_and(~(1ULL << cause));
+    }
+
 private:
-    bool waiting_for_interrupt = false;
+    // Also read by the timer, from whichever thread changes another hart
+    std::atomic<bool> waiting_for_interrupt = false;
+
+    // An idle hart in Run blocks here until it is woken by an interrupt,
+    // being unpaused, restarted or stopped
+    std::mutex sleep_lock;
+    std::condition_variable sleep_condition;
+
+    // Lets a scheduler pick up the hart again after it was parked
+    std::function<void()> wake_handler;
+
+    void Wake();
+    void WaitForWake();
+
+    // Tells the timer after IsIdle may have changed
+    void UpdateIdle();
+
+    // With no interrupt enabled nothing could end a WFI, so it does not wait
+    inline bool CanLeaveWFI() const {
+        return mip != 0 || sip != 0 || (mie & ~mideleg) == 0;
+    }
 
 public:
     inline bool IsWaitingForInterrupt() const {
         return waiting_for_interrupt;
     }
 
+    // Stopped, paused or asleep in WFI, the hart retires no instructions
+    inline bool IsIdle() const {
+        return !running || paused || waiting_for_interrupt;
+    }
+
+    // Only call from the thread that runs the hart
+    inline bool IsRunnable() const {
+        return running && !paused && (!waiting_for_interrupt || CanLeaveWFI());
+    }
+
+    // Called after anything that may make the hart runnable again, possibly
+    // from other threads
+    void SetWakeHandler(std::function<void()> handler);
+
 private:
     static constexpr Long TRAP_INTERRUPT_BIT = (1ULL << 31);
 
@@ -363,35 +443,90 @@ private:
     static constexpr Long EXCEPTION_ENVIRONMENT_CALL_FROM_S_MODE = 0x9;
     static constexpr Long EXCEPTION_ENVIRONMENT_CALL_FROM_M_MODE = 0xb;
     static constexpr Long EXCEPTION_INSTRUCTION_PAGE_FAULT = 0xc;
-    static constexpr Long EXCEPTION_INSTRUCTION_LOAD_PAGE_FAULT = 0xd;
+    static constexpr Long EXCEPTION_LOAD_PAGE_FAULT = 0xd;
     static constexpr Long EXCEPTION_STORE_AMO_PAGE_FAULT = 0xf;
 
-    void RaiseException(Long cause);
+    void RaiseException(Long cause, Long value = 0);
+    void RaiseMemoryFault(MemoryFault fault, Address address, bool is_store);
+    void RaisePageFault(Address address, bool is_write, bool is_execute);
+
+    static constexpr Long VALID_INTERRUPT_BITS =
+        (1ULL << INTERRUPT_SUPERVISOR_SOFTWARE) | (1ULL << INTERRUPT_MACHINE_SOFTWARE) |
+        (1ULL << INTERRUPT_SUPERVISOR_TIMER) | (1ULL << INTERRUPT_MACHINE_TIMER) |
+        (1ULL << INTERRUPT_SUPERVISOR_EXTERNAL) | (1ULL << INTERRUPT_MACHINE_EXTERNAL);
+
+    // Driven by the timer, software cannot clear it through mip
+    static constexpr Long MIP_READ_ONLY_BITS = 1ULL << INTERRUPT_MACHINE_TIMER;
 
-    static constexpr Long VALID_INTERRUPT_BITS = 0b0;
+    // Order the privileged spec takes pending interrupts in
+    static constexpr std::array<Long, 6> INTERRUPT_PRIORITY = {
+        INTERRUPT_MACHINE_EXTERNAL, INTERRUPT_MACHINE_SOFTWARE, INTERRUPT_MACHINE_TIMER,
+        INTERRUPT_SUPERVISOR_EXTERNAL, INTERRUPT_SUPERVISOR_SOFTWARE, INTERRUPT_SUPERVISOR_TIMER
+    };
 
-    Long mip = 0;
+    // Raised from other threads, such as the timer and other harts
+    std::atomic<Long> mip = 0;
     Long mie = 0;
     Long mideleg = 0;
     Long sip = 0;
     Long sie = 0;
 
-    void RaiseMachineTrap(Long cause);
-    void RaiseSupervisorTrap(Long cause);
+    void RaiseMachineTrap(Long cause, Long value = 0);
+    void RaiseSupervisorTrap(Long cause, Long value = 0);
     
     MStatus mstatus;
     SStatus sstatus;
 
+    // Entries are tagged with the virtual page number they were filled for.
+    // vpn_mask selects the bits that identify the mapped page, so a super
+    // page entry matches every page it covers.
     struct TLBCacheEntry {
-        Long tag : 63;
-        Long super : 1;
-        
-        TLBEntry tlb_entry;
+        Long vpn = 0;
+        Long vpn_mask = 0;
+        Long asid = 0;
+        bool valid = false;
+        bool global = false;
+        Byte level = 0;
+
+        TLBEntry tlb_entry{};
+
+        // The kinds of access that passed the permission checks in context,
+        // with the physical page and, for RAM, the host address of page vpn.
+        // Regions without host memory, such as MMIO, never get a host
+        // address and always take the slow path.
+        Byte context = 0;
+        Byte permitted = 0;
+        Address phys_page = 0;
+        Byte* host_read = nullptr;
+        Byte* host_write = nullptr;
+        Long host_write_generation = 0;
+
+        inline bool Matches(Long page, Long current_asid) const {
+            return valid && ((page ^ vpn) & vpn_mask) == 0 && (global || asid == current_asid);
+        }
+    };
 
-        TLBCacheEntry() : tag{0}, super{0} { tlb_entry.raw = 0; }
+    static constexpr size_t TLB_SETS = 64;
+    static constexpr size_t TLB_WAYS = 4;
+
+    struct TLBCache {
+        std::array<std::array<TLBCacheEntry, TLB_WAYS>, TLB_SETS> sets;
+        std::array<Byte, TLB_SETS> next_victim{};
+        size_t super_entries = 0;
     };
 
-    static constexpr size_t TLB_CACHE_SIZE = 16;
+    static constexpr Long PAGE_LEVEL_BITS = 9;
+    static constexpr size_t PAGE_WALK_CACHE_LEVELS = 3;
+    static constexpr size_t PAGE_WALK_CACHE_SIZE = 16;
+
+    // Remembers the physical address of the table a walk continues with at
+    // a given level, tagged with the VPN bits above that level and satp
+    struct PageWalkCacheEntry {
+        Long tag = 0;
+        Long satp = 0;
+        Address table = 0;
+        bool valid = false;
+    };
     
     template <typename Type>
     inline static consteval Type GetLog2(Type value) {
@@ -409,23 +544,77 @@ private:
     }
 
 public:
-    std::pair<TLBEntry, bool> GetTLBLookup(Address phys_addr, bool bypass_cache = false, bool is_amo = false);
+    // Returns the leaf PTE and the level it was found at, 0 for a 4 KiB
+    // page. The PTE is invalid when the walk raised an exception.
+    std::pair<TLBEntry, Byte> GetTLBLookup(Address virt_addr, bool is_write = false, bool is_execute = false, bool bypass_cache = false);
 
 private:
-    size_t tlb_cache_round_robin = 0;
-    std::array<TLBCacheEntry, TLB_CACHE_SIZE> tlb_cache;
+    TLBCache instruction_tlb;
+    TLBCache data_tlb;
+    std::array<std::array<PageWalkCacheEntry, PAGE_WALK_CACHE_SIZE>, PAGE_WALK_CACHE_LEVELS> page_walk_cache;
+
+    // Everything besides the translation that decides whether an access
+    // is permitted
+    inline Byte GetAccessContext() const {
+        return static_cast<Byte>(privilege_level) | (sstatus.SUM << 2) | (sstatus.MXR << 3);
+    }
+
+    static constexpr Byte ACCESS_READ = 1 << 0;
+    static constexpr Byte ACCESS_WRITE = 1 << 1;
+    static constexpr Byte ACCESS_EXECUTE = 1 << 2;
+    static constexpr Byte ACCESS_AMO = 1 << 3;
+
+    // The entry filled for exactly page vpn while in the current context
+    inline const TLBCacheEntry* FindPageEntry(const TLBCache& cache, Long vpn) const {
+        for (const auto& entry : cache.sets[vpn & (TLB_SETS - 1)]) {
+            if (entry.vpn == vpn && entry.context == GetAccessContext() && entry.Matches(vpn, satp.ASID))
+                return &entry;
+        }
+
+        return nullptr;
+    }
+
+    inline Byte* FindHostPage(Address address, bool is_write) const {
+        auto entry = FindPageEntry(data_tlb, address >> 12);
+        if (!entry)
+            return nullptr;
+        
+        if (!is_write)
+            return entry->host_read;
+        
+        return entry->host_write_generation == memory.GetCodeMarkGeneration() ? entry->host_write : nullptr;
+    }
+
+    TLBCacheEntry& InsertTLBEntry(TLBCache& cache, const TLBCacheEntry& entry);
+    void CachePageAccess(Address address, Address phys_address, Byte access);
+
+    // Return false when the access raised an exception
+    template <typename Type>
+    bool LoadGuest(Address address, Type& value);
+
+    template <typename Type>
+    bool StoreGuest(Address address, Type value);
+
+    // Drops the cached translations for address (or every address) that
+    // belong to asid (or every address space). Global mappings are kept
+    // when a single address space is flushed.
+    void FlushTLB(bool all_addresses, Address address, bool all_asids, Long asid);
 
     Memory& memory;
 
     union SATP {
         struct {
-            Long PPN : 22;
-            Long ASID : 9;
-            Long MODE : 1;
+            Long PPN : 44;
+            Long ASID : 16;
+            Long MODE : 4;
         };
         Long raw;
     };
 
+    static constexpr Long SATP_MODE_BARE = 0;
+    static constexpr Long SATP_MODE_SV39 = 8;
+    static constexpr Long SATP_MODE_SV48 = 9;
+
     SATP satp;
 
 public:
@@ -459,8 +648,8 @@ private:
     Long pc;
     Long cycles;
 
-    bool running = false;
-    bool paused = false;
+    std::atomic<bool> running = false;
+    std::atomic<bool> paused = false;
     bool pause_on_break = false;
     bool pause_on_restart = false;
     std::string err = "";
@@ -475,39 +664,7 @@ private:
 
     void Setup();
 
-    class CSRMappedMemory : public MemoryRegion {
-    public:
-        static constexpr Long TICKS_PER_SECOND = 32768;
-        Long time = 0;
-        Long time_cmp = -1ULL;
-
-        CSRMappedMemory() : MemoryRegion{TYPE_MAPPED_CSRS, 0,  0Xf00, 0x100, true, true} {}
-
-        Word ReadWord(Address address) const override {
-            address >>= 2;
-
-            switch (address) {
-                case 0:
-                    return static_cast<Word>(time);
-                
-                case 1:
-                    return static_cast<Word>(time >> 32);
-                
-                case 2:
-                    return static_cast<Word>(time_cmp);
-                
-                case 3:
-                    return static_cast<Word>(time_cmp >> 32);
-            }
-
-            return 0;
-        }
-
-        void Lock() const override {}
-        void Unlock() const override {}
-    };
-
-    std::shared_ptr<CSRMappedMemory> csr_mapped_memory;
+    std::shared_ptr<Timer> timer;
 
 public:
     VirtualMachine(Memory& memory, Long starting_pc, Hart hart_id);
@@ -515,7 +672,7 @@ public:
     VirtualMachine(VirtualMachine&&);
     ~VirtualMachine();
     
-    inline void Start() { running = true; }
+    inline void Start() { running = true; UpdateIdle(); }
     inline void Restart(Long pc, Hart source_hart) {
         this->pc = pc;
 
@@ -523,14 +680,17 @@ public:
             this->pc -= 4;
 
         Setup();
+        waiting_for_interrupt = false;
         paused = pause_on_restart;
+        UpdateIdle();
+        Wake();
     }
     inline bool IsRunning() const { return running; }
-    inline void Stop() { running = false; }
+    inline void Stop() { running = false; UpdateIdle(); Wake(); }
 
-    inline void Pause() { paused = true; }
+    inline void Pause() { paused = true; UpdateIdle(); }
     inline bool IsPaused() const { return paused; }
-    inline void Unpause() { paused = false; }
+    inline void Unpause() { paused = false; UpdateIdle(); Wake(); }
 
     inline void SetPauseOnBreak(bool pause_on_break) { this->pause_on_break = pause_on_break; }
     inline bool PauseOnBreak() const { return pause_on_break; }
@@ -539,17 +699,167 @@ public:
     inline bool PauseOnRestart() const { return pause_on_restart; }
 
 private:
+    static constexpr size_t INSTRUCTIONS_PER_PAGE = Memory::PAGE_SIZE / sizeof(Word);
+
+    struct DecodedPage {
+        std::array<RVInstruction, INSTRUCTIONS_PER_PAGE> instructions;
+        std::bitset<INSTRUCTIONS_PER_PAGE> decoded;
+    };
+
+    std::unordered_map<Address, std::unique_ptr<DecodedPage>> decoded_pages;
+    Address last_decoded_page_number = -1ULL;
+    DecodedPage* last_decoded_page = nullptr;
+    Long decoded_generation = 0;
+    bool flush_decoded_instructions = false;
+
+    inline bool IsDecodedCodeStale() const {
+        return flush_decoded_instructions || memory.GetCodeGeneration() != decoded_generation;
+    }
+
+    const RVInstruction* GetDecodedInstruction(Address phys_address);
+    const RVInstruction* DecodeInstruction(Address phys_address);
+    void FlushDecodedInstructions();
+    bool IsDecodedBreakPoint(Address addr);
+
+    using InstructionHandler = void (VirtualMachine::*)(const RVInstruction&);
+
+    // A straight line run of instructions ending at the first control
+    // transfer, system instruction or page boundary. Blocks remember up to
+    // two successors so that loops can be dispatched without a lookup.
+    struct DecodedBlock {
+        struct Entry {
+            InstructionHandler handler;
+            const RVInstruction* instr;
+            bool is_branch;
+        };
+
+        Address address = 0;
+        std::vector<Entry> entries;
+        bool ends_with_barrier = false;
+
+        Long executions = 0;
+        JIT::BlockFunction compiled = nullptr;
+
+        std::array<Address, 2> successor_pcs;
+        std::array<DecodedBlock*, 2> successors = {};
+        std::array<Long, 2> successor_epochs;
+
+        inline DecodedBlock* FindSuccessor(Address pc, Long epoch) const {
+            for (size_t i = 0; i < successors.size(); i++)
+                if (successors[i] && successor_pcs[i] == pc && successor_epochs[i] == epoch)
+                    return successors[i];
+            
+            return nullptr;
+        }
+    };
+
+    std::unordered_map<Address, std::unique_ptr<DecodedBlock>> decoded_blocks;
+    Long block_epoch = 0;
+
+    DecodedBlock* GetDecodedBlock(Address phys_address);
+    InstructionHandler ResolveHandler(RVInstruction::Type type) const;
+
+    template <RVInstruction::Type type>
+    void ExecuteFast(const RVInstruction& instr);
+
+    bool HandlePendingInterrupts();
+    void ExecuteInstruction(const RVInstruction& instr);
+
+    static constexpr Long JIT_THRESHOLD = 64;
+
+    std::unique_ptr<JIT> jit;
+    DecodedBlock* jit_block = nullptr;
+    Address jit_block_pc = 0;
+    bool jit_diverted = false;
+    std::exception_ptr jit_exception;
+    Long compiled_blocks = 0;
+
+    bool CompileHotBlock(DecodedBlock& block);
+    size_t RunCompiledBlock(DecodedBlock& block, bool& diverted);
+    static bool JITFallback(void* context, size_t index);
+
     bool SingleStep();
+    bool StepBlocks(Long steps);
+
+public:
+    enum class ExecutionEngine {
+        Interpreter,
+        Block,
+        JIT
+    };
+
+private:
+    ExecutionEngine execution_engine = ExecutionEngine::Interpreter;
 
 public:
+    inline void SetExecutionEngine(ExecutionEngine engine) {
+        execution_engine = engine;
+        block_epoch++;
+    }
+
+    inline ExecutionEngine GetExecutionEngine() const { return execution_engine; }
+
+    // Blocks the JIT translated into host code so far
+    inline Long GetCompiledBlocks() const { return compiled_blocks; }
+
+private:
+    std::unique_ptr<Profiler> profiler;
+
+public:
+    // Counts every instruction this hart runs. Only call this while the
+    // hart is stopped, the profiler goes away with it.
+    inline void EnableProfiling(bool enable) {
+        if (!enable) profiler.reset();
+        else if (!profiler) profiler = std::make_unique<Profiler>();
+    }
+
+    inline Profiler* GetProfiler() { return profiler.get(); }
+
     bool Step(Long steps = 1000);
-    void Run();
+
+    // Returns once stopped or after max_cycles
+    void Run(Long max_cycles = -1ULL);
+
+    // Runs up to steps instructions without blocking. Returns false when the
+    // hart has to be woken before it can continue.
+    bool RunFor(Long steps);
+
+    inline Long GetCycles() const { return cycles; }
 
     inline void SetPC(Long pc) { this->pc = pc; }
 
     void GetSnapshot(std::array<Reg, REGISTER_COUNT>& registers, std::array<Float, REGISTER_COUNT>& fregisters, Long& pc);
     void GetCSRSnapshot(std::unordered_map<Long, Long>& csrs) const;
 
+    // Everything a hart needs to continue where it was. The TLBs and decoded
+    // instructions are caches, they are flushed on restore instead.
+    struct HartState {
+        std::array<Reg, REGISTER_COUNT> regs;
+        std::array<Float, REGISTER_COUNT> fregs;
+        std::array<Long, CSR_COUNT> csrs;
+
+        Long pc;
+        Long cycles;
+
+        Long mip;
+        Long mie;
+        Long mideleg;
+        Long sip;
+        Long sie;
+
+        Long mstatus;
+        Long sstatus;
+        Long satp;
+
+        Byte privilege_level;
+        bool waiting_for_interrupt;
+        bool paused;
+    };
+
+    // Only while the hart is not in the middle of a step
+    void SaveState(HartState& state) const;
+    void RestoreState(const HartState& state);
+
     inline Expected<Reg&, std::range_error> GetRegister(size_t reg) {
         if (reg >= REGISTER_COUNT) {
             return Unexpected<std::range_error>(std::range_error(std::format("Could not get register {}. Max is {}", reg, REGISTER_COUNT)));
@@ -587,7 +897,7 @@ public:
 
     bool IsBreakPoint(Address addr);
 
-    void UpdateTime(double delta_time);
+    void UpdateStatistics(double delta_time);
 
     using ECallHandler = std::function<void(Hart, bool, Memory& memory, std::array<Reg, REGISTER_COUNT>& regs, std::array<Float, REGISTER_COUNT>& fregs)>;
 
@@ -0,0 +1,149 @@
+#include "ForkRunner.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <stdexcept>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <cerrno>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+
+std::vector<ForkRunner::Result> ForkRunner::Run(size_t, const std::function<std::string(size_t)>&, size_t) {
+    throw std::runtime_error("Forking children is not supported on Windows");
+}
+
+#else
+
+namespace {
+
+void WriteAll(int pipe, const std::string& data) {
+    for (size_t written = 0; written < data.size();) {
+        auto count = write(pipe, data.data() + written, data.size() - written);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count <= 0)
+            return;
+
+        written += count;
+    }
+}
+
+}
+
+std::vector<ForkRunner::Result> ForkRunner::Run(size_t children, const std::function<std::string(size_t)>& run, size_t parallel) {
+    struct Child {
+        pid_t pid;
+        int pipe;
+        size_t index;
+    };
+
+    std::vector<Result> results(children);
+    std::vector<Child> active;
+    std::vector<pollfd> polled;
+
+    if (parallel == 0)
+        parallel = 1;
+
+    // Reads from every running child until one of them closes its pipe and
+    // reaps that one, so a slow child does not hold up the slots behind it
+    auto Collect = [&]() {
+        for (;;) {
+            polled.clear();
+            for (auto& child : active)
+                polled.push_back({child.pipe, POLLIN, 0});
+
+            if (poll(polled.data(), polled.size(), -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                throw std::runtime_error("Could not wait for the children");
+            }
+
+            for (size_t j = 0; j < active.size(); j++) {
+                if (!polled[j].revents)
+                    continue;
+
+                auto child = active[j];
+                auto& result = results[child.index];
+
+                char buffer[4096];
+                auto count = read(child.pipe, buffer, sizeof(buffer));
+
+                if (count < 0 && errno == EINTR)
+                    continue;
+
+                if (count > 0) {
+                    result.output.append(buffer, count);
+                    continue;
+                }
+
+                close(child.pipe);
+                active.erase(active.begin() + j);
+
+                int status = 0;
+                while (waitpid(child.pid, &status, 0) < 0 && errno == EINTR);
+
+                result.completed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                return;
+            }
+        }
+    };
+
+    for (size_t i = 0; i < children; i++) {
+        if (active.size() >= parallel)
+            Collect();
+
+        int pipes[2];
+        if (pipe(pipes) != 0)
+            throw std::runtime_error(std::format("Could not create a pipe for child {}", i));
+
+        // Anything still buffered would be written once more by every child
+        std::fflush(nullptr);
+
+        auto pid = fork();
+
+        if (pid < 0) {
+            close(pipes[0]);
+            close(pipes[1]);
+            throw std::runtime_error(std::format("Could not fork child {}", i));
+        }
+
+        if (pid == 0) {
+            close(pipes[0]);
+
+            int code = EXIT_SUCCESS;
+
+            try {
+                WriteAll(pipes[1], run(i));
+            }
+            catch (std::exception& e) {
+                WriteAll(pipes[1], e.what());
+                code = EXIT_FAILURE;
+            }
+
+            close(pipes[1]);
+            std::fflush(nullptr);
+
+            // Skips the destructors of everything the parent still owns
+            _exit(code);
+        }
+
+        close(pipes[1]);
+        active.push_back({pid, pipes[0], i});
+    }
+
+    while (!active.empty())
+        Collect();
+
+    return results;
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "InputLog.hpp"
+
+#include <format>
+#include <stdexcept>
+
+namespace {
+
+// Little endian base 128, most values fit in one or two bytes
+void WriteVarint(std::ofstream& file, Long value) {
+    do {
+        Byte byte = value & 0x7f;
+        value >>= 7;
+
+        if (value)
+            byte |= 0x80;
+
+        file.put(static_cast<char>(byte));
+    } while (value);
+}
+
+Long ReadVarint(std::ifstream& file) {
+    Long value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        auto byte = file.get();
+        if (byte == std::ifstream::traits_type::eof())
+            throw std::runtime_error("Input log ends early");
+
+        value |= static_cast<Long>(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    throw std::runtime_error("Input log holds an invalid number");
+}
+
+}
+
+std::unique_ptr<InputLog> InputLog::Record(const std::string& path, const Header& header) {
+    std::unique_ptr<InputLog> log(new InputLog());
+
+    log->header = header;
+    log->file.open(path, std::ios_base::binary);
+
+    if (!log->file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+
+    log->file.write(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+    WriteVarint(log->file, VERSION);
+
+    WriteVarint(log->file, header.cores);
+    WriteVarint(log->file, header.quantum);
+    WriteVarint(log->file, header.seed);
+    WriteVarint(log->file, header.time);
+
+    log->file.flush();
+
+    if (!log->file)
+        throw std::runtime_error(std::format("Could not write the input log to {}", path));
+
+    return log;
+}
+
+std::unique_ptr<InputLog> InputLog::Replay(const std::string& path) {
+    std::ifstream file(path, std::ios_base::binary);
+
+    if (!file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for reading", path));
+
+    Long magic = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+
+    if (!file || magic != MAGIC)
+        throw std::runtime_error(std::format("{} is not an input log", path));
+
+    auto version = ReadVarint(file);
+    if (version != VERSION)
+        throw std::runtime_error(std::format("Input log {} has version {}, expected {}", path, version, VERSION));
+
+    std::unique_ptr<InputLog> log(new InputLog());
+    log->replaying = true;
+
+    log->header.cores = ReadVarint(file);
+    log->header.quantum = ReadVarint(file);
+    log->header.seed = ReadVarint(file);
+    log->header.time = ReadVarint(file);
+
+    while (file.peek() != std::ifstream::traits_type::eof()) {
+        auto& entry = log->entries.emplace_back();
+
+        entry.event = static_cast<Event>(ReadVarint(file));
+        entry.hart = ReadVarint(file);
+        entry.cycles = ReadVarint(file);
+
+        // The length is stored plus one, zero means there was no input
+        auto length = ReadVarint(file);
+        if (length == 0)
+            continue;
+
+        std::string data(length - 1, '\0');
+        file.read(data.data(), data.size());
+
+        if (!file)
+            throw std::runtime_error("Input log ends early");
+
+        entry.data = std::move(data);
+    }
+
+    return log;
+}
+
+std::optional<std::string> InputLog::Log(Event event, Hart hart, Long cycles, const std::function<std::optional<std::string>()>& read) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (replaying) {
+        if (entries.empty())
+            throw std::runtime_error(std::format("Replay diverged: hart {} asked for input at cycle {} after the recorded ones ran out", hart, cycles));
+
+        auto entry = std::move(entries.front());
+        entries.pop_front();
+
+        if (entry.event != event || entry.hart != hart || entry.cycles != cycles)
+            throw std::runtime_error(std::format("Replay diverged: hart {} asked for input at cycle {}, recorded was hart {} at cycle {}", hart, cycles, entry.hart, entry.cycles));
+
+        return entry.data;
+    }
+
+    auto data = read();
+
+    WriteVarint(file, static_cast<Long>(event));
+    WriteVarint(file, hart);
+    WriteVarint(file, cycles);
+
+    WriteVarint(file, data ? data->size() + 1 : 0);
+    if (data)
+        file.write(data->data(), data->size());
+
+    // Inputs are rare, a crashing guest should still leave them behind
+    file.flush();
+
+    if (!file)
+        throw std::runtime_error("Could not write to the input log");
+
+    return data;
+}
@@ -0,0 +1,399 @@
+#include "JIT.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X86_64
+#endif
+
+namespace {
+
+class X86Emitter {
+private:
+    std::vector<Byte> code;
+
+public:
+    static constexpr Byte RAX = 0;
+    static constexpr Byte RCX = 1;
+
+    inline void Emit(std::initializer_list<Byte> bytes) {
+        code.insert(code.end(), bytes);
+    }
+
+    inline void Emit32(Word value) {
+        for (size_t i = 0; i < sizeof(Word); i++)
+            code.push_back(static_cast<Byte>(value >> (i * 8)));
+    }
+
+    inline void Emit64(Long value) {
+        for (size_t i = 0; i < sizeof(Long); i++)
+            code.push_back(static_cast<Byte>(value >> (i * 8)));
+    }
+
+    inline void Patch32(size_t offset, Word value) {
+        for (size_t i = 0; i < sizeof(Word); i++)
+            code[offset + i] = static_cast<Byte>(value >> (i * 8));
+    }
+
+    inline size_t Size() const { return code.size(); }
+    inline const Byte* Data() const { return code.data(); }
+
+    // The guest register file is held in rbx, the context in r12
+    void Prologue() {
+        Emit({0x53});                   // push rbx
+        Emit({0x41, 0x54});             // push r12
+        Emit({0x48, 0x83, 0xec, 0x28}); // sub rsp, 40
+#if defined(_WIN32) || defined(_WIN64)
+        Emit({0x49, 0x89, 0xcc});       // mov r12, rcx
+        Emit({0x48, 0x89, 0xd3});       // mov rbx, rdx
+#else
+        Emit({0x49, 0x89, 0xfc});       // mov r12, rdi
+        Emit({0x48, 0x89, 0xf3});       // mov rbx, rsi
+#endif
+    }
+
+    void Epilogue() {
+        Emit({0x48, 0x83, 0xc4, 0x28}); // add rsp, 40
+        Emit({0x41, 0x5c});             // pop r12
+        Emit({0x5b});                   // pop rbx
+        Emit({0xc3});                   // ret
+    }
+
+    void LoadRegister(Byte host, Byte guest) {
+        if (guest == 0) {
+            Emit({0x31, static_cast<Byte>(0xc0 | (host << 3) | host)}); // xor host, host
+            return;
+        }
+
+        Emit({0x48, 0x8b, static_cast<Byte>(0x83 | (host << 3))});      // mov host, [rbx + disp32]
+        Emit32(guest * sizeof(Long));
+    }
+
+    void StoreRegister(Byte guest, Byte host) {
+        Emit({0x48, 0x89, static_cast<Byte>(0x83 | (host << 3))});      // mov [rbx + disp32], host
+        Emit32(guest * sizeof(Long));
+    }
+
+    void LoadImmediate(Byte host, Long value) {
+        Emit({0x48, static_cast<Byte>(0xb8 | host)});                   // mov host, imm64
+        Emit64(value);
+    }
+
+    void MoveImmediate32(Word value) {
+        Emit({0xb8});                                                   // mov eax, imm32
+        Emit32(value);
+    }
+
+    void CallFallback(JIT::Fallback fallback, size_t index) {
+#if defined(_WIN32) || defined(_WIN64)
+        Emit({0x4c, 0x89, 0xe1});       // mov rcx, r12
+        Emit({0xba});                   // mov edx, imm32
+#else
+        Emit({0x4c, 0x89, 0xe7});       // mov rdi, r12
+        Emit({0xbe});                   // mov esi, imm32
+#endif
+        Emit32(static_cast<Word>(index));
+        LoadImmediate(RAX, reinterpret_cast<Long>(fallback));
+        Emit({0xff, 0xd0});             // call rax
+    }
+
+    // Emits an exit taken when the fallback returned true. Returns the offset
+    // of the jump displacement that has to be patched to the epilogue.
+    size_t ExitIfSet(Word executed) {
+        Emit({0x84, 0xc0});             // test al, al
+        Emit({0x74, 0x0a});             // jz +10
+        MoveImmediate32(executed);
+        Emit({0xe9});                   // jmp rel32
+        Emit32(0);
+        return Size() - sizeof(Word);
+    }
+};
+
+bool EmitInline(X86Emitter& emitter, const RVInstruction& instr) {
+    using Type = RVInstruction::Type;
+    constexpr Byte RAX = X86Emitter::RAX;
+    constexpr Byte RCX = X86Emitter::RCX;
+
+    if (!JIT::CanInline(instr))
+        return false;
+
+    if (instr.rd == 0)
+        return true;
+
+    switch (instr.type) {
+        case Type::LUI:
+            emitter.LoadImmediate(RAX, instr.immediate);
+            break;
+
+        case Type::ADDI:
+        case Type::XORI:
+        case Type::ORI:
+        case Type::ANDI:
+        case Type::SLTI:
+        case Type::SLTIU:
+        case Type::ADDIW:
+            emitter.LoadRegister(RAX, instr.rs1);
+            emitter.LoadImmediate(RCX, instr.immediate);
+            break;
+
+        case Type::SLLI:
+        case Type::SRLI:
+        case Type::SRAI:
+            emitter.LoadRegister(RAX, instr.rs1);
+            break;
+
+        case Type::ADD:
+        case Type::SUB:
+        case Type::SLL:
+        case Type::SLT:
+        case Type::SLTU:
+        case Type::XOR:
+        case Type::SRL:
+        case Type::SRA:
+        case Type::OR:
+        case Type::AND:
+        case Type::ADDW:
+        case Type::SUBW:
+        case Type::MUL:
+            emitter.LoadRegister(RAX, instr.rs1);
+            emitter.LoadRegister(RCX, instr.rs2);
+            break;
+
+        default:
+            break;
+    }
+
+    Byte shift = static_cast<Byte>(instr.immediate & 0b111111);
+
+    switch (instr.type) {
+        case Type::ADD:
+        case Type::ADDI:
+            emitter.Emit({0x48, 0x01, 0xc8});               // add rax, rcx
+            break;
+
+        case Type::ADDW:
+        case Type::ADDIW:
+            emitter.Emit({0x48, 0x01, 0xc8});               // add rax, rcx
+            emitter.Emit({0x48, 0x63, 0xc0});               // movsxd rax, eax
+            break;
+
+        case Type::SUB:
+            emitter.Emit({0x48, 0x29, 0xc8});               // sub rax, rcx
+            break;
+
+        case Type::SUBW:
+            emitter.Emit({0x48, 0x29, 0xc8});               // sub rax, rcx
+            emitter.Emit({0x48, 0x63, 0xc0});               // movsxd rax, eax
+            break;
+
+        case Type::XOR:
+        case Type::XORI:
+            emitter.Emit({0x48, 0x31, 0xc8});               // xor rax, rcx
+            break;
+
+        case Type::OR:
+        case Type::ORI:
+            emitter.Emit({0x48, 0x09, 0xc8});               // or rax, rcx
+            break;
+
+        case Type::AND:
+        case Type::ANDI:
+            emitter.Emit({0x48, 0x21, 0xc8});               // and rax, rcx
+            break;
+
+        case Type::SLT:
+        case Type::SLTI:
+            emitter.Emit({0x48, 0x39, 0xc8});               // cmp rax, rcx
+            emitter.Emit({0x0f, 0x9c, 0xc0});               // setl al
+            emitter.Emit({0x48, 0x0f, 0xb6, 0xc0});         // movzx rax, al
+            break;
+
+        case Type::SLTU:
+        case Type::SLTIU:
+            emitter.Emit({0x48, 0x39, 0xc8});               // cmp rax, rcx
+            emitter.Emit({0x0f, 0x92, 0xc0});               // setb al
+            emitter.Emit({0x48, 0x0f, 0xb6, 0xc0});         // movzx rax, al
+            break;
+
+        case Type::SLL:
+            emitter.Emit({0x48, 0xd3, 0xe0});               // shl rax, cl
+            break;
+
+        case Type::SRL:
+            emitter.Emit({0x48, 0xd3, 0xe8});               // shr rax, cl
+            break;
+
+        case Type::SRA:
+            emitter.Emit({0x48, 0xd3, 0xf8});               // sar rax, cl
+            break;
+
+        case Type::SLLI:
+            emitter.Emit({0x48, 0xc1, 0xe0, shift});        // shl rax, imm8
+            break;
+
+        case Type::SRLI:
+            emitter.Emit({0x48, 0xc1, 0xe8, shift});        // shr rax, imm8
+            break;
+
+        case Type::SRAI:
+            emitter.Emit({0x48, 0xc1, 0xf8, shift});        // sar rax, imm8
+            break;
+
+        case Type::MUL:
+            emitter.Emit({0x48, 0x0f, 0xaf, 0xc1});         // imul rax, rcx
+            break;
+
+        default:
+            break;
+    }
+
+    emitter.StoreRegister(instr.rd, RAX);
+    return true;
+}
+
+constexpr size_t CODE_PAGE_SIZE = 4096;
+
+// The code cache is never writable and executable at the same time
+bool SetExecutable(Byte* code, size_t size, bool executable) {
+    auto begin = reinterpret_cast<uintptr_t>(code) & ~(CODE_PAGE_SIZE - 1);
+    auto end = (reinterpret_cast<uintptr_t>(code) + size + CODE_PAGE_SIZE - 1) & ~(CODE_PAGE_SIZE - 1);
+
+#if defined(_WIN32) || defined(_WIN64)
+    DWORD old_protection;
+    if (!VirtualProtect(reinterpret_cast<void*>(begin), end - begin, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &old_protection))
+        return false;
+
+    if (executable)
+        FlushInstructionCache(GetCurrentProcess(), code, size);
+
+    return true;
+#else
+    return mprotect(reinterpret_cast<void*>(begin), end - begin, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+}
+
+JIT::~JIT() {
+#if defined(_WIN32) || defined(_WIN64)
+    VirtualFree(code_cache, 0, MEM_RELEASE);
+#else
+    munmap(code_cache, code_cache_size);
+#endif
+}
+
+bool JIT::IsSupported() {
+#ifdef JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool JIT::CanInline(const RVInstruction& instr) {
+    using Type = RVInstruction::Type;
+
+    switch (instr.type) {
+        case Type::LUI:
+        case Type::ADDI:
+        case Type::SLTI:
+        case Type::SLTIU:
+        case Type::XORI:
+        case Type::ORI:
+        case Type::ANDI:
+        case Type::SLLI:
+        case Type::SRLI:
+        case Type::SRAI:
+        case Type::ADD:
+        case Type::SUB:
+        case Type::SLL:
+        case Type::SLT:
+        case Type::SLTU:
+        case Type::XOR:
+        case Type::SRL:
+        case Type::SRA:
+        case Type::OR:
+        case Type::AND:
+        case Type::ADDIW:
+        case Type::ADDW:
+        case Type::SUBW:
+        case Type::MUL:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+JIT::BlockFunction JIT::Compile(const std::vector<const RVInstruction*>& instrs) {
+    X86Emitter emitter;
+    std::vector<size_t> exits;
+
+    emitter.Prologue();
+
+    for (size_t i = 0; i < instrs.size(); i++) {
+        if (EmitInline(emitter, *instrs[i]))
+            continue;
+
+        emitter.CallFallback(fallback, i);
+        exits.push_back(emitter.ExitIfSet(static_cast<Word>(i + 1)));
+    }
+
+    emitter.MoveImmediate32(static_cast<Word>(instrs.size()));
+
+    size_t epilogue = emitter.Size();
+    emitter.Epilogue();
+
+    for (auto exit : exits)
+        emitter.Patch32(exit, static_cast<Word>(epilogue - (exit + sizeof(Word))));
+
+    if (code_cache_used + emitter.Size() > code_cache_size)
+        return nullptr;
+
+    // Earlier blocks on the same pages are not running while this one is
+    // written, each hart has its own code cache
+    auto code = code_cache + code_cache_used;
+    if (!SetExecutable(code, emitter.Size(), false))
+        return nullptr;
+
+    std::memcpy(code, emitter.Data(), emitter.Size());
+
+    if (!SetExecutable(code, emitter.Size(), true))
+        return nullptr;
+
+    // Keep every block 16 byte aligned
+    code_cache_used += (emitter.Size() + 15) & ~15;
+
+    return reinterpret_cast<BlockFunction>(code);
+}
+
+std::unique_ptr<JIT> JIT::Create(Fallback fallback, size_t code_cache_size) {
+    if (!IsSupported())
+        return nullptr;
+
+#if defined(_WIN32) || defined(_WIN64)
+    auto code_cache = static_cast<Byte*>(VirtualAlloc(nullptr, code_cache_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (!code_cache)
+        return nullptr;
+#else
+    auto code_cache = mmap(nullptr, code_cache_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code_cache == MAP_FAILED)
+        return nullptr;
+#endif
+
+    auto jit = std::unique_ptr<JIT>(new JIT(static_cast<Byte*>(code_cache), code_cache_size, fallback));
+
+    // Hosts that forbid executable anonymous memory fail here instead of on
+    // every compile
+    if (!SetExecutable(jit->code_cache, CODE_PAGE_SIZE, true) || !SetExecutable(jit->code_cache, CODE_PAGE_SIZE, false))
+        return nullptr;
+
+    return jit;
+}
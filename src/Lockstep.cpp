@@ -0,0 +1,96 @@
+#include "Lockstep.hpp"
+#include "VirtualMachine.hpp"
+#include "Timer.hpp"
+
+Lockstep::Lockstep(Memory& memory, const std::vector<VirtualMachine*>& harts, Long quantum, Long seed) : memory{memory}, harts{harts}, quantum{quantum}, random{seed} {
+    if (quantum == 0)
+        throw std::runtime_error("The lockstep quantum must not be 0");
+
+    for (size_t hart = 0; hart < harts.size(); hart++) {
+        order.push_back(hart);
+
+        harts[hart]->SetWakeHandler([this]() {
+            {
+                std::lock_guard<std::mutex> guard(wake_lock);
+                woken = true;
+            }
+
+            wake_condition.notify_one();
+        });
+    }
+}
+
+Lockstep::~Lockstep() {
+    for (auto vm : harts)
+        vm->SetWakeHandler(nullptr);
+}
+
+// Fisher-Yates with the raw generator output, std::shuffle may differ
+// between standard libraries
+void Lockstep::Shuffle() {
+    for (size_t i = order.size(); i > 1; i--)
+        std::swap(order[i - 1], order[random() % i]);
+}
+
+bool Lockstep::IsFinished() const {
+    for (auto vm : harts)
+        if (vm->IsRunning())
+            return false;
+
+    return true;
+}
+
+void Lockstep::WaitForWake() {
+    std::unique_lock<std::mutex> guard(wake_lock);
+    wake_condition.wait(guard, [this]() { return woken || IsFinished(); });
+    woken = false;
+}
+
+void Lockstep::Run(Long max_cycles) {
+    // A timer that already counts instructions keeps its time, switching
+    // from the host clock starts over at 0
+    auto timer = Timer::Get(memory);
+    if (timer->GetSource() != Timer::Source::Instructions)
+        timer->SetSource(Timer::Source::Instructions, 0);
+
+    memory.SetSingleThreaded(true);
+
+    try {
+        while (!IsFinished()) {
+            {
+                std::lock_guard<std::mutex> guard(wake_lock);
+                woken = false;
+            }
+
+            Shuffle();
+
+            bool progressed = false;
+
+            for (auto hart : order) {
+                auto vm = harts[hart];
+
+                if (!vm->IsRunnable())
+                    continue;
+
+                vm->RunFor(quantum);
+                progressed = true;
+
+                if (vm->GetCycles() >= max_cycles) {
+                    for (auto cur_vm : harts)
+                        cur_vm->Stop();
+                }
+            }
+
+            // Every hart is paused or waits without a deadline, only another
+            // thread can change that
+            if (!progressed)
+                WaitForWake();
+        }
+    }
+    catch (...) {
+        memory.SetSingleThreaded(false);
+        throw;
+    }
+
+    memory.SetSingleThreaded(false);
+}
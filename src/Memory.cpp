@@ -3,6 +3,85 @@
 #include <stdexcept>
 #include <format>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <windows.h>
+#include <mutex>
+#include <vector>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+namespace {
+
+// Windows charges committed memory against the commit limit, so RAM is only
+// reserved. Host pointers into RAM are handed out everywhere, so instead of
+// committing in every access path, a vectored exception handler commits the
+// chunk behind an access violation inside a reservation and retries.
+constexpr uintptr_t COMMIT_CHUNK = 64 * 1024;
+
+struct Reservation {
+    uintptr_t begin;
+    uintptr_t end;
+};
+
+std::mutex reservations_lock;
+std::vector<Reservation> reservations;
+
+LONG CALLBACK CommitOnAccess(PEXCEPTION_POINTERS info) {
+    auto record = info->ExceptionRecord;
+    if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || record->NumberParameters < 2)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    auto address = static_cast<uintptr_t>(record->ExceptionInformation[1]);
+
+    // Only pages that are reserved and not committed yet, any other fault is
+    // a real one
+    MEMORY_BASIC_INFORMATION page_info;
+    if (!VirtualQuery(reinterpret_cast<void*>(address), &page_info, sizeof(page_info)) || page_info.State != MEM_RESERVE)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    std::lock_guard<std::mutex> guard(reservations_lock);
+
+    for (auto& reservation : reservations) {
+        if (address < reservation.begin || address >= reservation.end)
+            continue;
+
+        auto begin = std::max(address & ~(COMMIT_CHUNK - 1), reservation.begin);
+        auto end = std::min(begin + COMMIT_CHUNK, reservation.end);
+
+        if (VirtualAlloc(reinterpret_cast<void*>(begin), end - begin, MEM_COMMIT, PAGE_READWRITE))
+            return EXCEPTION_CONTINUE_EXECUTION;
+
+        break;
+    }
+
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+void AddReservation(void* memory, size_t size) {
+    static std::once_flag registered;
+    std::call_once(registered, []() { AddVectoredExceptionHandler(1, CommitOnAccess); });
+
+    std::lock_guard<std::mutex> guard(reservations_lock);
+
+    auto begin = reinterpret_cast<uintptr_t>(memory);
+    reservations.push_back({begin, begin + size});
+}
+
+void RemoveReservation(void* memory) {
+    std::lock_guard<std::mutex> guard(reservations_lock);
+
+    std::erase_if(reservations, [memory](const Reservation& reservation) { return reservation.begin == reinterpret_cast<uintptr_t>(memory); });
+}
+
+}
+#endif
 
 Word MemoryRegion::ReadWord(Address address) const {
     auto vlong = ReadLong(address & ~7);
@@ -78,694 +157,495 @@ std::unique_ptr<MemoryRAM> MemoryRAM::Create(Address base, Address size) {
     return std::unique_ptr<MemoryRAM>(new MemoryRAM(base & ~3, size));
 }
 
-union U32S32 {
-    Word u;
-    SWord s;
-};
-
-MemoryRegion* Memory::GetMemoryRegion(Address address) {
-    for (auto& region : regions) {
-        Address end = region->base + region->size;
-        if (address >= region->base && address < end)
-            return region.get();
-    }
-    return nullptr;
+MemoryMappedRAM::MemoryMappedRAM(Byte* memory, Address base, Address size) : MemoryRegion(TYPE_GENERAL_RAM, 0, base, size, true, true) {
+    host_memory = memory;
 }
 
-const MemoryRegion* Memory::GetMemoryRegion(Address address) const {
-    for (const auto& region : regions) {
-        Address end = region->base + region->size;
-        if (address >= region->base && address < end)
-            return region.get();
-    }
-    return nullptr;
+MemoryMappedRAM::~MemoryMappedRAM() {
+#if defined(_WIN32) || defined(_WIN64)
+    RemoveReservation(host_memory);
+    VirtualFree(host_memory, 0, MEM_RELEASE);
+#else
+    munmap(host_memory, size + PAGE_SIZE);
+#endif
 }
 
-Long Memory::ReadLong(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
+std::unique_ptr<MemoryMappedRAM> MemoryMappedRAM::Create(Address base, Address size) {
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
+    // Only address space is reserved, the host hands out zeroed pages on
+    // first touch. The extra page keeps accesses that straddle the end of
+    // a region whose base is not 8 byte aligned inside the mapping.
+#if defined(_WIN32) || defined(_WIN64)
+    auto memory = VirtualAlloc(nullptr, size + PAGE_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+    if (!memory)
+        throw std::runtime_error(std::format("Cannot reserve {} bytes of host memory for RAM", size));
 
-    auto vlong = region->ReadLong(address - region->base);
+    AddReservation(memory, size + PAGE_SIZE);
+#else
+    auto memory = mmap(nullptr, size + PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error(std::format("Cannot reserve {} bytes of host memory for RAM", size));
+#endif
 
-    return vlong;
+    return std::unique_ptr<MemoryMappedRAM>(new MemoryMappedRAM(static_cast<Byte*>(memory), base & ~3, size));
 }
 
-Word Memory::ReadWord(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
+namespace {
 
-    auto word = region->ReadWord(address - region->base);
+template <typename Type>
+inline Type LoadFrom(const MemoryRegion* region, Address offset) {
+    if (auto host = region->HostPointer(offset)) {
+        Type value;
+        std::memcpy(&value, host, sizeof(Type));
+        return value;
+    }
 
-    return word;
+    if constexpr (std::is_same_v<Type, Long>) return region->ReadLong(offset);
+    else if constexpr (std::is_same_v<Type, Word>) return region->ReadWord(offset);
+    else if constexpr (std::is_same_v<Type, Half>) return region->ReadHalf(offset);
+    else return region->ReadByte(offset);
 }
 
-Half Memory::ReadHalf(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 1)
-        throw std::runtime_error(std::format("Unaligned read of half at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
-
-    auto half = region->ReadHalf(address - region->base);
+template <typename Type>
+inline void StoreTo(MemoryRegion* region, Address offset, Type value) {
+    if (auto host = region->HostPointer(offset)) {
+        std::memcpy(host, &value, sizeof(Type));
+        return;
+    }
 
-    return half;
+    if constexpr (std::is_same_v<Type, Long>) region->WriteLong(offset, value);
+    else if constexpr (std::is_same_v<Type, Word>) region->WriteWord(offset, value);
+    else if constexpr (std::is_same_v<Type, Half>) region->WriteHalf(offset, value);
+    else region->WriteByte(offset, value);
 }
 
-Byte Memory::ReadByte(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    auto region = GetMemoryRegion(address);
+[[noreturn]] void ThrowMemoryFault(MemoryFault fault, Address address, const char* access) {
+    switch (fault) {
+        case MemoryFault::Misaligned:
+            throw std::runtime_error(std::format("Unaligned {} at {:#18}", access, address));
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
+        case MemoryFault::Unmapped:
+            throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
 
-    auto byte = region->ReadByte(address - region->base);
+        case MemoryFault::Protected:
+            throw std::runtime_error(std::format("Invalid {} at {:#18} as it's not accessible", access, address));
+    }
 
-    return byte;
+    throw std::runtime_error(std::format("Invalid {} at {:#18}", access, address));
 }
 
-std::pair<Word, bool> Memory::PeekWord(Address address) const {
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        return {0, false};
-    
-    if (!region->readable)
-        return {0, false};
-    
-    auto word = region->ReadWord(address - region->base);
-
-    return {word, true};
 }
 
-bool Memory::TryWriteWord(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
-
+Byte* Memory::HostPointer(Address address, Address bytes) {
     auto region = GetMemoryRegion(address);
-
-    if (!region)
-        return false;
+    if (!region || !region->readable || !region->writable)
+        return nullptr;
     
-    if (!region->writable)
-        return false;
+    auto offset = address - region->base;
+    if (bytes > region->size - offset)
+        return nullptr;
 
-    region->WriteWord(address - region->base, word);
-    return true;
+    return region->HostPointer(offset);
 }
 
-void Memory::WriteLong(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::NotifyHostWrite(Address address, Address bytes) {
+    if (bytes == 0)
+        return;
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
+    if (HasReservations())
+        ClearReservations(address, bytes);
 
     auto region = GetMemoryRegion(address);
-
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
-
-    region->WriteLong(address - region->base, vlong);
-}
-
-void Memory::WriteWord(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
+        return;
 
-    auto region = GetMemoryRegion(address);
+    // Code pages are counted from the start of the region
+    Address first = (address - region->base) & ~(MemoryRegion::CODE_PAGE_SIZE - 1);
+    Address last = std::min(address - region->base + bytes - 1, region->size - 1);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
-
-    region->WriteWord(address - region->base, word);
+    for (Address offset = first; offset <= last; offset += MemoryRegion::CODE_PAGE_SIZE)
+        NotifyWrite(region, region->base + offset);
 }
 
-void Memory::WriteHalf(Address address, Half half) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 1)
-        throw std::runtime_error(std::format("Unaligned write of half at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
+Byte* Memory::HostStorePointer(Address address, Address bytes) {
+    auto host = HostPointer(address, bytes);
+    if (!host || bytes == 0)
+        return host;
     
-    region->WriteHalf(address - region->base, half);
-}
-
-void Memory::WriteByte(Address address, Byte byte) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
     auto region = GetMemoryRegion(address);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
-    
-    region->WriteByte(address - region->base, byte);
-}
-
-Long Memory::AtomicSwapL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
+    Address first = (address - region->base) & ~(MemoryRegion::CODE_PAGE_SIZE - 1);
+    Address last = address - region->base + bytes - 1;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
+    for (Address offset = first; offset <= last; offset += MemoryRegion::CODE_PAGE_SIZE)
+        if (region->IsCodePage(offset))
+            return nullptr;
     
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, vlong);
-    region->Lock();
+    // Stores through the pointer are not seen, so the pages count as written
+    for (Address offset = first; offset <= last; offset += MemoryRegion::CODE_PAGE_SIZE)
+        region->MarkDirtyPage(offset);
 
-    return old_long;
+    return host;
 }
 
-Long Memory::AtomicAddL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
-
+void Memory::MarkCodePage(Address address) {
     auto region = GetMemoryRegion(address);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long + vlong);
-    region->Unlock();
-
-    return old_long;
+    if (region && region->MarkCodePage(address - region->base))
+        code_mark_generation.fetch_add(1, std::memory_order_release);
 }
 
-Long Memory::AtomicAndL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+namespace {
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+std::atomic<Long> next_dispatch_id = 1;
 
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+// The last range a hart resolved, only valid while its table is current
+struct DispatchHit {
+    Long dispatch_id = 0;
+    MemoryRegion* region = nullptr;
+    Address start = 0;
+    Address size = 0;
+};
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long & vlong);
-    region->Unlock();
+thread_local DispatchHit last_hit;
 
-    return old_long;
 }
 
-Long Memory::AtomicOrL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+// Earlier regions take precedence, so slots that are already owned by a
+// region are left alone
+void Memory::InsertDispatch(DispatchSlot& slot, MemoryRegion* region, Address start, size_t level) {
+    if (slot.region && !slot.mixed)
+        return;
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    Address last = start + ((1ULL << DISPATCH_SHIFTS[level]) - 1);
+    Address region_last = region->base + region->size - 1;
+    bool covers = region->base <= start && last <= region_last;
 
-    auto region = GetMemoryRegion(address);
+    if (!slot.children) {
+        if (!slot.mixed && covers) {
+            slot.region = region;
+            return;
+        }
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+        if (level == DISPATCH_PAGE_LEVEL) {
+            slot.mixed = true;
+            return;
+        }
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long | vlong);
-    region->Unlock();
+        slot.children = std::make_unique<DispatchSlot[]>(DispatchChildren(level + 1));
+    }
 
-    return old_long;
+    auto shift = DISPATCH_SHIFTS[level + 1];
+    auto mask = DispatchChildren(level + 1) - 1;
+    Address first = std::max(region->base, start);
+    region_last = std::min(region_last, last);
+
+    for (Address index = (first >> shift) & mask; index <= ((region_last >> shift) & mask); index++)
+        InsertDispatch(slot.children[index], region, start + (index << shift), level + 1);
 }
 
-Long Memory::AtomicXorL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::RebuildDispatch() {
+    auto table = std::make_unique<DispatchTable>();
+    table->id = next_dispatch_id.fetch_add(1, std::memory_order_relaxed);
+    table->root = std::make_unique<DispatchSlot[]>(1ULL << (64 - DISPATCH_SHIFTS[0]));
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    for (auto& region : regions) {
+        table->regions.push_back(region.get());
 
-    auto region = GetMemoryRegion(address);
+        if (region->size == 0)
+            continue;
+        
+        Address last = region->base + region->size - 1;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long ^ vlong);
-    region->Unlock();
+        for (Address index = region->base >> DISPATCH_SHIFTS[0]; index <= last >> DISPATCH_SHIFTS[0]; index++)
+            InsertDispatch(table->root[index], region.get(), index << DISPATCH_SHIFTS[0], 0);
+    }
 
-    return old_long;
+    dispatch.store(table.get(), std::memory_order_release);
+    dispatch_tables.push_back(std::move(table));
 }
 
-SLong Memory::AtomicMinL(Address address, SLong vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+MemoryRegion* Memory::FindMemoryRegion(Address address) const {
+    auto table = dispatch.load(std::memory_order_acquire);
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    if (last_hit.dispatch_id == table->id && address - last_hit.start < last_hit.size)
+        return last_hit.region;
 
-    auto region = GetMemoryRegion(address);
+    size_t level = 0;
+    const DispatchSlot* slot = &table->root[address >> DISPATCH_SHIFTS[0]];
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    while (slot->children) {
+        level++;
+        slot = &slot->children[(address >> DISPATCH_SHIFTS[level]) & (DispatchChildren(level) - 1)];
+    }
 
-    U32S32 v;
+    if (slot->mixed) {
+        for (auto region : table->regions) {
+            if (address - region->base < region->size)
+                return region;
+        }
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    v.u = old_long;
-    if (vlong < v.s) v.s = vlong;
-    region->WriteLong(address - region->base, v.u);
-    region->Unlock();
+        return nullptr;
+    }
+
+    if (slot->region) {
+        Address size = 1ULL << DISPATCH_SHIFTS[level];
+        last_hit = {table->id, slot->region, address & ~(size - 1), size};
+    }
 
-    return old_long;
+    return slot->region;
 }
 
-Long Memory::AtomicMinUL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+template<typename Type>
+Expected<Type, MemoryFault> Memory::Load(Address address) const {
+    if (address & (sizeof(Type) - 1))
+        return Unexpected<MemoryFault>(MemoryFault::Misaligned);
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    if (address >= max_address)
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
     
     if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    if (vlong < old_long) region->WriteLong(address - region->base, vlong);
-    region->Unlock();
+        return Unexpected<MemoryFault>(MemoryFault::Protected);
 
-    return old_long;
+    return LoadFrom<Type>(region, address - region->base);
 }
 
-SLong Memory::AtomicMaxL(Address address, SLong vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+template<typename Type>
+Expected<bool, MemoryFault> Memory::Store(Address address, Type value) {
+    if (address & (sizeof(Type) - 1))
+        return Unexpected<MemoryFault>(MemoryFault::Misaligned);
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    if (address >= max_address)
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
     
     if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    U32S32 v;
-
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    v.u = old_long;
-    if (vlong > v.s) v.s = vlong;
-    region->WriteLong(address - region->base, v.u);
-    region->Unlock();
+        return Unexpected<MemoryFault>(MemoryFault::Protected);
 
-    return old_long;
+    StoreTo<Type>(region, address - region->base, value);
+    NotifyWrite(region, address);
+    return true;
 }
 
-Long Memory::AtomicMaxUL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+Expected<Long, MemoryFault> Memory::LoadLong(Address address) const { return Load<Long>(address); }
+Expected<Word, MemoryFault> Memory::LoadWord(Address address) const { return Load<Word>(address); }
+Expected<Half, MemoryFault> Memory::LoadHalf(Address address) const { return Load<Half>(address); }
+Expected<Byte, MemoryFault> Memory::LoadByte(Address address) const { return Load<Byte>(address); }
 
-    auto region = GetMemoryRegion(address);
+Expected<bool, MemoryFault> Memory::StoreLong(Address address, Long vlong) { return Store<Long>(address, vlong); }
+Expected<bool, MemoryFault> Memory::StoreWord(Address address, Word word) { return Store<Word>(address, word); }
+Expected<bool, MemoryFault> Memory::StoreHalf(Address address, Half half) { return Store<Half>(address, half); }
+Expected<bool, MemoryFault> Memory::StoreByte(Address address, Byte byte) { return Store<Byte>(address, byte); }
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+Long Memory::ReadLong(Address address) const {
+    auto vlong = LoadLong(address);
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    if (vlong > old_long) region->WriteLong(address - region->base, vlong);
-    region->Unlock();
+    if (!vlong)
+        ThrowMemoryFault(vlong.Error(), address, "read of long");
 
-    return old_long;
+    return vlong.Value();
 }
 
-Word Memory::AtomicSwapW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+Word Memory::ReadWord(Address address) const {
+    auto word = LoadWord(address);
 
-    region->Lock();
-    auto old_word = region->ReadLong(address - region->base);
-    region->WriteWord(address - region->base, word);
-    region->Lock();
+    if (!word)
+        ThrowMemoryFault(word.Error(), address, "read of word");
 
-    return old_word;
+    return word.Value();
 }
 
-Word Memory::AtomicAddW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+Half Memory::ReadHalf(Address address) const {
+    auto half = LoadHalf(address);
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    if (!half)
+        ThrowMemoryFault(half.Error(), address, "read of half");
 
-    auto region = GetMemoryRegion(address);
+    return half.Value();
+}
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+Byte Memory::ReadByte(Address address) const {
+    auto byte = LoadByte(address);
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word + word);
-    region->Unlock();
+    if (!byte)
+        ThrowMemoryFault(byte.Error(), address, "read of byte");
 
-    return old_word;
+    return byte.Value();
 }
 
-Word Memory::AtomicAndW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
+std::pair<Word, bool> Memory::PeekWord(Address address) const {
     if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+        throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
+        return {0, false};
     
     if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
+        return {0, false};
     
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    auto word = LoadFrom<Word>(region, address - region->base);
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word & word);
-    region->Unlock();
-
-    return old_word;
+    return {word, true};
 }
 
-Word Memory::AtomicOrW(Address address, Word word) {
+bool Memory::TryWriteWord(Address address, Word word) {
     if (address >= max_address)
         throw std::runtime_error(std::format("Tried reading from memory past max_address"));
 
     if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
+        return false;
     
     if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word | word);
-    region->Unlock();
+        return false;
 
-    return old_word;
+    StoreTo<Word>(region, address - region->base, word);
+    NotifyWrite(region, address);
+    return true;
 }
 
-Word Memory::AtomicXorW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::WriteLong(Address address, Long vlong) {
+    auto result = StoreLong(address, vlong);
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    if (!result)
+        ThrowMemoryFault(result.Error(), address, "write of long");
+}
 
-    auto region = GetMemoryRegion(address);
+void Memory::WriteWord(Address address, Word word) {
+    auto result = StoreWord(address, word);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    if (!result)
+        ThrowMemoryFault(result.Error(), address, "write of word");
+}
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word ^ word);
-    region->Unlock();
+void Memory::WriteHalf(Address address, Half half) {
+    auto result = StoreHalf(address, half);
 
-    return old_word;
+    if (!result)
+        ThrowMemoryFault(result.Error(), address, "write of half");
 }
 
-int32_t Memory::AtomicMinW(Address address, int32_t word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+void Memory::WriteByte(Address address, Byte byte) {
+    auto result = StoreByte(address, byte);
 
-    auto region = GetMemoryRegion(address);
+    if (!result)
+        ThrowMemoryFault(result.Error(), address, "write of byte");
+}
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+namespace {
 
-    U32S32 v;
+template <typename Type>
+inline Type ApplyAtomic(Type old, Type operand, auto operation) {
+    using Operation = decltype(operation);
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    v.u = old_word;
-    if (word < v.s) v.s = word;
-    region->WriteWord(address - region->base, v.u);
-    region->Unlock();
+    switch (operation) {
+        case Operation::Swap: return operand;
+        case Operation::Add: return old + operand;
+        case Operation::And: return old & operand;
+        case Operation::Or: return old | operand;
+        case Operation::Xor: return old ^ operand;
+        case Operation::Min: return std::min(old, operand);
+        case Operation::Max: return std::max(old, operand);
+    }
 
-    return old_word;
+    return old;
 }
 
-Word Memory::AtomicMinUW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
-
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+}
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    if (word < old_word) region->WriteWord(address - region->base, word);
-    region->Unlock();
+template<typename Type>
+Expected<Type, MemoryFault> Memory::Atomic(Address address, Type operand, AtomicOperation operation) {
+    using Unsigned = std::make_unsigned_t<Type>;
 
-    return old_word;
-}
+    if (address & (sizeof(Type) - 1))
+        return Unexpected<MemoryFault>(MemoryFault::Misaligned);
 
-int32_t Memory::AtomicMaxW(Address address, int32_t word) {
     if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
     
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    if (!region->readable || !region->writable)
+        return Unexpected<MemoryFault>(MemoryFault::Protected);
 
-    U32S32 v;
+    auto offset = address - region->base;
+    Type old;
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    v.u = old_word;
-    if (word > v.s) v.s = word;
-    region->WriteWord(address - region->base, v.u);
-    region->Unlock();
+    // RAM is updated with host atomics, only regions without host memory
+    // fall back to their lock
+    auto host = region->HostPointer(offset);
+    if (host && single_threaded) {
+        std::memcpy(&old, host, sizeof(Type));
 
-    return old_word;
-}
-
-Word Memory::AtomicMaxUW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+        auto value = ApplyAtomic(old, operand, operation);
+        std::memcpy(host, &value, sizeof(Type));
+    }
+    else if (host && !(reinterpret_cast<std::uintptr_t>(host) & (sizeof(Type) - 1))) {
+        std::atomic_ref<Type> value(*reinterpret_cast<Type*>(host));
+
+        switch (operation) {
+            case AtomicOperation::Swap: old = value.exchange(operand); break;
+            case AtomicOperation::Add: old = value.fetch_add(operand); break;
+            case AtomicOperation::And: old = value.fetch_and(operand); break;
+            case AtomicOperation::Or: old = value.fetch_or(operand); break;
+            case AtomicOperation::Xor: old = value.fetch_xor(operand); break;
+
+            default:
+                old = value.load();
+                while (!value.compare_exchange_weak(old, ApplyAtomic(old, operand, operation)));
+                break;
+        }
+    }
+    else {
+        region->Lock();
+        old = static_cast<Type>(LoadFrom<Unsigned>(region, offset));
+        StoreTo<Unsigned>(region, offset, static_cast<Unsigned>(ApplyAtomic(old, operand, operation)));
+        region->Unlock();
+    }
 
-    auto region = GetMemoryRegion(address);
+    NotifyWrite(region, address);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    return old;
+}
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    if (word > old_word) region->WriteWord(address - region->base, word);
-    region->Unlock();
+Expected<Long, MemoryFault> Memory::AtomicSwapL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::Swap); }
+Expected<Long, MemoryFault> Memory::AtomicAddL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::Add); }
+Expected<Long, MemoryFault> Memory::AtomicAndL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::And); }
+Expected<Long, MemoryFault> Memory::AtomicOrL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::Or); }
+Expected<Long, MemoryFault> Memory::AtomicXorL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::Xor); }
+Expected<SLong, MemoryFault> Memory::AtomicMinL(Address address, SLong vlong) { return Atomic<SLong>(address, vlong, AtomicOperation::Min); }
+Expected<Long, MemoryFault> Memory::AtomicMinUL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::Min); }
+Expected<SLong, MemoryFault> Memory::AtomicMaxL(Address address, SLong vlong) { return Atomic<SLong>(address, vlong, AtomicOperation::Max); }
+Expected<Long, MemoryFault> Memory::AtomicMaxUL(Address address, Long vlong) { return Atomic<Long>(address, vlong, AtomicOperation::Max); }
 
-    return old_word;
-}
+Expected<Word, MemoryFault> Memory::AtomicSwapW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::Swap); }
+Expected<Word, MemoryFault> Memory::AtomicAddW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::Add); }
+Expected<Word, MemoryFault> Memory::AtomicAndW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::And); }
+Expected<Word, MemoryFault> Memory::AtomicOrW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::Or); }
+Expected<Word, MemoryFault> Memory::AtomicXorW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::Xor); }
+Expected<SWord, MemoryFault> Memory::AtomicMinW(Address address, SWord word) { return Atomic<SWord>(address, word, AtomicOperation::Min); }
+Expected<Word, MemoryFault> Memory::AtomicMinUW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::Min); }
+Expected<SWord, MemoryFault> Memory::AtomicMaxW(Address address, SWord word) { return Atomic<SWord>(address, word, AtomicOperation::Max); }
+Expected<Word, MemoryFault> Memory::AtomicMaxUW(Address address, Word word) { return Atomic<Word>(address, word, AtomicOperation::Max); }
 
 void Memory::WriteLongs(Address address, const std::vector<Long>& longs) {
     for (Address head = address, i = 0; i < longs.size(); i++, head += 8) {
@@ -807,7 +687,7 @@ std::vector<std::pair<Long, bool>> Memory::PeekLongs(Address address, Address co
             region = GetMemoryRegion(head);
             if (region) {
                 end = region->base + region->size;
-                data.push_back({region->ReadLong(head - region->base), true});
+                data.push_back({LoadFrom<Long>(region, head - region->base), true});
             }
             else
                 data.push_back({0, false});
@@ -817,7 +697,7 @@ std::vector<std::pair<Long, bool>> Memory::PeekLongs(Address address, Address co
                 region = GetMemoryRegion(head);
             
             if (region) {
-                data.push_back({region->ReadLong(head - region->base), true});
+                data.push_back({LoadFrom<Long>(region, head - region->base), true});
             }
             else
                 data.push_back({0, false});
@@ -837,7 +717,7 @@ std::vector<std::pair<Word, bool>> Memory::PeekWords(Address address, Address co
             region = GetMemoryRegion(head);
             if (region) {
                 end = region->base + region->size;
-                data.push_back({region->ReadWord(head - region->base), true});
+                data.push_back({LoadFrom<Word>(region, head - region->base), true});
             }
             else
                 data.push_back({0, false});
@@ -847,7 +727,7 @@ std::vector<std::pair<Word, bool>> Memory::PeekWords(Address address, Address co
                 region = GetMemoryRegion(head);
             
             if (region) {
-                data.push_back({region->ReadWord(head - region->base), true});
+                data.push_back({LoadFrom<Word>(region, head - region->base), true});
             }
             else
                 data.push_back({0, false});
@@ -857,74 +737,195 @@ std::vector<std::pair<Word, bool>> Memory::PeekWords(Address address, Address co
     return data;
 }
 
-Long Memory::ReadLongReserved(Address address, Hart hart_id) const {
-    lock.lock();
-    for (auto& item : reservations) {
-        if (item.second == (address & ~0b11)) {
-            reservations.erase(item.first);
-            break;
-        }
+template<typename Type>
+Expected<Type, MemoryFault> Memory::LoadReserved(Address address, Hart hart_id) const {
+    auto& slot = reservations[hart_id];
+
+    // Reserve before reading, so a store landing after the read clears it
+    if (slot.granule.exchange(address & ~(RESERVATION_GRANULE - 1)) == NO_RESERVATION)
+        active_reservations.fetch_add(1);
+
+    auto value = Load<Type>(address);
+    if (!value) {
+        if (slot.granule.exchange(NO_RESERVATION) != NO_RESERVATION)
+            active_reservations.fetch_sub(1);
+        
+        return value;
     }
-    
-    reservations[hart_id] = address & ~0b11;
-    lock.unlock();
 
-    return ReadLong(address);
+    slot.value = value.Value();
+
+    return value;
 }
 
-Word Memory::ReadWordReserved(Address address, Hart hart_id) const {
-    lock.lock();
-    for (auto& item : reservations) {
-        if (item.second == (address & ~0b11)) {
-            reservations.erase(item.first);
-            break;
-        }
-    }
+template<typename Type>
+Expected<bool, MemoryFault> Memory::StoreConditional(Address address, Type value, Hart hart_id) {
+    if (address & (sizeof(Type) - 1))
+        return Unexpected<MemoryFault>(MemoryFault::Misaligned);
+
+    if (address >= max_address)
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
+
+    auto region = GetMemoryRegion(address);
+
+    if (!region)
+        return Unexpected<MemoryFault>(MemoryFault::Unmapped);
     
-    reservations[hart_id] = address & ~0b11;
-    lock.unlock();
+    if (!region->writable)
+        return Unexpected<MemoryFault>(MemoryFault::Protected);
 
-    return ReadWord(address);
-}
+    // SC gives up the reservation whether it succeeds or not
+    auto& slot = reservations[hart_id];
+    auto held = slot.granule.exchange(NO_RESERVATION);
 
-bool Memory::WriteLongConditional(Address address, Long value, Hart hart_id) {
-    lock.lock();
-    if (reservations.find(hart_id) == reservations.end()) {
-        lock.unlock();
+    if (held == NO_RESERVATION)
         return false;
-    }
+    
+    active_reservations.fetch_sub(1);
 
-    if (reservations[hart_id] != (address & ~0b11)) {
-        lock.unlock();
+    if (held != (address & ~(RESERVATION_GRANULE - 1)))
         return false;
-    }
 
-    reservations.erase(hart_id);
+    auto reserved = static_cast<Type>(slot.value);
+    auto offset = address - region->base;
+    bool stored;
 
-    lock.unlock();
+    auto host = region->HostPointer(offset);
+    if (host && single_threaded) {
+        Type current;
+        std::memcpy(&current, host, sizeof(Type));
 
-    WriteLong(address, value);
-    return true;
+        stored = current == reserved;
+        if (stored)
+            std::memcpy(host, &value, sizeof(Type));
+    }
+    else if (host && !(reinterpret_cast<std::uintptr_t>(host) & (sizeof(Type) - 1))) {
+        stored = std::atomic_ref<Type>(*reinterpret_cast<Type*>(host)).compare_exchange_strong(reserved, value);
+    }
+    else {
+        region->Lock();
+        stored = LoadFrom<Type>(region, offset) == reserved;
+        if (stored)
+            StoreTo<Type>(region, offset, value);
+        region->Unlock();
+    }
+
+    if (stored)
+        NotifyWrite(region, address);
+
+    return stored;
 }
 
-bool Memory::WriteWordConditional(Address address, Word value, Hart hart_id) {
-    lock.lock();
-    if (reservations.find(hart_id) == reservations.end()) {
-        lock.unlock();
-        return false;
+Expected<Long, MemoryFault> Memory::LoadLongReserved(Address address, Hart hart_id) const { return LoadReserved<Long>(address, hart_id); }
+Expected<Word, MemoryFault> Memory::LoadWordReserved(Address address, Hart hart_id) const { return LoadReserved<Word>(address, hart_id); }
+
+Expected<bool, MemoryFault> Memory::StoreLongConditional(Address address, Long vlong, Hart hart_id) { return StoreConditional<Long>(address, vlong, hart_id); }
+Expected<bool, MemoryFault> Memory::StoreWordConditional(Address address, Word word, Hart hart_id) { return StoreConditional<Word>(address, word, hart_id); }
+
+void Memory::ClearReservations(Address address, Address bytes) const {
+    auto first = address & ~(RESERVATION_GRANULE - 1);
+    auto last = address + bytes - 1;
+
+    for (auto& slot : reservations) {
+        auto granule = slot.granule.load(std::memory_order_relaxed);
+        if (granule == NO_RESERVATION || granule < first || granule > last)
+            continue;
+        
+        if (slot.granule.compare_exchange_strong(granule, NO_RESERVATION))
+            active_reservations.fetch_sub(1);
     }
+}
 
-    if (reservations[hart_id] != (address & ~0b11)) {
-        lock.unlock();
-        return false;
+namespace {
+
+Memory::PageImage CopyPage(const Byte* host) {
+    static const std::array<Byte, Memory::PAGE_SIZE> zeros{};
+
+    if (std::memcmp(host, zeros.data(), Memory::PAGE_SIZE) == 0)
+        return nullptr;
+
+    auto page = std::make_shared<std::array<Byte, Memory::PAGE_SIZE>>();
+    std::memcpy(page->data(), host, Memory::PAGE_SIZE);
+
+    return page;
+}
+
+}
+
+std::vector<Memory::RegionImage> Memory::CaptureImage() {
+    std::vector<RegionImage> image;
+
+    for (auto& region : regions) {
+        auto host = region->HostPointer(0);
+        if (!host || !region->writable)
+            continue;
+
+        auto& pages = image_pages[region.get()];
+
+        region->ForEachDirtyPage([&](Address offset) {
+            if (auto page = CopyPage(host + offset))
+                pages[offset] = page;
+            
+            else
+                pages.erase(offset);
+        });
+
+        region->ClearDirtyPages();
+
+        image.push_back({region->base, region->size, pages});
     }
 
-    reservations.erase(hart_id);
+    // Harts have to ask for new store pointers, which marks the pages dirty
+    code_mark_generation.fetch_add(1, std::memory_order_release);
 
-    lock.unlock();
+    return image;
+}
 
-    WriteWord(address, value);
-    return true;
+void Memory::RestoreImage(const std::vector<RegionImage>& image) {
+    for (auto& region_image : image) {
+        auto region = FindMemoryRegion(region_image.base);
+        auto host = region ? region->HostPointer(0) : nullptr;
+
+        if (!host || region->base != region_image.base || region->size != region_image.size)
+            throw std::runtime_error(std::format("There is no RAM region of {} bytes at {:#x} to restore into", region_image.size, region_image.base));
+
+        auto& target = region_image.pages;
+        auto& current = image_pages[region];
+
+        auto RestorePage = [&](Address offset) {
+            auto page = target.find(offset);
+
+            if (page != target.end())
+                std::memcpy(host + offset, page->second->data(), PAGE_SIZE);
+            
+            else
+                std::memset(host + offset, 0, PAGE_SIZE);
+
+            NotifyWrite(region, region->base + offset);
+        };
+
+        region->ForEachDirtyPage(RestorePage);
+
+        for (auto& [offset, page] : current) {
+            auto found = target.find(offset);
+            if (found == target.end() || found->second != page)
+                RestorePage(offset);
+        }
+
+        for (auto& [offset, page] : target)
+            if (!current.contains(offset))
+                RestorePage(offset);
+
+        region->ClearDirtyPages();
+        current = target;
+    }
+
+    code_mark_generation.fetch_add(1, std::memory_order_release);
+
+    // Reservations do not survive a restore, the next SC fails
+    for (auto& slot : reservations)
+        if (slot.granule.exchange(NO_RESERVATION) != NO_RESERVATION)
+            active_reservations.fetch_sub(1);
 }
 
 Address Memory::ReadFileInto(const std::string& path, Address address) {
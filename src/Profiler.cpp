@@ -0,0 +1,128 @@
+#include "Profiler.hpp"
+#include "RV64.hpp"
+
+#include <algorithm>
+#include <format>
+
+namespace {
+
+std::string Disassemble(const Memory& memory, Address pc) {
+    auto [word, valid] = memory.PeekWord(pc);
+    if (!valid)
+        return "Unmapped Memory";
+
+    return RVInstruction::FromUInt32(word);
+}
+
+}
+
+Profiler::PageCounts& Profiler::GetPage(Address page) {
+    std::lock_guard<std::mutex> guard(pages_lock);
+
+    auto& counts = pages[page];
+    if (!counts)
+        counts = std::make_unique<PageCounts>();
+
+    return *counts;
+}
+
+Long Profiler::GetCount(Address physical_pc) const {
+    std::lock_guard<std::mutex> guard(pages_lock);
+
+    auto page = pages.find(physical_pc & ~(Memory::PAGE_SIZE - 1));
+    if (page == pages.end())
+        return 0;
+
+    return (*page->second)[(physical_pc & (Memory::PAGE_SIZE - 1)) / sizeof(Word)].load(std::memory_order_relaxed);
+}
+
+Long Profiler::GetTotal() const {
+    std::lock_guard<std::mutex> guard(pages_lock);
+
+    Long total = 0;
+    for (auto& [page, counts] : pages)
+        for (auto& count : *counts)
+            total += count.load(std::memory_order_relaxed);
+
+    return total;
+}
+
+Long Profiler::GetMaxCount() const {
+    std::lock_guard<std::mutex> guard(pages_lock);
+
+    Long max = 0;
+    for (auto& [page, counts] : pages)
+        for (auto& count : *counts)
+            max = std::max(max, count.load(std::memory_order_relaxed));
+
+    return max;
+}
+
+std::vector<Profiler::HotSpot> Profiler::GetHotSpots(size_t max) const {
+    std::vector<HotSpot> hot_spots;
+
+    {
+        std::lock_guard<std::mutex> guard(pages_lock);
+
+        for (auto& [page, counts] : pages) {
+            for (size_t i = 0; i < counts->size(); i++) {
+                auto count = (*counts)[i].load(std::memory_order_relaxed);
+                if (count != 0)
+                    hot_spots.push_back({page + i * sizeof(Word), count});
+            }
+        }
+    }
+
+    // Ties stay in address order
+    std::stable_sort(hot_spots.begin(), hot_spots.end(), [](const HotSpot& a, const HotSpot& b) { return a.count > b.count; });
+
+    if (hot_spots.size() > max)
+        hot_spots.resize(max);
+
+    return hot_spots;
+}
+
+// Not while this profiler's own hart is counting
+void Profiler::Merge(const Profiler& other) {
+    for (auto& hot_spot : other.GetHotSpots())
+        Count(hot_spot.pc, hot_spot.count);
+}
+
+void Profiler::Clear() {
+    std::lock_guard<std::mutex> guard(pages_lock);
+
+    for (auto& [page, counts] : pages)
+        for (auto& count : *counts)
+            count.store(0, std::memory_order_relaxed);
+}
+
+std::string Profiler::HotSpotReport(const Memory& memory, size_t max) const {
+    auto total = GetTotal();
+    std::string report = std::format("{} instructions counted\n", total);
+
+    auto hot_spots = GetHotSpots(max);
+
+    for (size_t i = 0; i < hot_spots.size(); i++) {
+        double share = 100.0 * hot_spots[i].count / total;
+        report += std::format("{:>4} 0x{:0>16x} {:>12} {:>6.2f}% {}\n", i + 1, hot_spots[i].pc, hot_spots[i].count, share, Disassemble(memory, hot_spots[i].pc));
+    }
+
+    return report;
+}
+
+std::string Profiler::Listing(const Memory& memory) const {
+    auto hot_spots = GetHotSpots();
+
+    std::sort(hot_spots.begin(), hot_spots.end(), [](const HotSpot& a, const HotSpot& b) { return a.pc < b.pc; });
+
+    std::string listing;
+
+    for (size_t i = 0; i < hot_spots.size(); i++) {
+        if (i != 0 && hot_spots[i].pc != hot_spots[i - 1].pc + sizeof(Word))
+            listing += "...\n";
+
+        listing += std::format("0x{:0>16x} {:>12} {}\n", hot_spots[i].pc, hot_spots[i].count, Disassemble(memory, hot_spots[i].pc));
+    }
+
+    return listing;
+}
@@ -158,7 +158,7 @@ void RVInstruction::SetupCSRNames() {
     csr_names[0x7a8] = "mcontext";
 }
 
-RVInstruction::operator std::string() {
+RVInstruction::operator std::string() const {
     std::string s;
 
     union SU64 {
@@ -335,6 +335,10 @@ RVInstruction::operator std::string() {
             s = std::format("FENCE");
             break;
         
+        case Type::FENCE_I:
+            s = std::format("FENCE.I");
+            break;
+        
         case Type::ECALL:
             s = std::format("ECALL");
             break;
@@ -779,12 +783,448 @@ RVInstruction::operator std::string() {
     return s;
 }
 
-RVInstruction RVInstruction::FromUInt32(Word instr) {
-    RVInstructionWord iw;
-    iw.raw = instr;
+namespace {
+
+using Type = RVInstruction::Type;
+using R = RVInstruction;
+
+enum class Format : Byte {
+    U,
+    J,
+    I,
+    ShiftImmediate,
+    B,
+    S,
+    R,
+    RFloat,
+    R4,
+    Fence,
+    System,
+    CSR
+};
+
+// An instruction matches when (word & mask) == match
+struct Descriptor {
+    Type type;
+    Format format;
+    Word mask;
+    Word match;
+};
+
+constexpr Word MASK_OPCODE = 0x0000007f;
+constexpr Word MASK_RD = 0x00000f80;
+constexpr Word MASK_FUNCT3 = 0x00007000;
+constexpr Word MASK_RS1 = 0x000f8000;
+constexpr Word MASK_RS2 = 0x01f00000;
+constexpr Word MASK_FUNCT2 = 0x06000000;
+constexpr Word MASK_FUNCT5 = 0xf8000000;
+constexpr Word MASK_FUNCT6 = 0xfc000000;
+constexpr Word MASK_FUNCT7 = 0xfe000000;
+constexpr Word MASK_FUNCT12 = 0xfff00000;
+
+constexpr Word RD(Word rd) { return rd << 7; }
+constexpr Word FUNCT3(Word funct3) { return funct3 << 12; }
+constexpr Word RS1(Word rs1) { return rs1 << 15; }
+constexpr Word RS2(Word rs2) { return rs2 << 20; }
+constexpr Word FUNCT2(Word funct2) { return funct2 << 25; }
+constexpr Word FUNCT5(Word funct5) { return funct5 << 27; }
+constexpr Word FUNCT6(Word funct6) { return funct6 << 26; }
+constexpr Word FUNCT7(Word funct7) { return funct7 << 25; }
+constexpr Word FUNCT12(Word funct12) { return funct12 << 20; }
+
+constexpr Descriptor Op(Type type, Format format, Byte opcode) {
+    return {type, format, MASK_OPCODE, opcode};
+}
+
+constexpr Descriptor OpF3(Type type, Format format, Byte opcode, Byte funct3, Word mask = 0, Word match = 0) {
+    return {type, format, MASK_OPCODE | MASK_FUNCT3 | mask, opcode | FUNCT3(funct3) | match};
+}
+
+constexpr Descriptor OpF3F7(Type type, Byte opcode, Byte funct3, Byte funct7) {
+    return OpF3(type, Format::R, opcode, funct3, MASK_FUNCT7, FUNCT7(funct7));
+}
+
+constexpr Descriptor System(Type type, Half funct12) {
+    return OpF3(type, Format::System, R::OP_SYSTEM, R::FUNCT3_SYSTEM, MASK_RD | MASK_RS1 | MASK_FUNCT12, RD(R::RD_SYSTEM) | RS1(R::RS1_SYSTEM) | FUNCT12(funct12));
+}
+
+constexpr Descriptor Atomic(Type type, Byte funct7, Word mask = 0, Word match = 0) {
+    return OpF3(type, Format::R, R::OP_ATOMIC, R::FUNCT3_ATOMIC, MASK_FUNCT5 | mask, FUNCT7(funct7) | match);
+}
+
+constexpr Descriptor Fused(Type type, Byte opcode, Byte funct2) {
+    return {type, Format::R4, MASK_OPCODE | MASK_FUNCT2, opcode | FUNCT2(funct2)};
+}
+
+constexpr Descriptor Float(Type type, Byte funct5, Byte funct2, Word mask = 0, Word match = 0) {
+    return {type, Format::RFloat, MASK_OPCODE | MASK_FUNCT7 | mask, R::OP_FLOAT | FUNCT5(funct5) | FUNCT2(funct2) | match};
+}
+
+constexpr Descriptor FloatF3(Type type, Byte funct5, Byte funct2, Byte funct3, Word mask = 0, Word match = 0) {
+    return Float(type, funct5, funct2, MASK_FUNCT3 | mask, FUNCT3(funct3) | match);
+}
+
+constexpr Descriptor FloatRS2(Type type, Byte funct5, Byte funct2, Byte rs2) {
+    return Float(type, funct5, funct2, MASK_RS2, RS2(rs2));
+}
+
+constexpr Descriptor CUST(Type type, Byte funct7) {
+    return {type, Format::R, MASK_OPCODE | MASK_FUNCT7, R::OP_CUST | FUNCT7(funct7)};
+}
+
+constexpr std::array DESCRIPTORS = {
+    Op(Type::LUI, Format::U, R::OP_LUI),
+    Op(Type::AUIPC, Format::U, R::OP_AUIPC),
+    Op(Type::JAL, Format::J, R::OP_JAL),
+    OpF3(Type::JALR, Format::I, R::OP_JALR, R::FUNCT3_JALR),
+
+    OpF3(Type::BEQ, Format::B, R::OP_BRANCH, R::FUNCT3_BEQ),
+    OpF3(Type::BNE, Format::B, R::OP_BRANCH, R::FUNCT3_BNE),
+    OpF3(Type::BLT, Format::B, R::OP_BRANCH, R::FUNCT3_BLT),
+    OpF3(Type::BGE, Format::B, R::OP_BRANCH, R::FUNCT3_BGE),
+    OpF3(Type::BLTU, Format::B, R::OP_BRANCH, R::FUNCT3_BLTU),
+    OpF3(Type::BGEU, Format::B, R::OP_BRANCH, R::FUNCT3_BGEU),
+
+    OpF3(Type::LB, Format::I, R::OP_LOAD, R::FUNCT3_LB),
+    OpF3(Type::LH, Format::I, R::OP_LOAD, R::FUNCT3_LH),
+    OpF3(Type::LW, Format::I, R::OP_LOAD, R::FUNCT3_LW),
+    OpF3(Type::LD, Format::I, R::OP_LOAD, R::FUNCT3_LD),
+    OpF3(Type::LBU, Format::I, R::OP_LOAD, R::FUNCT3_LBU),
+    OpF3(Type::LHU, Format::I, R::OP_LOAD, R::FUNCT3_LHU),
+    OpF3(Type::LWU, Format::I, R::OP_LOAD, R::FUNCT3_LWU),
+
+    OpF3(Type::SB, Format::S, R::OP_STORE, R::FUNCT3_SB),
+    OpF3(Type::SH, Format::S, R::OP_STORE, R::FUNCT3_SH),
+    OpF3(Type::SW, Format::S, R::OP_STORE, R::FUNCT3_SW),
+    OpF3(Type::SD, Format::S, R::OP_STORE, R::FUNCT3_SD),
+
+    OpF3(Type::ADDI, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_ADDI),
+    OpF3(Type::SLTI, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_SLTI),
+    OpF3(Type::SLTIU, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_SLTIU),
+    OpF3(Type::XORI, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_XORI),
+    OpF3(Type::ORI, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_ORI),
+    OpF3(Type::ANDI, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_ANDI),
+    OpF3(Type::SLLI, Format::I, R::OP_MATH_IMMEDIATE, R::FUNCT3_SLLI, MASK_FUNCT6, FUNCT6(R::FUNCT7_SLLI)),
+    OpF3(Type::SRLI, Format::ShiftImmediate, R::OP_MATH_IMMEDIATE, R::FUNCT3_SHIFT_RIGHT_IMMEDIATE, MASK_FUNCT6, FUNCT6(R::FUNCT7_SRLI)),
+    OpF3(Type::SRAI, Format::ShiftImmediate, R::OP_MATH_IMMEDIATE, R::FUNCT3_SHIFT_RIGHT_IMMEDIATE, MASK_FUNCT6, FUNCT6(R::FUNCT7_SRAI)),
+
+    OpF3(Type::ADDIW, Format::I, R::OP_MATH_W_IMMEDIATE, R::FUNCT3_ADDI),
+    OpF3(Type::SLLIW, Format::I, R::OP_MATH_W_IMMEDIATE, R::FUNCT3_SLLI, MASK_FUNCT7, FUNCT7(R::FUNCT7_SLLI)),
+    OpF3(Type::SRLIW, Format::I, R::OP_MATH_W_IMMEDIATE, R::FUNCT3_SHIFT_RIGHT_IMMEDIATE, MASK_FUNCT6, FUNCT6(R::FUNCT7_SRLI)),
+    OpF3(Type::SRAIW, Format::I, R::OP_MATH_W_IMMEDIATE, R::FUNCT3_SHIFT_RIGHT_IMMEDIATE, MASK_FUNCT6, FUNCT6(R::FUNCT7_SRAI)),
+
+    OpF3F7(Type::ADD, R::OP_MATH, R::FUNCT3_ADD_SUB_MUL, R::FUNCT7_ADD),
+    OpF3F7(Type::SUB, R::OP_MATH, R::FUNCT3_ADD_SUB_MUL, R::FUNCT7_SUB),
+    OpF3F7(Type::MUL, R::OP_MATH, R::FUNCT3_ADD_SUB_MUL, R::FUNCT7_MUL),
+    OpF3F7(Type::SLL, R::OP_MATH, R::FUNCT3_SLL_MULH, R::FUNCT7_SLL),
+    OpF3F7(Type::MULH, R::OP_MATH, R::FUNCT3_SLL_MULH, R::FUNCT7_MULH),
+    OpF3F7(Type::SLT, R::OP_MATH, R::FUNCT3_SLT_MULHSU, R::FUNCT7_SLT),
+    OpF3F7(Type::MULHSU, R::OP_MATH, R::FUNCT3_SLT_MULHSU, R::FUNCT7_MULHSU),
+    OpF3F7(Type::SLTU, R::OP_MATH, R::FUNCT3_SLTU_MULHU, R::FUNCT7_SLTU),
+    OpF3F7(Type::MULHU, R::OP_MATH, R::FUNCT3_SLTU_MULHU, R::FUNCT7_MULHU),
+    OpF3F7(Type::XOR, R::OP_MATH, R::FUNCT3_XOR_DIV, R::FUNCT7_XOR),
+    OpF3F7(Type::DIV, R::OP_MATH, R::FUNCT3_XOR_DIV, R::FUNCT7_DIV),
+    OpF3F7(Type::SRL, R::OP_MATH, R::FUNCT3_SHIFT_RIGHT_DIVU, R::FUNCT7_SRL),
+    OpF3F7(Type::SRA, R::OP_MATH, R::FUNCT3_SHIFT_RIGHT_DIVU, R::FUNCT7_SRA),
+    OpF3F7(Type::DIVU, R::OP_MATH, R::FUNCT3_SHIFT_RIGHT_DIVU, R::FUNCT7_DIVU),
+    OpF3F7(Type::OR, R::OP_MATH, R::FUNCT3_OR_REM, R::FUNCT7_OR),
+    OpF3F7(Type::REM, R::OP_MATH, R::FUNCT3_OR_REM, R::FUNCT7_REM),
+    OpF3F7(Type::AND, R::OP_MATH, R::FUNCT3_AND_REMU, R::FUNCT7_AND),
+    OpF3F7(Type::REMU, R::OP_MATH, R::FUNCT3_AND_REMU, R::FUNCT7_REMU),
+
+    OpF3F7(Type::ADDW, R::OP_MATH_W, R::FUNCT3_ADD_SUB_MUL, R::FUNCT7_ADD),
+    OpF3F7(Type::SUBW, R::OP_MATH_W, R::FUNCT3_ADD_SUB_MUL, R::FUNCT7_SUB),
+    OpF3F7(Type::MULW, R::OP_MATH_W, R::FUNCT3_ADD_SUB_MUL, R::FUNCT7_MUL),
+    OpF3F7(Type::SLLW, R::OP_MATH_W, R::FUNCT3_SLL_MULH, R::FUNCT7_SLL),
+    OpF3F7(Type::SLTU, R::OP_MATH_W, R::FUNCT3_SLTU_MULHU, R::FUNCT7_SLTU),
+    OpF3F7(Type::DIVW, R::OP_MATH_W, R::FUNCT3_XOR_DIV, R::FUNCT7_DIV),
+    OpF3F7(Type::SRLW, R::OP_MATH_W, R::FUNCT3_SHIFT_RIGHT_DIVU, R::FUNCT7_SRL),
+    OpF3F7(Type::SRAW, R::OP_MATH_W, R::FUNCT3_SHIFT_RIGHT_DIVU, R::FUNCT7_SRA),
+    OpF3F7(Type::DIVUW, R::OP_MATH_W, R::FUNCT3_SHIFT_RIGHT_DIVU, R::FUNCT7_DIVU),
+    OpF3F7(Type::REMW, R::OP_MATH_W, R::FUNCT3_OR_REM, R::FUNCT7_REM),
+    OpF3F7(Type::REMUW, R::OP_MATH_W, R::FUNCT3_AND_REMU, R::FUNCT7_REMU),
+
+    OpF3(Type::FENCE, Format::Fence, R::OP_FENCE, R::FUNCT3_FENCE),
+    OpF3(Type::FENCE_I, Format::Fence, R::OP_FENCE, R::FUNCT3_FENCE_I),
+
+    System(Type::ECALL, R::IMM_ECALL),
+    System(Type::EBREAK, R::IMM_EBREAK),
+    System(Type::SRET, R::IMM_SRET),
+    System(Type::MRET, R::IMM_MRET),
+    System(Type::WFI, R::IMM_WFI),
+    OpF3(Type::SFENCE_VMA, Format::System, R::OP_SYSTEM, R::FUNCT3_SYSTEM, MASK_RD | MASK_FUNCT7, RD(R::RD_SYSTEM) | FUNCT7(R::FUNCT7_SFENCE_VMA)),
+    OpF3(Type::SINVAL_VMA, Format::System, R::OP_SYSTEM, R::FUNCT3_SYSTEM, MASK_RD | MASK_FUNCT7, RD(R::RD_SYSTEM) | FUNCT7(R::FUNCT7_SINVAL_VMA)),
+    OpF3(Type::SINVAL_GVMA, Format::System, R::OP_SYSTEM, R::FUNCT3_SYSTEM, MASK_RD | MASK_FUNCT7, RD(R::RD_SYSTEM) | FUNCT7(R::FUNCT7_SINVAL_GVMA)),
+    OpF3(Type::SFENCE_W_INVAL, Format::System, R::OP_SYSTEM, R::FUNCT3_SYSTEM, MASK_RD | MASK_RS1 | MASK_RS2 | MASK_FUNCT7, RD(R::RD_SYSTEM) | RS1(R::RS1_SYSTEM) | RS2(R::RS2_SFENCE_W_INVAL) | FUNCT7(R::FUNCT7_SFENCE_SINVAL)),
+    OpF3(Type::SFENCE_INVAL_IR, Format::System, R::OP_SYSTEM, R::FUNCT3_SYSTEM, MASK_RD | MASK_RS1 | MASK_RS2 | MASK_FUNCT7, RD(R::RD_SYSTEM) | RS1(R::RS1_SYSTEM) | RS2(R::RS2_SFENCE_INVAL_IR) | FUNCT7(R::FUNCT7_SFENCE_SINVAL)),
+
+    OpF3(Type::CSRRW, Format::CSR, R::OP_CSR, R::FUNCT3_CSRRW),
+    OpF3(Type::CSRRS, Format::CSR, R::OP_CSR, R::FUNCT3_CSRRS),
+    OpF3(Type::CSRRC, Format::CSR, R::OP_CSR, R::FUNCT3_CSRRC),
+    OpF3(Type::CSRRWI, Format::CSR, R::OP_CSR, R::FUNCT3_CSRRWI),
+    OpF3(Type::CSRRSI, Format::CSR, R::OP_CSR, R::FUNCT3_CSRRSI),
+    OpF3(Type::CSRRCI, Format::CSR, R::OP_CSR, R::FUNCT3_CSRRCI),
+
+    Atomic(Type::LR_W, R::FUNCT7_LR_W, MASK_RS2, RS2(R::RS2_LR_W)),
+    Atomic(Type::SC_W, R::FUNCT7_SC_W),
+    Atomic(Type::AMOSWAP_W, R::FUNCT7_AMOSWAP_W),
+    Atomic(Type::AMOADD_W, R::FUNCT7_AMOADD_W),
+    Atomic(Type::AMOXOR_W, R::FUNCT7_AMOXOR_W),
+    Atomic(Type::AMOAND_W, R::FUNCT7_AMOAND_W),
+    Atomic(Type::AMOOR_W, R::FUNCT7_AMOOR_W),
+    Atomic(Type::AMOMIN_W, R::FUNCT7_AMOMIN_W),
+    Atomic(Type::AMOMAX_W, R::FUNCT7_AMOMAX_W),
+    Atomic(Type::AMOMINU_W, R::FUNCT7_AMOMINU_W),
+    Atomic(Type::AMOMAXU_W, R::FUNCT7_AMOMAXU_W),
+
+    OpF3(Type::FLW, Format::I, R::OP_FL, R::FUNCT3_FLW),
+    OpF3(Type::FLD, Format::I, R::OP_FL, R::FUNCT3_FLD),
+    OpF3(Type::FSW, Format::S, R::OP_FS, R::FUNCT3_FSW),
+    OpF3(Type::FSD, Format::S, R::OP_FS, R::FUNCT3_FSD),
+
+    Fused(Type::FMADD_S, R::OP_FMADD, R::FUNCT2_S),
+    Fused(Type::FMADD_D, R::OP_FMADD, R::FUNCT2_D),
+    Fused(Type::FMSUB_S, R::OP_FMSUB, R::FUNCT2_S),
+    Fused(Type::FMSUB_D, R::OP_FMSUB, R::FUNCT2_D),
+    Fused(Type::FNMSUB_S, R::OP_FNMSUB, R::FUNCT2_S),
+    Fused(Type::FNMSUB_D, R::OP_FNMSUB, R::FUNCT2_D),
+    Fused(Type::FNMADD_S, R::OP_FNMADD, R::FUNCT2_S),
+    Fused(Type::FNMADD_D, R::OP_FNMADD, R::FUNCT2_D),
+
+    Float(Type::FADD_S, R::FUNCT5_FADD, R::FUNCT2_S),
+    Float(Type::FADD_D, R::FUNCT5_FADD, R::FUNCT2_D),
+    Float(Type::FSUB_S, R::FUNCT5_FSUB, R::FUNCT2_S),
+    Float(Type::FSUB_D, R::FUNCT5_FSUB, R::FUNCT2_D),
+    Float(Type::FMUL_S, R::FUNCT5_FMUL, R::FUNCT2_S),
+    Float(Type::FMUL_D, R::FUNCT5_FMUL, R::FUNCT2_D),
+    Float(Type::FDIV_S, R::FUNCT5_FDIV, R::FUNCT2_S),
+    Float(Type::FDIV_D, R::FUNCT5_FDIV, R::FUNCT2_D),
+    FloatRS2(Type::FSQRT_S, R::FUNCT5_FSQRT, R::FUNCT2_S, R::RS2_FSQRT),
+    FloatRS2(Type::FSQRT_D, R::FUNCT5_FSQRT, R::FUNCT2_D, R::RS2_FSQRT),
+
+    FloatF3(Type::FSGNJ_S, R::FUNCT5_FSGNJ, R::FUNCT2_S, R::FUNCT3_FSGNJ),
+    FloatF3(Type::FSGNJ_D, R::FUNCT5_FSGNJ, R::FUNCT2_D, R::FUNCT3_FSGNJ),
+    FloatF3(Type::FSGNJN_S, R::FUNCT5_FSGNJ, R::FUNCT2_S, R::FUNCT3_FSGNJN),
+    FloatF3(Type::FSGNJN_D, R::FUNCT5_FSGNJ, R::FUNCT2_D, R::FUNCT3_FSGNJN),
+    FloatF3(Type::FSGNJX_S, R::FUNCT5_FSGNJ, R::FUNCT2_S, R::FUNCT3_FSGNJX),
+    FloatF3(Type::FSGNJX_D, R::FUNCT5_FSGNJ, R::FUNCT2_D, R::FUNCT3_FSGNJX),
+    FloatF3(Type::FMIN_S, R::FUNCT5_FMIN_FMAX, R::FUNCT2_S, R::FUNCT3_FMIN),
+    FloatF3(Type::FMIN_D, R::FUNCT5_FMIN_FMAX, R::FUNCT2_D, R::FUNCT3_FMIN),
+    FloatF3(Type::FMAX_S, R::FUNCT5_FMIN_FMAX, R::FUNCT2_S, R::FUNCT3_FMAX),
+    FloatF3(Type::FMAX_D, R::FUNCT5_FMIN_FMAX, R::FUNCT2_D, R::FUNCT3_FMAX),
+
+    FloatRS2(Type::FCVT_W_S, R::FUNCT5_FCVT_W, R::FUNCT2_S, R::RS2_FCVT_W),
+    FloatRS2(Type::FCVT_WU_S, R::FUNCT5_FCVT_W, R::FUNCT2_S, R::RS2_FCVT_WU),
+    FloatRS2(Type::FCVT_W_D, R::FUNCT5_FCVT_W, R::FUNCT2_D, R::RS2_FCVT_W),
+    FloatRS2(Type::FCVT_WU_D, R::FUNCT5_FCVT_W, R::FUNCT2_D, R::RS2_FCVT_WU),
+
+    FloatF3(Type::FMV_X_W, R::FUNCT5_FCLASS_FMV_X_W, R::FUNCT2_S, R::FUNCT3_FMV_X_W, MASK_RS2, RS2(R::RS2_FMV_X_W)),
+    FloatF3(Type::FMV_X_D, R::FUNCT5_FCLASS_FMV_X_W, R::FUNCT2_D, R::FUNCT3_FMV_X_W, MASK_RS2, RS2(R::RS2_FMV_X_W)),
+    FloatF3(Type::FCLASS_S, R::FUNCT5_FCLASS_FMV_X_W, R::FUNCT2_S, R::FUNCT3_FCLASS, MASK_RS2, RS2(R::RS2_FCLASS)),
+    FloatF3(Type::FCLASS_D, R::FUNCT5_FCLASS_FMV_X_W, R::FUNCT2_D, R::FUNCT3_FCLASS, MASK_RS2, RS2(R::RS2_FCLASS)),
+
+    FloatF3(Type::FEQ_S, R::FUNCT5_FCOMPARE, R::FUNCT2_S, R::FUNCT3_FEQ),
+    FloatF3(Type::FEQ_D, R::FUNCT5_FCOMPARE, R::FUNCT2_D, R::FUNCT3_FEQ),
+    FloatF3(Type::FLT_S, R::FUNCT5_FCOMPARE, R::FUNCT2_S, R::FUNCT3_FLT),
+    FloatF3(Type::FLT_D, R::FUNCT5_FCOMPARE, R::FUNCT2_D, R::FUNCT3_FLT),
+    FloatF3(Type::FLE_S, R::FUNCT5_FCOMPARE, R::FUNCT2_S, R::FUNCT3_FLE),
+    FloatF3(Type::FLE_D, R::FUNCT5_FCOMPARE, R::FUNCT2_D, R::FUNCT3_FLE),
+
+    FloatRS2(Type::FCVT_S_W, R::FUNCT5_FCVT, R::FUNCT2_S, R::RS2_FCVT_W),
+    FloatRS2(Type::FCVT_D_W, R::FUNCT5_FCVT, R::FUNCT2_D, R::RS2_FCVT_W),
+    FloatRS2(Type::FCVT_S_WU, R::FUNCT5_FCVT, R::FUNCT2_S, R::RS2_FCVT_WU),
+    FloatRS2(Type::FCVT_D_WU, R::FUNCT5_FCVT, R::FUNCT2_D, R::RS2_FCVT_WU),
+    FloatRS2(Type::FCVT_S_L, R::FUNCT5_FCVT, R::FUNCT2_S, R::RS2_FCVT_L),
+    FloatRS2(Type::FCVT_D_L, R::FUNCT5_FCVT, R::FUNCT2_D, R::RS2_FCVT_L),
+    FloatRS2(Type::FCVT_S_LU, R::FUNCT5_FCVT, R::FUNCT2_S, R::RS2_FCVT_LU),
+    FloatRS2(Type::FCVT_D_LU, R::FUNCT5_FCVT, R::FUNCT2_D, R::RS2_FCVT_LU),
+
+    Descriptor{Type::FMV_W_X, Format::RFloat, MASK_OPCODE | MASK_FUNCT5 | MASK_FUNCT3 | MASK_RS2, R::OP_FLOAT | FUNCT5(R::FUNCT5_FMV_W_X) | FUNCT3(R::FUNCT3_FMV_W_X) | RS2(R::RS2_FMV_W_X)},
+
+    Float(Type::FCVT_L_S, R::FUNCT5_FCVT_D, R::FUNCT2_S),
+    Float(Type::FCVT_L_D, R::FUNCT5_FCVT_D, R::FUNCT2_D),
+
+    CUST(Type::CUST_TVA, R::FUNCT7_CUST_TVA),
+    CUST(Type::CUST_MTRAP, R::FUNCT7_CUST_MTRAP),
+    CUST(Type::CUST_STRAP, R::FUNCT7_CUST_STRAP)
+};
+
+static_assert(DESCRIPTORS.size() < 256);
+
+// Descriptor indices bucketed by opcode, so the table builders below only
+// look at descriptors that can possibly match
+constexpr size_t OPCODE_COUNT = 1 << 7;
+
+struct OpcodeBuckets {
+    std::array<Half, OPCODE_COUNT + 1> first;
+    std::array<Byte, DESCRIPTORS.size()> indices;
+};
+
+constexpr OpcodeBuckets BuildOpcodeBuckets() {
+    OpcodeBuckets buckets{};
+
+    for (const auto& desc : DESCRIPTORS)
+        buckets.first[(desc.match & MASK_OPCODE) + 1]++;
+    
+    for (size_t i = 0; i < OPCODE_COUNT; i++)
+        buckets.first[i + 1] += buckets.first[i];
+    
+    auto next = buckets.first;
+    for (size_t i = 0; i < DESCRIPTORS.size(); i++)
+        buckets.indices[next[DESCRIPTORS[i].match & MASK_OPCODE]++] = static_cast<Byte>(i);
+
+    return buckets;
+}
+
+constexpr OpcodeBuckets OPCODE_BUCKETS = BuildOpcodeBuckets();
+
+template <typename Visitor>
+constexpr void ForEachMatch(Word word, Word key_mask, Visitor visit) {
+    Byte opcode = word & MASK_OPCODE;
+
+    for (size_t i = OPCODE_BUCKETS.first[opcode]; i < OPCODE_BUCKETS.first[opcode + 1]; i++) {
+        const auto& desc = DESCRIPTORS[OPCODE_BUCKETS.indices[i]];
+
+        if ((word & desc.mask & key_mask) == (desc.match & key_mask))
+            visit(OPCODE_BUCKETS.indices[i]);
+    }
+}
+
+// The first level is indexed by opcode and funct3. Entries with more than
+// a couple of candidates that are told apart by funct7 point to a group of
+// 128 second level entries instead. Every entry lists the few descriptors
+// that can still match, which are then checked against their full mask.
+constexpr Word KEY_MASK = MASK_OPCODE | MASK_FUNCT3;
+constexpr size_t FIRST_LEVEL_SIZE = 1 << 10;
+constexpr size_t GROUP_SIZE = 1 << 7;
+constexpr size_t MAX_SCANNED_CANDIDATES = 2;
+
+// The first candidate is kept inline, the rest (if any) live in the
+// candidate array. Entries without candidates never match.
+struct DecodeEntry {
+    Descriptor first = {Type::INVALID, Format::R, 0, 1};
+    Half rest = 0;
+    Byte rest_count = 0;
+    bool is_group = false;
+};
+
+constexpr Word FirstLevelWord(size_t index) {
+    return (index & MASK_OPCODE) | FUNCT3(static_cast<Word>(index >> 7));
+}
+
+constexpr std::array<bool, FIRST_LEVEL_SIZE> FindGroups() {
+    std::array<bool, FIRST_LEVEL_SIZE> groups{};
+
+    for (size_t i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        size_t candidates = 0;
+        bool uses_funct7 = false;
+
+        ForEachMatch(FirstLevelWord(i), KEY_MASK, [&](Byte index) {
+            candidates++;
+            if (DESCRIPTORS[index].mask & MASK_FUNCT7) uses_funct7 = true;
+        });
+
+        groups[i] = candidates > MAX_SCANNED_CANDIDATES && uses_funct7;
+    }
+
+    return groups;
+}
+
+constexpr std::array<bool, FIRST_LEVEL_SIZE> IS_GROUP = FindGroups();
+
+constexpr size_t CountGroups() {
+    size_t groups = 0;
+    for (bool is_group : IS_GROUP)
+        if (is_group) groups++;
+    
+    return groups;
+}
+
+constexpr size_t GROUP_COUNT = CountGroups();
+
+template <typename Visitor>
+constexpr void VisitEntries(Visitor visit) {
+    size_t group = 0;
+
+    for (size_t i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        Word word = FirstLevelWord(i);
+
+        if (!IS_GROUP[i]) {
+            visit(i, word, KEY_MASK);
+            continue;
+        }
+
+        for (Word funct7 = 0; funct7 < GROUP_SIZE; funct7++)
+            visit(FIRST_LEVEL_SIZE + group * GROUP_SIZE + funct7, word | FUNCT7(funct7), KEY_MASK | MASK_FUNCT7);
+        
+        group++;
+    }
+}
+
+constexpr size_t CountCandidates() {
+    size_t count = 0;
+
+    VisitEntries([&](size_t, Word word, Word key_mask) {
+        size_t matches = 0;
+        ForEachMatch(word, key_mask, [&](Byte) { matches++; });
+
+        if (matches > 1)
+            count += matches - 1;
+    });
+
+    return count;
+}
+
+constexpr size_t CANDIDATE_COUNT = CountCandidates();
+
+struct DecodeTable {
+    std::array<DecodeEntry, FIRST_LEVEL_SIZE + GROUP_COUNT * GROUP_SIZE> entries;
+    std::array<Descriptor, CANDIDATE_COUNT> candidates;
+};
+
+constexpr DecodeTable BuildDecodeTable() {
+    DecodeTable table{};
+    size_t next = 0;
+    size_t group = 0;
+
+    for (size_t i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        if (!IS_GROUP[i]) continue;
+
+        table.entries[i].rest = static_cast<Half>(group++);
+        table.entries[i].is_group = true;
+    }
+
+    VisitEntries([&](size_t index, Word word, Word key_mask) {
+        auto& entry = table.entries[index];
+        entry.rest = static_cast<Half>(next);
+        bool has_first = false;
 
+        ForEachMatch(word, key_mask, [&](Byte desc) {
+            if (!has_first) {
+                entry.first = DESCRIPTORS[desc];
+                has_first = true;
+                return;
+            }
+
+            table.candidates[next++] = DESCRIPTORS[desc];
+            entry.rest_count++;
+        });
+    });
+
+    return table;
+}
+
+constexpr DecodeTable DECODE_TABLE = BuildDecodeTable();
+
+constexpr Long SignExtend(Word value, Byte bit) {
+    Long sign = -1ULL << bit;
+    if (value & (1ULL << bit)) return value | sign;
+    return value;
+}
+
+inline RVInstruction Extract(const Descriptor& desc, Word instr) {
     RVInstruction rv;
-    rv.type = RVInstruction::Type::INVALID;
+    rv.type = desc.type;
     rv.immediate = 0;
     rv.rd = 0;
     rv.rs1 = 0;
@@ -792,1185 +1232,116 @@ RVInstruction RVInstruction::FromUInt32(Word instr) {
     rv.rm = 0;
     rv.rs3 = 0;
 
-    int8_t sign_extend_at = -1;
-
-    switch (iw.opcode) {
-        case OP_LUI:
-            rv.type = RVInstruction::Type::LUI;
-            rv.rd = iw.U.rd;
-            rv.immediate = iw.U.imm << 12;
-            sign_extend_at = 31;
-            break;
-        
-        case OP_AUIPC:
-            rv.type = RVInstruction::Type::AUIPC;
-            rv.rd = iw.U.rd;
-            rv.immediate = iw.U.imm << 12;
-            sign_extend_at = 31;
-            break;
-        
-        case OP_JAL:
-            rv.type = RVInstruction::Type::JAL;
-            rv.rd = iw.J.rd;
-            rv.immediate = iw.J.imm0 << 1;
-            rv.immediate |= iw.J.imm1 << 11;
-            rv.immediate |= iw.J.imm2 << 12;
-            rv.immediate |= iw.J.imm3 << 20;
-            sign_extend_at = 20;
-            break;
-        
-        case OP_JALR:
-            if (iw.I.funct3 != 0) break;
-
-            rv.type = RVInstruction::Type::JALR;
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-            break;
-        
-        case OP_BRANCH:
-            rv.rs1 = iw.B.rs1;
-            rv.rs2 = iw.B.rs2;
-            rv.immediate = iw.B.imm0 << 1;
-            rv.immediate |= iw.B.imm1 << 5;
-            rv.immediate |= iw.B.imm2 << 11;
-            rv.immediate |= iw.B.imm3 << 12;
-            sign_extend_at = 12;
-
-            switch (iw.S.funct3) {
-                case FUNCT3_BEQ:
-                    rv.type = RVInstruction::Type::BEQ;
-                    break;
-                
-                case FUNCT3_BNE:
-                    rv.type = RVInstruction::Type::BNE;
-                    break;
-                
-                case FUNCT3_BLT:
-                    rv.type = RVInstruction::Type::BLT;
-                    break;
-                
-                case FUNCT3_BGE:
-                    rv.type = RVInstruction::Type::BGE;
-                    break;
-                
-                case FUNCT3_BLTU:
-                    rv.type = RVInstruction::Type::BLTU;
-                    break;
-                
-                case FUNCT3_BGEU:
-                    rv.type = RVInstruction::Type::BGEU;
-                    break;
-                
-                default:
-                    break;
-            }
+    Byte rd = (instr >> 7) & 0x1f;
+    Byte funct3 = (instr >> 12) & 0b111;
+    Byte rs1 = (instr >> 15) & 0x1f;
+    Byte rs2 = (instr >> 20) & 0x1f;
+
+    switch (desc.format) {
+        case Format::U:
+            rv.rd = rd;
+            rv.immediate = SignExtend(instr & 0xfffff000, 31);
             break;
         
-        case OP_LOAD:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_LB:
-                    rv.type = RVInstruction::Type::LB;
-                    break;
-                
-                case FUNCT3_LH:
-                    rv.type = RVInstruction::Type::LH;
-                    break;
-                
-                case FUNCT3_LW:
-                    rv.type = RVInstruction::Type::LW;
-                    break;
-                
-                case FUNCT3_LD:
-                    rv.type = RVInstruction::Type::LD;
-                    break;
-                
-                case FUNCT3_LBU:
-                    rv.type = RVInstruction::Type::LBU;
-                    break;
-                
-                case FUNCT3_LHU:
-                    rv.type = RVInstruction::Type::LHU;
-                    break;
-                
-                case FUNCT3_LWU:
-                    rv.type = RVInstruction::Type::LWU;
-                    break;
-                
-                default:
-                    break;
-            }
+        case Format::J: {
+            Word imm = ((instr >> 21) & 0x3ff) << 1;
+            imm |= ((instr >> 20) & 1) << 11;
+            imm |= ((instr >> 12) & 0xff) << 12;
+            imm |= (instr >> 31) << 20;
+
+            rv.rd = rd;
+            rv.immediate = SignExtend(imm, 20);
             break;
+        }
         
-        case OP_STORE:
-            rv.rs1 = iw.S.rs1;
-            rv.rs2 = iw.S.rs2;
-            rv.immediate = iw.S.imm0;
-            rv.immediate |= iw.S.imm1 << 5;
-            sign_extend_at = 11;
-
-            switch (iw.S.funct3) {
-                case FUNCT3_SB:
-                    rv.type = RVInstruction::Type::SB;
-                    break;
-                
-                case FUNCT3_SH:
-                    rv.type = RVInstruction::Type::SH;
-                    break;
-                
-                case FUNCT3_SW:
-                    rv.type = RVInstruction::Type::SW;
-                    break;
-                
-                case FUNCT3_SD:
-                    rv.type = RVInstruction::Type::SD;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+        case Format::ShiftImmediate:
+            rv.rs2 = rs2;
+            [[fallthrough]];
         
-        case OP_MATH_IMMEDIATE:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-            
-            switch (iw.I.funct3) {
-                case FUNCT3_ADDI:
-                    rv.type = RVInstruction::Type::ADDI;
-                    break;
-                
-                case FUNCT3_SLTI:
-                    rv.type = RVInstruction::Type::SLTI;
-                    break;
-                
-                case FUNCT3_SLTIU:
-                    rv.type = RVInstruction::Type::SLTIU;
-                    break;
-                
-                case FUNCT3_XORI:
-                    rv.type = RVInstruction::Type::XORI;
-                    break;
-                
-                case FUNCT3_ORI:
-                    rv.type = RVInstruction::Type::ORI;
-                    break;
-                
-                case FUNCT3_ANDI:
-                    rv.type = RVInstruction::Type::ANDI;
-                    break;
-                
-                case FUNCT3_SLLI:
-                    if ((rv.immediate >> 6) != 0) break;
-                    rv.type = RVInstruction::Type::SLLI;
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_IMMEDIATE:
-                    rv.rs2 = iw.R.rs2;
-                    switch (rv.immediate >> 6) {
-                        case FUNCT7_SRLI:
-                            rv.type = RVInstruction::Type::SRLI;
-                            break;
-                        
-                        case FUNCT7_SRAI:
-                            rv.type = RVInstruction::Type::SRAI;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                default:
-                    break;
-            }
+        case Format::I:
+            rv.rd = rd;
+            rv.rs1 = rs1;
+            rv.immediate = SignExtend(instr >> 20, 11);
             break;
         
-        case OP_MATH_W_IMMEDIATE:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_ADDI:
-                    rv.type = RVInstruction::Type::ADDIW;
-                    break;
-                
-                case FUNCT3_SLLI:
-                    if ((rv.immediate >> 5) != 0) break;
-                    rv.type = RVInstruction::Type::SLLIW;
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_IMMEDIATE:
-                    switch (rv.immediate >> 6) {
-                        case FUNCT7_SRLI:
-                            rv.type = RVInstruction::Type::SRLIW;
-                            break;
-                        
-                        case FUNCT7_SRAI:
-                            rv.type = RVInstruction::Type::SRAIW;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+        case Format::B: {
+            Word imm = ((instr >> 8) & 0xf) << 1;
+            imm |= ((instr >> 25) & 0x3f) << 5;
+            imm |= ((instr >> 7) & 1) << 11;
+            imm |= (instr >> 31) << 12;
 
-        case OP_MATH:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-            
-            switch (iw.R.funct3) {
-                case FUNCT3_ADD_SUB_MUL:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_ADD:
-                            rv.type = RVInstruction::Type::ADD;
-                            break;
-                        
-                        case FUNCT7_SUB:
-                            rv.type = RVInstruction::Type::SUB;
-                            break;
-                        
-                        case FUNCT7_MUL:
-                            rv.type = RVInstruction::Type::MUL;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLL_MULH:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SLL:
-                            rv.type = RVInstruction::Type::SLL;
-                            break;
-                        
-                        case FUNCT7_MULH:
-                            rv.type = RVInstruction::Type::MULH;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLT_MULHSU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SLT:
-                            rv.type = RVInstruction::Type::SLT;
-                            break;
-                        
-                        case FUNCT7_MULHSU:
-                            rv.type = RVInstruction::Type::MULHSU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLTU_MULHU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SLTU:
-                            rv.type = RVInstruction::Type::SLTU;
-                            break;
-                        
-                        case FUNCT7_MULHU:
-                            rv.type = RVInstruction::Type::MULHU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_XOR_DIV:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_XOR:
-                            rv.type = RVInstruction::Type::XOR;
-                            break;
-                        
-                        case FUNCT7_DIV:
-                            rv.type = RVInstruction::Type::DIV;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_DIVU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SRL:
-                            rv.type = RVInstruction::Type::SRL;
-                            break;
-                        
-                        case FUNCT7_SRA:
-                            rv.type = RVInstruction::Type::SRA;
-                            break;
-                        
-                        case FUNCT7_DIVU:
-                            rv.type = RVInstruction::Type::DIVU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_OR_REM:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_OR:
-                            rv.type = RVInstruction::Type::OR;
-                            break;
-                        
-                        case FUNCT7_REM:
-                            rv.type = RVInstruction::Type::REM;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_AND_REMU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_AND:
-                            rv.type = RVInstruction::Type::AND;
-                            break;
-                        
-                        case FUNCT7_REMU:
-                            rv.type = RVInstruction::Type::REMU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                default:
-                    break;
-            }
+            rv.rs1 = rs1;
+            rv.rs2 = rs2;
+            rv.immediate = SignExtend(imm, 12);
             break;
+        }
         
-        case OP_MATH_W:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-
-            switch (iw.R.funct3) {
-                case FUNCT3_ADD_SUB_MUL:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_ADD:
-                            rv.type = RVInstruction::Type::ADDW;
-                            break;
-                        
-                        case FUNCT7_SUB:
-                            rv.type = RVInstruction::Type::SUBW;
-                            break;
-                        
-                        case FUNCT7_MUL:
-                            rv.type = RVInstruction::Type::MULW;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLL_MULH:
-                    if (iw.R.funct7 != FUNCT7_SLL) break;
-                    rv.type = RVInstruction::Type::SLLW;
-                    break;
-                
-                case FUNCT3_SLT_MULHSU:
-                    break;
-                
-                case FUNCT3_SLTU_MULHU:
-                    if (iw.R.funct7 != FUNCT7_SLTU) break;
-                    rv.type = RVInstruction::Type::SLTU;
-                    break;
-                
-                case FUNCT3_XOR_DIV:
-                    if (iw.R.funct7 != FUNCT7_DIV) break;
-                    rv.type = RVInstruction::Type::DIVW;
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_DIVU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SRL:
-                            rv.type = RVInstruction::Type::SRLW;
-                            break;
-                        
-                        case FUNCT7_SRA:
-                            rv.type = RVInstruction::Type::SRAW;
-                            break;
-                        
-                        case FUNCT7_DIVU:
-                            rv.type = RVInstruction::Type::DIVUW;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_OR_REM:
-                    if (iw.R.funct7 != FUNCT7_REM) break;
-                    rv.type = RVInstruction::Type::REMW;
-                    break;
-                
-                case FUNCT3_AND_REMU:
-                    if (iw.R.funct7 != FUNCT7_REMU) break;
-                    rv.type = RVInstruction::Type::REMUW;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+        case Format::S: {
+            Word imm = (instr >> 7) & 0x1f;
+            imm |= (instr >> 25) << 5;
 
-        case OP_FENCE:
-            if (iw.I.funct3 != FUNCT3_FENCE) break;
-
-            rv.type = RVInstruction::Type::FENCE;
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-
-            break;
-        
-        case OP_SYSTEM:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_SYSTEM:
-                    if (iw.I.rd != RD_SYSTEM || iw.I.funct3 != FUNCT3_SYSTEM) break;
-
-                    switch (iw.I.imm) {
-                        case IMM_ECALL:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::ECALL;
-                            break;
-                        
-                        case IMM_EBREAK:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::EBREAK;
-                            break;
-                        
-                        case IMM_SRET:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::SRET;
-                            break;
-
-                        case IMM_MRET:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::MRET;
-                            break;
-                        
-                        case IMM_WFI:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::WFI;
-                            break;
-
-                        default:
-                            switch (iw.R.funct7) {
-                                case FUNCT7_SFENCE_VMA:
-                                    rv.type = RVInstruction::Type::SFENCE_VMA;
-                                    break;
-                                
-                                case FUNCT7_SINVAL_VMA:
-                                    rv.type = RVInstruction::Type::SINVAL_VMA;
-                                    break;
-                                
-                                case FUNCT7_SINVAL_GVMA:
-                                    rv.type = RVInstruction::Type::SINVAL_GVMA;
-                                    break;
-                                
-                                case FUNCT7_SFENCE_SINVAL:
-                                    if (iw.I.rs1 != RS1_SYSTEM) break;
-
-                                    switch (iw.R.rs2) {
-                                        case RS2_SFENCE_W_INVAL:
-                                            rv.type = RVInstruction::Type::SFENCE_W_INVAL;
-                                            break;
-                                        
-                                        case RS2_SFENCE_INVAL_IR:
-                                            rv.type = RVInstruction::Type::SFENCE_INVAL_IR;
-                                            break;
-                                        
-                                        default:
-                                            break;
-                                    }
-                                    break;
-                            }
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_CSRRW:
-                    rv.type = RVInstruction::Type::CSRRW;
-                    break;
-                
-                case FUNCT3_CSRRS:
-                    rv.type = RVInstruction::Type::CSRRS;
-                    break;
-                
-                case FUNCT3_CSRRC:
-                    rv.type = RVInstruction::Type::CSRRC;
-                    break;
-                
-                case FUNCT3_CSRRWI:
-                    rv.type = RVInstruction::Type::CSRRWI;
-                    break;
-                
-                case FUNCT3_CSRRSI:
-                    rv.type = RVInstruction::Type::CSRRSI;
-                    break;
-                
-                case FUNCT3_CSRRCI:
-                    rv.type = RVInstruction::Type::CSRRCI;
-                    break;
-                
-                default:
-                    break;
-            }
-
-            switch (iw.I.funct3) {
-                case FUNCT3_CSRRW:
-                case FUNCT3_CSRRS:
-                case FUNCT3_CSRRC:
-                case FUNCT3_CSRRWI:
-                case FUNCT3_CSRRSI:
-                case FUNCT3_CSRRCI:
-                    rv.rd = iw.I.rd;
-                    rv.rs1 = iw.I.rs1;
-                    rv.immediate = iw.I.imm;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-
-        case OP_ATOMIC:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-
-            switch (iw.R.funct3) {
-                case FUNCT3_ATOMIC:
-                    switch (iw.R.funct7 & FUNCT7_ATOMIC_MASK) {
-                        case FUNCT7_LR_W:
-                            if (iw.R.rs2 != RS2_LR_W) break;
-
-                            rv.type = RVInstruction::Type::LR_W;
-                            break;
-                        
-                        case FUNCT7_SC_W:
-                            rv.type = RVInstruction::Type::SC_W;
-                            break;
-                        
-                        case FUNCT7_AMOSWAP_W:
-                            rv.type = RVInstruction::Type::AMOSWAP_W;
-                            break;
-                        
-                        case FUNCT7_AMOADD_W:
-                            rv.type = RVInstruction::Type::AMOADD_W;
-                            break;
-                        
-                        case FUNCT7_AMOXOR_W:
-                            rv.type = RVInstruction::Type::AMOXOR_W;
-                            break;
-                        
-                        case FUNCT7_AMOAND_W:
-                            rv.type = RVInstruction::Type::AMOAND_W;
-                            break;
-                        
-                        case FUNCT7_AMOOR_W:
-                            rv.type = RVInstruction::Type::AMOOR_W;
-                            break;
-                        
-                        case FUNCT7_AMOMIN_W:
-                            rv.type = RVInstruction::Type::AMOMIN_W;
-                            break;
-                        
-                        case FUNCT7_AMOMAX_W:
-                            rv.type = RVInstruction::Type::AMOMAX_W;
-                            break;
-                        
-                        case FUNCT7_AMOMINU_W:
-                            rv.type = RVInstruction::Type::AMOMINU_W;
-                            break;
-                        
-                        case FUNCT7_AMOMAXU_W:
-                            rv.type = RVInstruction::Type::AMOMAXU_W;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-            }
+            rv.rs1 = rs1;
+            rv.rs2 = rs2;
+            rv.immediate = SignExtend(imm, 11);
             break;
+        }
         
-        case OP_FL:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_FLW:
-                    rv.type = RVInstruction::Type::FLW;
-                    break;
-                
-                case FUNCT3_FLD:
-                    rv.type = RVInstruction::Type::FLD;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+        case Format::R4:
+            rv.rs3 = instr >> 27;
+            [[fallthrough]];
         
-        case OP_FS:
-            rv.rs1 = iw.S.rs1;
-            rv.rs2 = iw.S.rs2;
-            rv.immediate = iw.S.imm0;
-            rv.immediate |= iw.S.imm1 << 5;
-            sign_extend_at = 11;
-
-            switch (iw.S.funct3) {
-                case FUNCT3_FSW:
-                    rv.type = RVInstruction::Type::FSW;
-                    break;
-                
-                case FUNCT3_FSD:
-                    rv.type = RVInstruction::Type::FSD;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+        case Format::RFloat:
+            rv.rm = funct3;
+            [[fallthrough]];
         
-        case OP_FMADD:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
-
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FMADD_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FMADD_D;
-                    break;
-                
-                default:
-                    break;
-            }
+        case Format::R:
+        case Format::System:
+            rv.rd = rd;
+            rv.rs1 = rs1;
+            rv.rs2 = rs2;
             break;
         
-        case OP_FMSUB:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
-
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FMSUB_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FMSUB_D;
-                    break;
-                
-                default:
-                    break;
-            }
+        case Format::Fence:
+            rv.rd = rd;
+            rv.rs1 = rs1;
             break;
         
-        case OP_FNMSUB:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
-
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FNMSUB_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FNMSUB_D;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_FNMADD:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
-
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FNMADD_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FNMADD_D;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_FLOAT:
-            rv.rd = iw.R.rd;
-            rv.rm = iw.R.funct3;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-            
-            switch (iw.R.funct7 >> 2) {
-                case FUNCT5_FADD:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FADD_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FADD_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FSUB:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FSUB_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FSUB_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FMUL:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FMUL_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FMUL_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FDIV:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FDIV_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FDIV_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FSQRT:
-                    if (rv.rs2 != RS2_FSQRT) break;
-
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FSQRT_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FSQRT_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FSGNJ:
-                    switch (iw.R.funct3) {
-                        case FUNCT3_FSGNJ:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FSGNJ_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FSGNJ_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FSGNJN:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FSGNJN_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FSGNJN_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FSGNJX:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FSGNJX_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FSGNJX_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FMIN_FMAX:
-                    switch (iw.R.funct3) {
-                        case FUNCT3_FMIN:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FMIN_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FMIN_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FMAX:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FMAX_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FMAX_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FCVT_W:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            switch (iw.R.rs2) {
-                                case RS2_FCVT_W:
-                                    rv.type = RVInstruction::Type::FCVT_W_S;
-                                    break;
-                                
-                                case RS2_FCVT_WU:
-                                    rv.type = RVInstruction::Type::FCVT_WU_S;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT2_D:
-                            switch (iw.R.rs2) {
-                                case RS2_FCVT_W:
-                                    rv.type = RVInstruction::Type::FCVT_W_D;
-                                    break;
-                                
-                                case RS2_FCVT_WU:
-                                    rv.type = RVInstruction::Type::FCVT_WU_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-
-                case FUNCT5_FCLASS_FMV_X_W:
-                    if (iw.R.rs2 == RS2_FMV_X_W && iw.R.funct3 == FUNCT3_FMV_X_W) {
-                        switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                            case FUNCT2_S:
-                                rv.type = RVInstruction::Type::FMV_X_W;
-                                break;
-                            
-                            case FUNCT2_D:
-                                rv.type = RVInstruction::Type::FMV_X_D;
-                                break;
-                            
-                            default:
-                                break;
-                        }
-                        break;
-                    }
-                    else if (iw.R.rs2 == RS2_FCLASS && iw.R.funct3 == FUNCT3_FCLASS) {
-                        switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                            case FUNCT2_S:
-                                rv.type = RVInstruction::Type::FCLASS_S;
-                                break;
-                            
-                            case FUNCT2_D:
-                                rv.type = RVInstruction::Type::FCLASS_D;
-                                break;
-                            
-                            default:
-                                break;
-                        }
-                        break;
-                    }
-                    break;
-                
-                case FUNCT5_FCOMPARE:
-                    switch (iw.R.funct3) {
-                        case FUNCT3_FEQ:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FEQ_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FEQ_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FLT:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FLT_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FLT_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FLE:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FLE_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FLE_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FCVT:
-                    switch (iw.R.rs2) {
-                        case RS2_FCVT_W:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_W;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_W;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case RS2_FCVT_WU:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_WU;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_WU;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case RS2_FCVT_L:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_L;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_L;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case RS2_FCVT_LU:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_LU;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_LU;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FMV_W_X:
-                    if (iw.R.rs2 != RS2_FMV_W_X || iw.R.funct3 != FUNCT3_FMV_W_X) break;
-                    rv.type = RVInstruction::Type::FMV_W_X;
-                    break;
-                
-                case FUNCT5_FCVT_D:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FCVT_L_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FCVT_L_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-            }
-            break;
-        
-        case OP_CUST:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-            rv.rd = iw.R.rd;
-            
-            switch (iw.R.funct7) {
-                case FUNCT7_CUST_TVA:
-                    rv.type = RVInstruction::Type::CUST_TVA;
-                    break;
-                
-                case FUNCT7_CUST_MTRAP:
-                    rv.type = RVInstruction::Type::CUST_MTRAP;
-                    break;
-                
-                case FUNCT7_CUST_STRAP:
-                    rv.type = RVInstruction::Type::CUST_STRAP;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-
-        default:
+        case Format::CSR:
+            rv.rd = rd;
+            rv.rs1 = rs1;
+            rv.rs2 = rs2;
+            rv.immediate = instr >> 20;
             break;
     }
 
-    if (sign_extend_at > 0) {
-        Long sign = -1ULL << sign_extend_at;
-        if (rv.immediate & (1ULL << sign_extend_at)) rv.immediate |= sign;
+    return rv;
+}
+
+}
+
+RVInstruction RVInstruction::FromUInt32(Word instr) {
+    const DecodeEntry* entry = &DECODE_TABLE.entries[(instr & MASK_OPCODE) | ((instr & MASK_FUNCT3) >> 5)];
+
+    if (entry->is_group)
+        entry = &DECODE_TABLE.entries[FIRST_LEVEL_SIZE + entry->rest * GROUP_SIZE + (instr >> 25)];
+
+    if ((instr & entry->first.mask) == entry->first.match)
+        return Extract(entry->first, instr);
+
+    for (Byte i = 0; i < entry->rest_count; i++) {
+        const auto& desc = DECODE_TABLE.candidates[entry->rest + i];
+
+        if ((instr & desc.mask) == desc.match)
+            return Extract(desc, instr);
     }
 
+    RVInstruction rv;
+    rv.type = Type::INVALID;
+    rv.immediate = 0;
+    rv.rd = 0;
+    rv.rs1 = 0;
+    rv.rs2 = 0;
+    rv.rm = 0;
+    rv.rs3 = 0;
     return rv;
-}
\ No newline at end of file
+}
@@ -0,0 +1,157 @@
+#include "Scheduler.hpp"
+#include "VirtualMachine.hpp"
+
+#include <thread>
+
+Scheduler::Scheduler(const std::vector<VirtualMachine*>& harts, size_t workers, Long time_slice) : harts{harts}, states{std::make_unique<std::atomic<HartState>[]>(harts.size())}, pending{std::make_unique<std::atomic<bool>[]>(harts.size())}, time_slice{time_slice} {
+    if (workers == 0)
+        throw std::runtime_error("A scheduler needs at least one worker");
+
+    for (size_t i = 0; i < workers; i++)
+        queues.push_back(std::make_unique<WorkerQueue>());
+
+    for (size_t hart = 0; hart < harts.size(); hart++) {
+        states[hart] = HartState::Parked;
+        pending[hart] = false;
+
+        harts[hart]->SetWakeHandler([this, hart]() { Unpark(hart); });
+    }
+}
+
+Scheduler::~Scheduler() {
+    for (auto vm : harts)
+        vm->SetWakeHandler(nullptr);
+}
+
+void Scheduler::Enqueue(size_t hart, size_t queue) {
+    {
+        std::lock_guard<std::mutex> guard(queues[queue]->lock);
+        queues[queue]->harts.push_back(hart);
+        queued++;
+    }
+
+    { std::lock_guard<std::mutex> guard(idle_lock); }
+    idle_condition.notify_one();
+}
+
+// Takes from the front of the own queue, steals from the back of the others
+bool Scheduler::Dequeue(size_t worker, size_t& hart) {
+    for (size_t i = 0; i < queues.size(); i++) {
+        auto& queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+
+        if (queue.harts.empty())
+            continue;
+
+        if (i == 0) {
+            hart = queue.harts.front();
+            queue.harts.pop_front();
+        }
+        else {
+            hart = queue.harts.back();
+            queue.harts.pop_back();
+        }
+
+        queued--;
+        return true;
+    }
+
+    return false;
+}
+
+// A wake that arrives while the hart is still running is remembered in
+// pending and picked up when the worker parks it
+void Scheduler::Unpark(size_t hart) {
+    pending[hart] = true;
+
+    auto expected = HartState::Parked;
+    if (states[hart].compare_exchange_strong(expected, HartState::Queued))
+        Enqueue(hart, next_queue++ % queues.size());
+}
+
+void Scheduler::Park(size_t hart, size_t worker) {
+    states[hart] = HartState::Parked;
+
+    if (pending[hart].exchange(false)) {
+        auto expected = HartState::Parked;
+        if (states[hart].compare_exchange_strong(expected, HartState::Queued))
+            Enqueue(hart, worker);
+    }
+
+    CheckFinished();
+}
+
+void Scheduler::CheckFinished() {
+    for (auto vm : harts)
+        if (vm->IsRunning())
+            return;
+
+    finished = true;
+
+    { std::lock_guard<std::mutex> guard(idle_lock); }
+    idle_condition.notify_all();
+}
+
+void Scheduler::StopAll() {
+    for (auto vm : harts)
+        vm->Stop();
+}
+
+void Scheduler::Work(size_t worker, Long max_cycles) {
+    while (!finished) {
+        size_t hart;
+
+        if (!Dequeue(worker, hart)) {
+            std::unique_lock<std::mutex> guard(idle_lock);
+            idle_condition.wait(guard, [this]() { return queued != 0 || finished; });
+            continue;
+        }
+
+        auto vm = harts[hart];
+
+        states[hart] = HartState::Running;
+        pending[hart] = false;
+
+        bool runnable = false;
+
+        try {
+            runnable = vm->RunFor(time_slice);
+
+            if (vm->GetCycles() >= max_cycles)
+                StopAll();
+        }
+        catch (...) {
+            {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            StopAll();
+        }
+
+        if (runnable && vm->IsRunning()) {
+            states[hart] = HartState::Queued;
+            Enqueue(hart, worker);
+        }
+        else
+            Park(hart, worker);
+    }
+}
+
+void Scheduler::Run(Long max_cycles) {
+    CheckFinished();
+
+    // Harts that cannot run yet park again right away
+    for (size_t hart = 0; hart < harts.size(); hart++)
+        Unpark(hart);
+
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 0; i < queues.size(); i++)
+            workers.emplace_back([this, max_cycles](size_t worker) { Work(worker, max_cycles); }, i);
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
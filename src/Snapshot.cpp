@@ -0,0 +1,147 @@
+#include "Snapshot.hpp"
+#include "Timer.hpp"
+
+#include <fstream>
+#include <format>
+#include <stdexcept>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<VirtualMachine::HartState>);
+
+namespace {
+
+template <typename Type>
+void WriteValue(std::ofstream& file, const Type& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(Type));
+}
+
+template <typename Type>
+Type ReadValue(std::ifstream& file) {
+    Type value;
+    file.read(reinterpret_cast<char*>(&value), sizeof(Type));
+
+    if (!file)
+        throw std::runtime_error("Snapshot file ends early");
+
+    return value;
+}
+
+}
+
+Snapshot Snapshot::Capture(Memory& memory, const std::vector<VirtualMachine*>& harts) {
+    Snapshot snapshot;
+
+    for (auto vm : harts) {
+        auto& state = snapshot.harts.emplace_back();
+        vm->SaveState(state);
+    }
+
+    auto timer = Timer::Get(memory);
+    snapshot.time = timer->Time();
+
+    for (auto& state : snapshot.harts)
+        snapshot.compares.push_back(timer->GetCompare(state.csrs[VirtualMachine::CSR_MHARTID]));
+
+    snapshot.memory_image = memory.CaptureImage();
+
+    return snapshot;
+}
+
+void Snapshot::Restore(Memory& memory, const std::vector<VirtualMachine*>& harts) const {
+    if (harts.size() != this->harts.size())
+        throw std::runtime_error(std::format("Snapshot holds {} harts, cannot restore into {}", this->harts.size(), harts.size()));
+
+    memory.RestoreImage(memory_image);
+
+    for (size_t i = 0; i < harts.size(); i++)
+        harts[i]->RestoreState(this->harts[i]);
+
+    // Restored after the harts, so their pending timer interrupt follows
+    // mtimecmp
+    auto timer = Timer::Get(memory);
+    timer->SetTime(time);
+
+    for (size_t i = 0; i < harts.size(); i++)
+        timer->SetCompare(this->harts[i].csrs[VirtualMachine::CSR_MHARTID], compares[i]);
+}
+
+// Pages of zeros are left out, each stored page is preceded by its offset
+void Snapshot::Save(const std::string& path) const {
+    std::ofstream file(path, std::ios_base::binary);
+
+    if (!file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+
+    WriteValue(file, MAGIC);
+    WriteValue(file, VERSION);
+
+    WriteValue<Long>(file, harts.size());
+    for (size_t i = 0; i < harts.size(); i++) {
+        WriteValue(file, harts[i]);
+        WriteValue(file, compares[i]);
+    }
+
+    WriteValue(file, time);
+
+    WriteValue<Long>(file, memory_image.size());
+    for (auto& region : memory_image) {
+        WriteValue(file, region.base);
+        WriteValue(file, region.size);
+
+        WriteValue<Long>(file, region.pages.size());
+
+        for (auto& [offset, page] : region.pages) {
+            WriteValue(file, offset);
+            WriteValue(file, *page);
+        }
+    }
+
+    if (!file)
+        throw std::runtime_error(std::format("Could not write the snapshot to {}", path));
+}
+
+Snapshot Snapshot::Load(const std::string& path) {
+    std::ifstream file(path, std::ios_base::binary);
+
+    if (!file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for reading", path));
+
+    if (ReadValue<Long>(file) != MAGIC)
+        throw std::runtime_error(std::format("{} is not a snapshot", path));
+
+    auto version = ReadValue<Long>(file);
+    if (version != VERSION)
+        throw std::runtime_error(std::format("Snapshot {} has version {}, expected {}", path, version, VERSION));
+
+    Snapshot snapshot;
+
+    auto hart_count = ReadValue<Long>(file);
+    if (hart_count > Memory::MAX_HARTS)
+        throw std::runtime_error(std::format("Snapshot {} holds {} harts", path, hart_count));
+
+    for (Long i = 0; i < hart_count; i++) {
+        snapshot.harts.push_back(ReadValue<VirtualMachine::HartState>(file));
+        snapshot.compares.push_back(ReadValue<Long>(file));
+    }
+
+    snapshot.time = ReadValue<Long>(file);
+
+    auto region_count = ReadValue<Long>(file);
+    for (Long i = 0; i < region_count; i++) {
+        auto& region = snapshot.memory_image.emplace_back();
+
+        region.base = ReadValue<Address>(file);
+        region.size = ReadValue<Address>(file);
+
+        auto stored = ReadValue<Long>(file);
+        for (Long j = 0; j < stored; j++) {
+            auto offset = ReadValue<Address>(file);
+            if (offset >= region.size || (offset & (Memory::PAGE_SIZE - 1)))
+                throw std::runtime_error(std::format("Snapshot {} has a page at {:#x} outside of the region at {:#x}", path, offset, region.base));
+
+            region.pages[offset] = std::make_shared<const std::array<Byte, Memory::PAGE_SIZE>>(ReadValue<std::array<Byte, Memory::PAGE_SIZE>>(file));
+        }
+    }
+
+    return snapshot;
+}
@@ -0,0 +1,226 @@
+#include "Timer.hpp"
+#include "VirtualMachine.hpp"
+
+std::shared_ptr<Timer> Timer::Get(Memory& memory) {
+    auto region = memory.GetSharedRegion(BASE);
+
+    if (region && region->type == TYPE_MAPPED_CSRS && region->base == BASE)
+        return std::static_pointer_cast<Timer>(region);
+
+    auto timer = std::shared_ptr<Timer>(new Timer());
+    memory.AddMemoryRegion(timer);
+
+    return timer;
+}
+
+void Timer::Attach(Hart hart, VirtualMachine* vm) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!harts[hart])
+        attached++;
+
+    harts[hart] = vm;
+    SetIdle(hart, vm->IsIdle());
+}
+
+void Timer::Detach(Hart hart, VirtualMachine* vm) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // A moved hart has already attached its new instance
+    if (harts[hart] != vm)
+        return;
+
+    SetIdle(hart, false);
+
+    harts[hart] = nullptr;
+    attached--;
+}
+
+void Timer::UpdateIdle(Hart hart) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Read under the lock, so the last update always sees the latest state
+    if (harts[hart])
+        SetIdle(hart, harts[hart]->IsIdle());
+}
+
+void Timer::SetIdle(Hart hart, bool is_idle) {
+    if (idle[hart] == is_idle)
+        return;
+
+    idle[hart] = is_idle;
+
+    if (is_idle) idle_count++;
+    else idle_count--;
+}
+
+Long Timer::CurrentTime() const {
+    if (source == Source::Instructions)
+        return offset + retired;
+
+    return offset + std::chrono::duration_cast<Ticks>(Clock::now() - start).count();
+}
+
+Long Timer::Time() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return CurrentTime();
+}
+
+void Timer::SetSource(Source source) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Time stays continuous across the switch
+    SwitchSource(source, CurrentTime());
+}
+
+void Timer::SetSource(Source source, Long time) {
+    std::lock_guard<std::mutex> guard(lock);
+    SwitchSource(source, time);
+}
+
+void Timer::SwitchSource(Source source, Long time) {
+    offset = time;
+    start = Clock::now();
+    retired = 0;
+
+    this->source = source;
+
+    for (Hart hart = 0; hart < Memory::MAX_HARTS; hart++)
+        Schedule(hart, offset);
+}
+
+void Timer::SetTime(Long time) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    offset = time;
+    start = Clock::now();
+    retired = 0;
+
+    // Harts whose mtimecmp is now ahead of mtime stop being interrupted
+    for (Hart hart = 0; hart < Memory::MAX_HARTS; hart++)
+        Schedule(hart, time);
+}
+
+Long Timer::GetCompare(Hart hart) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return compare[hart];
+}
+
+void Timer::SetCompare(Hart hart, Long value) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    compare[hart] = value;
+    Schedule(hart, CurrentTime());
+}
+
+// The timer interrupt stays pending for as long as mtime >= mtimecmp
+void Timer::Schedule(Hart hart, Long time) {
+    auto vm = harts[hart];
+    auto value = compare[hart];
+
+    if (value <= time) {
+        if (vm)
+            vm->RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_TIMER);
+
+        return;
+    }
+
+    if (vm)
+        vm->ClearInterrupt(VirtualMachine::INTERRUPT_MACHINE_TIMER);
+
+    if (value == NO_DEADLINE)
+        return;
+
+    deadlines.emplace(value, hart);
+    next_deadline = deadlines.top().first;
+
+    if (source == Source::HostClock && !worker.joinable())
+        worker = std::jthread([this](std::stop_token stop) { Work(stop); });
+
+    changed = true;
+    deadline_changed.notify_all();
+}
+
+void Timer::RaiseExpired(Long time) {
+    while (!deadlines.empty() && deadlines.top().first <= time) {
+        auto [value, hart] = deadlines.top();
+        deadlines.pop();
+
+        if (compare[hart] == value && harts[hart])
+            harts[hart]->RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_TIMER);
+    }
+
+    next_deadline = deadlines.empty() ? NO_DEADLINE : deadlines.top().first;
+}
+
+void Timer::Retire(Long instructions) {
+    retired += instructions;
+
+    if (offset + retired < next_deadline)
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    RaiseExpired(CurrentTime());
+}
+
+void Timer::SkipToDeadline() {
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (source != Source::Instructions || deadlines.empty() || idle_count != attached)
+        return;
+
+    auto time = CurrentTime();
+    auto deadline = deadlines.top().first;
+
+    if (deadline > time)
+        retired += deadline - time;
+
+    RaiseExpired(CurrentTime());
+}
+
+void Timer::Work(std::stop_token stop) {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (!stop.stop_requested()) {
+        auto wake_at = Clock::now() + MAX_WAIT;
+
+        if (source == Source::HostClock) {
+            RaiseExpired(CurrentTime());
+
+            if (!deadlines.empty()) {
+                auto remaining = deadlines.top().first - CurrentTime();
+                if (remaining < static_cast<Long>(MAX_WAIT.count()))
+                    wake_at = Clock::now() + std::chrono::ceil<Clock::duration>(Ticks(remaining));
+            }
+        }
+
+        changed = false;
+        deadline_changed.wait_until(guard, stop, wake_at, [this]() { return changed; });
+    }
+}
+
+Long Timer::ReadLong(Address address) const {
+    address &= ~7;
+
+    if (address == MTIME_OFFSET)
+        return Time();
+
+    auto hart = (address - MTIMECMP_OFFSET) / sizeof(Long);
+    if (hart < Memory::MAX_HARTS)
+        return GetCompare(hart);
+
+    return 0;
+}
+
+void Timer::WriteLong(Address address, Long value) {
+    address &= ~7;
+
+    if (address == MTIME_OFFSET) {
+        SetTime(value);
+        return;
+    }
+
+    auto hart = (address - MTIMECMP_OFFSET) / sizeof(Long);
+    if (hart < Memory::MAX_HARTS)
+        SetCompare(hart, value);
+}
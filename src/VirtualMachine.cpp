@@ -3,19 +3,14 @@
 #include "RV64.hpp"
 
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 #include <format>
 #include <cassert>
 #include <stdexcept>
 #include <cmath>
-#include <chrono>
 #include <fenv.h>
 
-#if defined(_WIN32) || defined(_WIN64)
-#include <windows.h>
-#else
-#include <sched.h>
-#endif
-
 std::string VirtualMachine::VMException::dump() const {
     std::array<std::string, REGISTER_COUNT> names = {
         "zero",
@@ -184,255 +179,312 @@ std::string VirtualMachine::VMException::dump() const {
 }
 
 const int VirtualMachine::default_rounding_mode = fegetround();
+thread_local int VirtualMachine::host_rounding_mode = -1;
 
-bool VirtualMachine::CSRPrivilegeCheck(Long csr) {
-    if (csr < 4 || (csr >= 0xc00 && csr < 0xcf0))
-        return true;
-    
-    if ((csr >= 0x100 && csr < 0x144) || csr == 0x180)
-        return privilege_level != PrivilegeLevel::User;
-    
-    return privilege_level == PrivilegeLevel::Machine;
-}
+namespace {
 
-Long VirtualMachine::ReadCSR(Long csr, bool is_internal_read) {
-    if (!is_internal_read && !CSRPrivilegeCheck(csr)) {
-        RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-        return 0;
-    }
-    
-    if (csr >= CSR_MHPMEVENT3 && csr < (CSR_MHPMEVENT3 + CSR_PERFORMANCE_EVENT_MAX - 3))
-        return 0;
-    
-    if (csr >= CSR_MHPMCOUNTER3 && csr < (CSR_MHPMCOUNTER3 + CSR_PERF_COUNTER_MAX - 3))
-        return 0;
+constexpr std::array<int, 8> HOST_ROUNDING_MODES = {FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD, -1, -1, -1, -1};
 
-    switch (csr) {
-        case CSR_FFLAGS:
-            return csrs[CSR_FCSR] & CSR_FCSR_FLAGS;
-        
-        case CSR_FRM:
-            return csrs[CSR_FCSR] >> 5;
+}
 
-        case CSR_MCYCLE:
-        case CSR_CYCLE:
-            return static_cast<Long>(cycles);
-        
-        case CSR_TIME:
-            return static_cast<Long>(csr_mapped_memory->time);
+constexpr std::array<VirtualMachine::CSRHandler, VirtualMachine::CSR_COUNT> VirtualMachine::BuildCSRHandlers() {
+    std::array<CSRHandler, CSR_COUNT> handlers{};
 
-        case CSR_MSTATUS:
-            mstatus.SD = mstatus.FS == FS_DIRTY;
-            return mstatus.raw;
+    constexpr Byte ALL = PrivilegeBit(PrivilegeLevel::Machine) | PrivilegeBit(PrivilegeLevel::Supervisor) | PrivilegeBit(PrivilegeLevel::User);
+    constexpr Byte SUPERVISOR = PrivilegeBit(PrivilegeLevel::Machine) | PrivilegeBit(PrivilegeLevel::Supervisor);
+    constexpr Byte MACHINE = PrivilegeBit(PrivilegeLevel::Machine);
 
-        case CSR_SSTATUS:
-            sstatus.SD = sstatus.FS == FS_DIRTY;
-            return sstatus.raw;
-        
-        case CSR_MIP:
-            return mip;
-        
-        case CSR_MIE:
-            return mie;
-        
-        case CSR_MIDELEG:
-            return mideleg;
+    for (Long csr = 0; csr < CSR_COUNT; csr++) {
+        if (csr < 4 || (csr >= 0xc00 && csr < 0xcf0))
+            handlers[csr].privileges = ALL;
         
-        case CSR_SIP:
-            return sip;
+        else if ((csr >= 0x100 && csr < 0x144) || csr == 0x180)
+            handlers[csr].privileges = SUPERVISOR;
         
-        case CSR_SIE:
-            return sie;
+        else
+            handlers[csr].privileges = MACHINE;
+    }
 
-        case CSR_MCOUNTEREN:
-        case CSR_MCOUNTINHIBIT:
-            return 0;
-        
-        case CSR_MENVCFG:
-            return 0;
-        
-        case CSR_SENVCFG:
-            return 0;
-        
-        case CSR_SATP:
-            return satp.raw;
+    auto read_stored = [](VirtualMachine& vm, Long csr) { return vm.csrs[csr]; };
+    auto write_stored = [](VirtualMachine& vm, Long csr, Long value) { vm.csrs[csr] = value; };
+    auto read_zero = [](VirtualMachine&, Long) { return Long{0}; };
+    auto write_ignored = [](VirtualMachine&, Long, Long) {};
 
-        default:
-            if (!csrs.contains(csr)) {
-                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                return 0;
-            }
+    auto stored = [&](Half csr) {
+        handlers[csr].read = read_stored;
+        handlers[csr].write = write_stored;
+        handlers[csr].stored = true;
+    };
 
-            return csrs[csr];
-    }
+    auto read_only = [&](Half csr) {
+        handlers[csr].read = read_stored;
+        handlers[csr].write = write_ignored;
+        handlers[csr].stored = true;
+    };
 
-    return csrs[csr];
-}
+    // User
 
-void VirtualMachine::WriteCSR(Long csr, Long value) {
-    if (!CSRPrivilegeCheck(csr)) {
-        RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-        return;
+    stored(CSR_FCSR);
+    stored(CSR_INSTRET);
+
+    // Flags raised by the host since the last fold are pending until read or
+    // replaced
+    handlers[CSR_FCSR].read = [](VirtualMachine& vm, Long) {
+        vm.AccrueFloatFlags();
+        return vm.csrs[CSR_FCSR];
+    };
+    handlers[CSR_FCSR].write = [](VirtualMachine& vm, Long, Long value) {
+        vm.AccrueFloatFlags();
+        vm.csrs[CSR_FCSR] = value;
+        vm.UpdateDynamicRoundingMode();
+    };
+
+    handlers[CSR_FFLAGS].read = [](VirtualMachine& vm, Long) {
+        vm.AccrueFloatFlags();
+        return vm.csrs[CSR_FCSR] & CSR_FCSR_FLAGS;
+    };
+    handlers[CSR_FFLAGS].write = [](VirtualMachine& vm, Long, Long value) {
+        vm.AccrueFloatFlags();
+        auto last = vm.csrs[CSR_FCSR];
+        last &= ~CSR_FCSR_FLAGS;
+        last |= value & CSR_FCSR_FLAGS;
+        vm.csrs[CSR_FCSR] = last;
+    };
+
+    handlers[CSR_FRM].read = [](VirtualMachine& vm, Long) { return vm.csrs[CSR_FCSR] >> 5; };
+    handlers[CSR_FRM].write = [](VirtualMachine& vm, Long, Long value) {
+        auto last = vm.csrs[CSR_FCSR];
+        last &= ~(0b111 << 5);
+        last |= (value & 0b111) << 5;
+        vm.csrs[CSR_FCSR] = last;
+        vm.UpdateDynamicRoundingMode();
+    };
+
+    for (auto csr : {CSR_CYCLE, CSR_MCYCLE}) {
+        handlers[csr].read = [](VirtualMachine& vm, Long) { return static_cast<Long>(vm.cycles); };
+        handlers[csr].write = write_ignored;
     }
+
+    handlers[CSR_TIME].read = [](VirtualMachine& vm, Long) { return vm.timer->Time(); };
+    handlers[CSR_TIME].write = write_ignored;
+
+    for (Long csr = CSR_MHPMEVENT3; csr < (CSR_MHPMEVENT3 + CSR_PERFORMANCE_EVENT_MAX - 3); csr++)
+        handlers[csr].read = read_zero;
     
-    switch (csr) {
-        case CSR_MVENDORID:
-        case CSR_MARCHID:
-        case CSR_MIMPID:
-        case CSR_MHARTID:
-        case CSR_MISA:
-        case CSR_MINSTRET:
-        case CSR_CYCLE:
-        case CSR_TIME:
-        case CSR_MCOUNTEREN:
-        case CSR_MCOUNTINHIBIT:
-        case CSR_MENVCFG:
-        case CSR_SENVCFG:
-            return; // Non writable
-        
-        case CSR_FFLAGS: {
-            auto last = csrs[CSR_FCSR];
-            last &= ~CSR_FCSR_FLAGS;
-            last |= value & CSR_FCSR_FLAGS;
-            csrs[CSR_FCSR] = last;
-            break;
-        }
+    for (Long csr = CSR_MHPMCOUNTER3; csr < (CSR_MHPMCOUNTER3 + CSR_PERF_COUNTER_MAX - 3); csr++)
+        handlers[csr].read = read_zero;
 
-        case CSR_FRM: {
-            auto last = csrs[CSR_FCSR];
-            last &= ~(0b111 << 5);
-            last |= (value & 0b111) << 5;
-            csrs[CSR_FCSR] = last;
-            break;
-        }
+    // Supervisor
 
-        case CSR_MSTATUS: {
-            auto last = mstatus.MPP;
-            mstatus.raw &= ~MSTATUS_WRITABLE_BITS;
-            value &= MSTATUS_WRITABLE_BITS;
-            mstatus.raw |= value;
+    for (auto csr : {CSR_STVEC, CSR_SSCRATCH, CSR_SEPC, CSR_SCAUSE, CSR_STVAL})
+        stored(csr);
 
-            if (mstatus.MPP == 0b10)
-                mstatus.MPP = last;
-            
-            break;
-        }
+    handlers[CSR_SSTATUS].read = [](VirtualMachine& vm, Long) {
+        vm.sstatus.SD = vm.sstatus.FS == FS_DIRTY;
+        return static_cast<Long>(vm.sstatus.raw);
+    };
+    handlers[CSR_SSTATUS].write = [](VirtualMachine& vm, Long, Long value) {
+        vm.sstatus.raw &= ~SSTATUS_WRITABLE_BITS;
+        vm.sstatus.raw |= value & SSTATUS_WRITABLE_BITS;
+    };
 
-        case CSR_SSTATUS: {
-            sstatus.raw &= ~SSTATUS_WRITABLE_BITS;
-            value &= SSTATUS_WRITABLE_BITS;
-            sstatus.raw |= value;
-            break;
-        }
+    handlers[CSR_SIP].read = [](VirtualMachine& vm, Long) { return vm.sip; };
+    handlers[CSR_SIP].write = [](VirtualMachine& vm, Long, Long value) { vm.sip = value & VALID_INTERRUPT_BITS; };
 
-        case CSR_MIP:
-            mip = value & VALID_INTERRUPT_BITS;
-            break;
-        
-        case CSR_MIE:
-            mie = value & VALID_INTERRUPT_BITS;
-            break;
-        
-        case CSR_MIDELEG:
-            mideleg = value & VALID_INTERRUPT_BITS;
-            break;
-        
-        case CSR_SIP:
-            sip = value & VALID_INTERRUPT_BITS;
-            break;
-        
-        case CSR_SIE:
-            sie = value & VALID_INTERRUPT_BITS;
-            break;
+    handlers[CSR_SIE].read = [](VirtualMachine& vm, Long) { return vm.sie; };
+    handlers[CSR_SIE].write = [](VirtualMachine& vm, Long, Long value) { vm.sie = value & VALID_INTERRUPT_BITS; };
 
-        case CSR_SATP:
-            satp.raw = value;
-            break;
+    handlers[CSR_SATP].read = [](VirtualMachine& vm, Long) { return static_cast<Long>(vm.satp.raw); };
+    handlers[CSR_SATP].write = [](VirtualMachine& vm, Long, Long value) {
+        SATP satp;
+        satp.raw = value;
 
-        default:
-            if (!csrs.contains(csr)) {
-                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                return;
-            }
+        // Writes selecting an unsupported mode have no effect
+        if (satp.MODE != SATP_MODE_BARE && satp.MODE != SATP_MODE_SV39 && satp.MODE != SATP_MODE_SV48)
+            return;
 
-            csrs[csr] = value;
-            break;
+        vm.satp = satp;
+        vm.block_epoch++;
+    };
+
+    handlers[CSR_SENVCFG].read = read_zero;
+    handlers[CSR_SENVCFG].write = write_ignored;
+
+    // Machine
+
+    for (auto csr : {CSR_MVENDORID, CSR_MARCHID, CSR_MIMPID, CSR_MHARTID, CSR_MISA, CSR_MINSTRET})
+        read_only(csr);
+
+    for (auto csr : {CSR_MEDELEG, CSR_MTVEC, CSR_MSCRATCH, CSR_MEPC, CSR_MCAUSE, CSR_MTVAL, CSR_MCONFIGPTR})
+        stored(csr);
+
+    handlers[CSR_MSTATUS].read = [](VirtualMachine& vm, Long) {
+        vm.mstatus.SD = vm.mstatus.FS == FS_DIRTY;
+        return static_cast<Long>(vm.mstatus.raw);
+    };
+    handlers[CSR_MSTATUS].write = [](VirtualMachine& vm, Long, Long value) {
+        auto last = vm.mstatus.MPP;
+        vm.mstatus.raw &= ~MSTATUS_WRITABLE_BITS;
+        vm.mstatus.raw |= value & MSTATUS_WRITABLE_BITS;
+
+        if (vm.mstatus.MPP == 0b10)
+            vm.mstatus.MPP = last;
+    };
+
+    handlers[CSR_MIP].read = [](VirtualMachine& vm, Long) { return vm.mip.load(); };
+    handlers[CSR_MIP].write = [](VirtualMachine& vm, Long, Long value) {
+        // The timer may raise MTIP in between, so the read only bits are
+        // never written back
+        value &= VALID_INTERRUPT_BITS & ~MIP_READ_ONLY_BITS;
+
+        vm.mip.fetch_and(value | MIP_READ_ONLY_BITS);
+        vm.mip.fetch_or(value);
+    };
+
+    handlers[CSR_MIE].read = [](VirtualMachine& vm, Long) { return vm.mie; };
+    handlers[CSR_MIE].write = [](VirtualMachine& vm, Long, Long value) { vm.mie = value & VALID_INTERRUPT_BITS; };
+
+    handlers[CSR_MIDELEG].read = [](VirtualMachine& vm, Long) { return vm.mideleg; };
+    handlers[CSR_MIDELEG].write = [](VirtualMachine& vm, Long, Long value) { vm.mideleg = value & VALID_INTERRUPT_BITS; };
+
+    for (auto csr : {CSR_MCOUNTEREN, CSR_MCOUNTINHIBIT, CSR_MENVCFG}) {
+        handlers[csr].read = read_zero;
+        handlers[csr].write = write_ignored;
+    }
+
+    return handlers;
+}
+
+constinit const std::array<VirtualMachine::CSRHandler, VirtualMachine::CSR_COUNT> VirtualMachine::csr_handlers = BuildCSRHandlers();
+
+Long VirtualMachine::ReadCSR(Long csr, bool is_internal_read) {
+    const auto& handler = csr_handlers[csr & (CSR_COUNT - 1)];
+
+    if (!handler.read || (!is_internal_read && !(handler.privileges & PrivilegeBit(privilege_level)))) {
+        RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+        return 0;
+    }
+
+    return handler.read(*this, csr & (CSR_COUNT - 1));
+}
+
+void VirtualMachine::WriteCSR(Long csr, Long value) {
+    const auto& handler = csr_handlers[csr & (CSR_COUNT - 1)];
+
+    if (!handler.write || !(handler.privileges & PrivilegeBit(privilege_level))) {
+        RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+        return;
     }
+
+    handler.write(*this, csr & (CSR_COUNT - 1), value);
+}
+
+void VirtualMachine::UpdateDynamicRoundingMode() {
+    dynamic_rounding_mode = HOST_ROUNDING_MODES[(csrs[CSR_FCSR] >> 5) & 0b111];
 }
 
 bool VirtualMachine::ChangeRoundingMode(Byte rm) {
-    switch (rm) {
-        case RVInstruction::RM_ROUND_TO_NEAREST_TIES_EVEN:
-            fesetround(FE_TONEAREST);
-            break;
-        
-        case RVInstruction::RM_ROUND_TO_ZERO:
-            fesetround(FE_TOWARDZERO);
-            break;
-        
-        case RVInstruction::RM_ROUND_DOWN:
-            fesetround(FE_DOWNWARD);
-            break;
-        
-        case RVInstruction::RM_ROUND_UP:
-            fesetround(FE_UPWARD);
-            break;
-        
-        case RVInstruction::RM_ROUND_TO_NEAREST_TIES_MAX_MAGNITUDE:
-        case RVInstruction::RM_INVALID0:
-        case RVInstruction::RM_INVALID1:
-            return false;
-        
-        case RVInstruction::RM_DYNAMIC:
-            return ChangeRoundingMode((csrs[CSR_FCSR] >> 5) & 0b111);
-        
-        default:
-            fesetround(default_rounding_mode);
-            break;
+    int mode;
+
+    if (rm == RVInstruction::RM_DYNAMIC)
+        mode = dynamic_rounding_mode;
+    
+    else if (rm < HOST_ROUNDING_MODES.size())
+        mode = HOST_ROUNDING_MODES[rm];
+    
+    else
+        mode = default_rounding_mode;
+
+    if (mode < 0)
+        return false;
+
+    // fesetround serializes the host FP pipeline, only call it on a change
+    if (mode != host_rounding_mode) {
+        fesetround(mode);
+        host_rounding_mode = mode;
     }
 
     return true;
 }
 
-bool VirtualMachine::CheckFloatErrors() {
-    fexcept_t except;
-    fegetexceptflag(&except, FE_ALL_EXCEPT);
+void VirtualMachine::AccrueFloatFlags() {
+    auto raised = fetestexcept(FE_ALL_EXCEPT);
+    if (!raised)
+        return;
+    
+    feclearexcept(FE_ALL_EXCEPT);
 
-    csrs[CSR_FCSR] &= ~CSR_FCSR_FLAGS;
+    if (raised & FE_DIVBYZERO) csrs[CSR_FCSR] |= CSR_FCSR_DZ;
+    if (raised & FE_INEXACT) csrs[CSR_FCSR] |= CSR_FCSR_NX;
+    if (raised & FE_INVALID) csrs[CSR_FCSR] |= CSR_FCSR_NV;
+    if (raised & FE_OVERFLOW) csrs[CSR_FCSR] |= CSR_FCSR_OF;
+    if (raised & FE_UNDERFLOW) csrs[CSR_FCSR] |= CSR_FCSR_UF;
+}
 
-    if (except & FE_DIVBYZERO) csrs[CSR_FCSR] |= CSR_FCSR_DZ;
-    if (except & FE_INEXACT) csrs[CSR_FCSR] |= CSR_FCSR_NX;
-    if (except & FE_INVALID) csrs[CSR_FCSR] |= CSR_FCSR_NV;
-    if (except & FE_OVERFLOW) csrs[CSR_FCSR] |= CSR_FCSR_OF;
-    if (except & FE_UNDERFLOW) csrs[CSR_FCSR] |= CSR_FCSR_UF;
+void VirtualMachine::RaiseInterrupt(Long cause) {
+    mip.fetch_or(1ULL << cause);
+    Wake();
+}
 
-    if (except & (FE_DIVBYZERO | FE_INVALID)) return true;
-    return false;
+void VirtualMachine::Wake() {
+    // Taking the lock orders the state change before the sleeping hart
+    // checks it again, so the notification cannot get lost
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+
+        if (wake_handler)
+            wake_handler();
+    }
+
+    sleep_condition.notify_all();
 }
 
-void VirtualMachine::RaiseInterrupt(Long cause) {
-    auto cause_bit = 1ULL << cause;
+void VirtualMachine::UpdateIdle() {
+    if (timer)
+        timer->UpdateIdle(csrs[CSR_MHARTID]);
+}
 
-    static std::mutex lock;
-    lock.lock();
-    csrs[CSR_MIP] |= cause_bit;
-    lock.unlock();
+void VirtualMachine::SetWakeHandler(std::function<void()> handler) {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    wake_handler = handler;
 }
 
-void VirtualMachine::RaiseException(Long cause) {
+void VirtualMachine::WaitForWake() {
+    std::unique_lock<std::mutex> guard(sleep_lock);
+
+    sleep_condition.wait(guard, [this]() {
+        if (!running)
+            return true;
+        
+        if (paused)
+            return false;
+        
+        return !waiting_for_interrupt || CanLeaveWFI();
+    });
+}
+
+void VirtualMachine::RaiseException(Long cause, Long value) {
     auto cause_bit = 1ULL << cause;
 
     auto delegate = csrs[CSR_MEDELEG];
 
     if (delegate & cause_bit)
-        RaiseSupervisorTrap(cause);
+        RaiseSupervisorTrap(cause, value);
     
     else
-        RaiseMachineTrap(cause);
+        RaiseMachineTrap(cause, value);
+    
+}
+
+void VirtualMachine::RaiseMemoryFault(MemoryFault fault, Address address, bool is_store) {
+    if (fault == MemoryFault::Misaligned)
+        RaiseException(is_store ? EXCEPTION_STORE_AMO_ADDRESS_MISALIGNED : EXCEPTION_LOAD_ADDRESS_MISALIGNED, address);
     
+    else
+        RaiseException(is_store ? EXCEPTION_STORE_AMO_ACCESS_FAULT : EXCEPTION_LOAD_ACCESS_FAULT, address);
 }
 
-void VirtualMachine::RaiseMachineTrap(Long cause) {
+void VirtualMachine::RaiseMachineTrap(Long cause, Long value) {
     auto handler_address = csrs[CSR_MTVEC];
 
     auto mode = handler_address & 0b11;
@@ -452,6 +504,7 @@ void VirtualMachine::RaiseMachineTrap(Long cause) {
 
     csrs[CSR_MCAUSE] = cause;
     csrs[CSR_MEPC] = pc;
+    csrs[CSR_MTVAL] = value;
 
     mstatus.MPIE = mstatus.MIE;
     mstatus.MIE = 0;
@@ -476,10 +529,9 @@ void VirtualMachine::RaiseMachineTrap(Long cause) {
     privilege_level = PrivilegeLevel::Machine;
 }
 
-void VirtualMachine::RaiseSupervisorTrap(Long cause) {
-    auto [handler_address, valid] = TranslateMemoryAddress(csrs[CSR_STVEC], false, false);
-
-    if (!valid) return;
+void VirtualMachine::RaiseSupervisorTrap(Long cause, Long value) {
+    // pc holds virtual addresses, the handler is fetched through the MMU
+    auto handler_address = csrs[CSR_STVEC];
 
     auto mode = handler_address & 0b11;
     handler_address &= ~0b11;
@@ -498,6 +550,7 @@ void VirtualMachine::RaiseSupervisorTrap(Long cause) {
 
     csrs[CSR_SCAUSE] = cause;
     csrs[CSR_SEPC] = pc;
+    csrs[CSR_STVAL] = value;
 
     mstatus.SPIE = mstatus.SIE;
     mstatus.SIE = 0;
@@ -519,166 +572,335 @@ void VirtualMachine::RaiseSupervisorTrap(Long cause) {
     privilege_level = PrivilegeLevel::Supervisor;
 }
 
-std::pair<VirtualMachine::TLBEntry, bool> VirtualMachine::GetTLBLookup(Address virt_addr, bool bypass_cache, bool is_amo) {
-    // TODO Fix this!
-    constexpr auto KB_OFFSET_BITS = GetLog2(0x1000U);
-    constexpr auto MB_OFFSET_BITS = GetLog2(0x200000U);
+void VirtualMachine::RaisePageFault(Address address, bool is_write, bool is_execute) {
+    if (is_execute)
+        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT, address);
+    
+    else if (is_write)
+        RaiseException(EXCEPTION_STORE_AMO_PAGE_FAULT, address);
+    
+    else
+        RaiseException(EXCEPTION_LOAD_PAGE_FAULT, address);
+}
+
+std::pair<VirtualMachine::TLBEntry, Byte> VirtualMachine::GetTLBLookup(Address virt_addr, bool is_write, bool is_execute, bool bypass_cache) {
+    Long vpn = virt_addr >> 12;
+    Long asid = satp.ASID;
 
-    auto kb_tag = (virt_addr & ~((1ULL << KB_OFFSET_BITS) - 1)) >> 1;
-    auto mb_tag = (virt_addr & ~((1ULL << MB_OFFSET_BITS) - 1)) >> 1;
+    auto& cache = is_execute ? instruction_tlb : data_tlb;
+    auto& set = cache.sets[vpn & (TLB_SETS - 1)];
 
     if (!bypass_cache) {
-        for (size_t i = 0; i < tlb_cache.size(); i++) {
-            if (!tlb_cache[i].tlb_entry.V) continue;
-
-            if (tlb_cache[i].super && (mb_tag == tlb_cache[i].tag))
-                return {tlb_cache[i].tlb_entry, true};
-            
-            if (!tlb_cache[i].super && (kb_tag == tlb_cache[i].tag))
-                return {tlb_cache[i].tlb_entry, false};
+        for (const auto& entry : set) {
+            if (entry.Matches(vpn, asid))
+                return {entry.tlb_entry, entry.level};
         }
     }
 
-    union VirtualAddress {
-        struct {
-            Word offset : 12;
-            Word vpn_0 : 10;
-            Word vpn_1 : 10;
-        };
-        Word raw;
+    auto Fault = [&]() {
+        RaisePageFault(virt_addr, is_write, is_execute);
+        return std::pair<TLBEntry, Byte>{TLBEntry{}, 0};
     };
 
-    VirtualAddress vaddr;
-    vaddr.raw = virt_addr;
+    Long levels = satp.MODE == SATP_MODE_SV48 ? 4 : 3;
 
-    Word root_table_address = satp.PPN << 12;
+    // Bits above the virtual address space have to be a copy of its top bit
+    auto va_bits = 12 + levels * PAGE_LEVEL_BITS;
+    if (static_cast<Address>(static_cast<SLong>(virt_addr << (64 - va_bits)) >> (64 - va_bits)) != virt_addr)
+        return Fault();
 
-    auto ReadTLBEntry = [&](Address address) {
-        TLBEntry ppn;
-        ppn.V = 0;
-        auto ppn_read = memory.PeekWord(address);
-        if (!ppn_read.second) {
-            RaiseException(is_amo ? EXCEPTION_STORE_AMO_ACCESS_FAULT : EXCEPTION_LOAD_ACCESS_FAULT);
-            return ppn;
-        }
-        
-        ppn.raw = ppn_read.first;
-        if (!ppn.V || (!ppn.R && ppn.W)) {
-            RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            return ppn;
-        }
+    auto VPNBits = [&](Long level) {
+        return (vpn >> (level * PAGE_LEVEL_BITS)) & ((1ULL << PAGE_LEVEL_BITS) - 1);
+    };
+
+    Long level = levels - 1;
+    Address table = satp.PPN << 12;
 
-        if (!ppn.X && !ppn.W && ppn.R) {
-            RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            ppn.V = 0;
-            return ppn;
+    // Resume from the deepest table a previous walk went through
+    for (Long i = 0; i < levels - 1; i++) {
+        auto tag = vpn >> ((i + 1) * PAGE_LEVEL_BITS);
+        const auto& entry = page_walk_cache[i][tag & (PAGE_WALK_CACHE_SIZE - 1)];
+
+        if (entry.valid && entry.tag == tag && entry.satp == static_cast<Long>(satp.raw)) {
+            level = i;
+            table = entry.table;
+            break;
         }
+    }
+
+    TLBEntry tlb;
 
-        if (ppn.X && ppn.W && !ppn.R) {
-            RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            ppn.V = 0;
-            return ppn;
+    while (true) {
+        auto pte = memory.LoadLong(table + VPNBits(level) * sizeof(Long));
+        if (!pte) {
+            if (is_execute)
+                RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT, virt_addr);
+            
+            else
+                RaiseException(is_write ? EXCEPTION_STORE_AMO_ACCESS_FAULT : EXCEPTION_LOAD_ACCESS_FAULT, virt_addr);
+            
+            return {TLBEntry{}, 0};
         }
+
+        tlb.raw = pte.Value();
+
+        if (!tlb.V || (!tlb.R && tlb.W) || tlb._reserved || tlb.PBMT || tlb.N)
+            return Fault();
         
-        return ppn;
-    };
+        if (tlb.IsLeaf())
+            break;
+        
+        if (level == 0 || tlb.A || tlb.D || tlb.U)
+            return Fault();
+        
+        level--;
+        table = tlb.PPN << 12;
 
-    auto& cache = tlb_cache[tlb_cache_round_robin];
-    tlb_cache_round_robin++;
-    if (tlb_cache_round_robin >= TLB_CACHE_SIZE) tlb_cache_round_robin = 0;
+        auto tag = vpn >> ((level + 1) * PAGE_LEVEL_BITS);
+        page_walk_cache[level][tag & (PAGE_WALK_CACHE_SIZE - 1)] = {tag, static_cast<Long>(satp.raw), table, true};
+    }
 
-    cache = TLBCacheEntry();
+    // Super pages have to be aligned to their size
+    if (tlb.PPN & ((1ULL << (level * PAGE_LEVEL_BITS)) - 1))
+        return Fault();
 
-    auto tlb = ReadTLBEntry(root_table_address + vaddr.vpn_1 * 4);
+    TLBCacheEntry entry;
+    entry.vpn = vpn;
+    entry.vpn_mask = ~((1ULL << (level * PAGE_LEVEL_BITS)) - 1);
+    entry.asid = asid;
+    entry.valid = true;
+    entry.global = tlb.G;
+    entry.level = static_cast<Byte>(level);
+    entry.tlb_entry = tlb;
 
-    if (!tlb.V) return {tlb, false};
+    InsertTLBEntry(cache, entry);
 
-    if (!tlb.R && !tlb.X) {
-        constexpr Word PAGE_SIZE = 0x1000;
-        tlb = ReadTLBEntry(tlb.PPN * PAGE_SIZE + vaddr.vpn_0 * 4);
+    return {tlb, static_cast<Byte>(level)};
+}
 
-        cache.tag = kb_tag;
-        cache.tlb_entry = tlb;
-    }
-    else {
-        if (tlb.PPN_0 != 0) {
-            RaiseMachineTrap(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            tlb.V = 0;
-            return {tlb, false};
-        }
-        
-        cache.tag = mb_tag;
-        cache.super = 1;
-        cache.tlb_entry = tlb;
+VirtualMachine::TLBCacheEntry& VirtualMachine::InsertTLBEntry(TLBCache& cache, const TLBCacheEntry& entry) {
+    auto set_index = entry.vpn & (TLB_SETS - 1);
+    auto& set = cache.sets[set_index];
+
+    auto way = std::find_if(set.begin(), set.end(), [](const TLBCacheEntry& entry) { return !entry.valid; });
+
+    if (way == set.end()) {
+        way = set.begin() + cache.next_victim[set_index];
+        cache.next_victim[set_index] = (cache.next_victim[set_index] + 1) % TLB_WAYS;
     }
 
-    return {tlb, cache.super != 0};
-}
+    *way = entry;
+    way->context = GetAccessContext();
+    way->permitted = 0;
+    way->host_read = nullptr;
+    way->host_write = nullptr;
 
-std::pair<Address, bool> VirtualMachine::TranslateMemoryAddress(Address address, bool is_write, bool is_execute, bool is_amo) {
-    if (!IsUsingVirtualMemory()) return {address, true};
+    if (entry.level != 0)
+        cache.super_entries++;
     
-    auto [tlb, super] = GetTLBLookup(address);
-
-    if (!tlb.V) return {0, false};
+    return *way;
+}
 
-    if (is_execute && !tlb.X) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
+void VirtualMachine::CachePageAccess(Address address, Address phys_address, Byte access) {
+    Long vpn = address >> 12;
+    auto& cache = access == ACCESS_EXECUTE ? instruction_tlb : data_tlb;
+    auto& set = cache.sets[vpn & (TLB_SETS - 1)];
+
+    auto way = std::find_if(set.begin(), set.end(), [&](const TLBCacheEntry& entry) { return entry.vpn == vpn && entry.Matches(vpn, satp.ASID); });
+    TLBCacheEntry* entry = way != set.end() ? &*way : nullptr;
+
+    // Pages of a super page get their own entries, so every page can take
+    // the single compare path
+    if (!entry) {
+        for (const auto& cached : set) {
+            if (cached.Matches(vpn, satp.ASID)) {
+                auto copy = cached;
+                copy.vpn = vpn;
+                entry = &InsertTLBEntry(cache, copy);
+                break;
+            }
+        }
     }
 
-    if (is_write && !tlb.W) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
+    if (!entry)
+        return;
+
+    auto context = GetAccessContext();
+    if (entry->context != context) {
+        entry->context = context;
+        entry->permitted = 0;
+        entry->host_read = nullptr;
+        entry->host_write = nullptr;
     }
 
-    if (!is_write && !tlb.R) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
+    auto page = phys_address & ~(Memory::PAGE_SIZE - 1);
+
+    entry->permitted |= access;
+    entry->phys_page = page;
+
+    if (access == ACCESS_READ)
+        entry->host_read = memory.HostPointer(page, Memory::PAGE_SIZE);
+    
+    else if (access == ACCESS_WRITE) {
+        // Read before the code pages are checked, so a page marked in
+        // between is caught by the generation compare
+        entry->host_write_generation = memory.GetCodeMarkGeneration();
+        entry->host_write = memory.HostStorePointer(page, Memory::PAGE_SIZE);
     }
+}
 
-    if (is_amo && (!tlb.R || !tlb.W)) {
-        RaiseException(EXCEPTION_STORE_AMO_PAGE_FAULT);
+template <typename Type>
+bool VirtualMachine::LoadGuest(Address address, Type& value) {
+    bool paged = IsUsingVirtualMemory();
+
+    if (paged && !(address & (sizeof(Type) - 1))) {
+        if (auto host = FindHostPage(address, false)) {
+            std::memcpy(&value, host + (address & (Memory::PAGE_SIZE - 1)), sizeof(Type));
+            return true;
+        }
     }
 
-    if (privilege_level == PrivilegeLevel::User && !tlb.U) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
+    auto [translated_address, translation_valid] = TranslateMemoryAddress(address, false, false);
+    if (!translation_valid) return false;
+
+    Expected<Type, MemoryFault> loaded = [&]() {
+        if constexpr (std::is_same_v<Type, Long>) return memory.LoadLong(translated_address);
+        else if constexpr (std::is_same_v<Type, Word>) return memory.LoadWord(translated_address);
+        else if constexpr (std::is_same_v<Type, Half>) return memory.LoadHalf(translated_address);
+        else return memory.LoadByte(translated_address);
+    }();
+
+    if (!loaded) {
+        RaiseMemoryFault(loaded.Error(), address, false);
+        return false;
     }
 
-    if (privilege_level == PrivilegeLevel::Supervisor && tlb.U && !sstatus.SUM) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
+    value = loaded.Value();
+
+    return true;
+}
+
+template <typename Type>
+bool VirtualMachine::StoreGuest(Address address, Type value) {
+    bool paged = IsUsingVirtualMemory();
+
+    if (paged && !(address & (sizeof(Type) - 1))) {
+        if (auto host = FindHostPage(address, true)) {
+            std::memcpy(host + (address & (Memory::PAGE_SIZE - 1)), &value, sizeof(Type));
+
+            if (memory.HasReservations())
+                memory.ClearReservations(TranslateMemoryAddress(address, true, false).first);
+            
+            return true;
+        }
     }
 
-    if (!tlb.A || (tlb.D && is_write)) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
+    auto [translated_address, translation_valid] = TranslateMemoryAddress(address, true, false);
+    if (!translation_valid) return false;
+
+    Expected<bool, MemoryFault> stored = [&]() {
+        if constexpr (std::is_same_v<Type, Long>) return memory.StoreLong(translated_address, value);
+        else if constexpr (std::is_same_v<Type, Word>) return memory.StoreWord(translated_address, value);
+        else if constexpr (std::is_same_v<Type, Half>) return memory.StoreHalf(translated_address, value);
+        else return memory.StoreByte(translated_address, value);
+    }();
+
+    if (!stored) {
+        RaiseMemoryFault(stored.Error(), address, true);
+        return false;
     }
 
-    union VirtualAddress {
-        struct {
-            Word offset : 12;
-            Word vpn_0 : 10;
-            Word vpn_1 : 10;
-        };
-        Word raw;
+    return true;
+}
+
+void VirtualMachine::FlushTLB(bool all_addresses, Address address, bool all_asids, Long asid) {
+    Long vpn = address >> 12;
+
+    auto Flush = [&](TLBCacheEntry& entry) {
+        if (!entry.valid)
+            return;
+        
+        if (!all_addresses && ((vpn ^ entry.vpn) & entry.vpn_mask) != 0)
+            return;
+        
+        if (!all_asids && (entry.global || entry.asid != asid))
+            return;
+        
+        entry.valid = false;
     };
 
-    VirtualAddress vaddr;
-    vaddr.raw = address;
+    for (auto cache : {&instruction_tlb, &data_tlb}) {
+        // A super page may be cached in the set of any page it covers
+        if (all_addresses || cache->super_entries != 0) {
+            for (auto& set : cache->sets)
+                for (auto& entry : set)
+                    Flush(entry);
+        }
+        else {
+            for (auto& entry : cache->sets[vpn & (TLB_SETS - 1)])
+                Flush(entry);
+        }
 
-    Word phys_address;
-    if (super) {
-        phys_address = tlb.PPN_1 << 22;
-        phys_address |= vaddr.vpn_0 << 12;
-        phys_address |= vaddr.offset;
+        if (all_addresses && all_asids)
+            cache->super_entries = 0;
     }
-    else {
-        phys_address = tlb.PPN << 12;
-        phys_address |= vaddr.offset;
+
+    // Cached tables are only dropped by fences that cover every address
+    if (all_addresses) {
+        for (auto& level : page_walk_cache)
+            for (auto& entry : level)
+                entry.valid = false;
+    }
+}
+
+std::pair<Address, bool> VirtualMachine::TranslateMemoryAddress(Address address, bool is_write, bool is_execute, bool is_amo) {
+    if (!IsUsingVirtualMemory()) return {address, true};
+
+    is_write = is_write || is_amo;
+
+    Byte access = is_execute ? ACCESS_EXECUTE : is_amo ? ACCESS_AMO : is_write ? ACCESS_WRITE : ACCESS_READ;
+
+    auto entry = FindPageEntry(is_execute ? instruction_tlb : data_tlb, address >> 12);
+    if (entry && (entry->permitted & access))
+        return {entry->phys_page | (address & (Memory::PAGE_SIZE - 1)), true};
+    
+    auto [tlb, level] = GetTLBLookup(address, is_write, is_execute);
+
+    if (!tlb.V) return {0, false};
+
+    bool permitted;
+
+    if (is_execute)
+        permitted = tlb.X;
+    
+    else if (is_amo)
+        permitted = tlb.R && tlb.W;
+    
+    else if (is_write)
+        permitted = tlb.W;
+    
+    else
+        permitted = tlb.R || (sstatus.MXR && tlb.X);
+
+    if (privilege_level == PrivilegeLevel::User && !tlb.U)
+        permitted = false;
+
+    if (privilege_level == PrivilegeLevel::Supervisor && tlb.U && (is_execute || !sstatus.SUM))
+        permitted = false;
+
+    if (!tlb.A || (is_write && !tlb.D))
+        permitted = false;
+
+    if (!permitted) {
+        RaisePageFault(address, is_write, is_execute);
+        return {0, false};
     }
 
+    Address offset_mask = (1ULL << (12 + level * PAGE_LEVEL_BITS)) - 1;
+    Address phys_address = ((static_cast<Address>(tlb.PPN) << 12) & ~offset_mask) | (address & offset_mask);
+
+    CachePageAccess(address, phys_address, access);
+
     return {phys_address, true};
 }
 
@@ -726,6 +948,8 @@ void VirtualMachine::Setup() {
     privilege_level = PrivilegeLevel::Machine;
 
     cycles = 0;
+
+    block_epoch++;
 }
 
 VirtualMachine::VirtualMachine(Memory& memory, Address starting_pc, Address hart_id) : memory{memory}, pc{starting_pc} {
@@ -734,20 +958,16 @@ VirtualMachine::VirtualMachine(Memory& memory, Address starting_pc, Address hart
     csrs[CSR_MARCHID] = ('E' << 24) | ('N' << 16) | ('I' << 8) | ('H');
     csrs[CSR_MIMPID] = ('C' << 24) | ('A' << 16) | ('M' << 8) | ('V');
 
+    if (hart_id >= Memory::MAX_HARTS)
+        throw std::runtime_error(std::format("Hart {} is above the supported {} harts", hart_id, Memory::MAX_HARTS));
+
     csrs[CSR_MHARTID] = hart_id;
 
     csrs[CSR_MISA] = ISA_64_BITS | ISA_A | ISA_D | ISA_F | ISA_I | ISA_M;
 
-    csr_mapped_memory = std::make_shared<CSRMappedMemory>();
-    memory.AddMemoryRegion(csr_mapped_memory);
+    timer = Timer::Get(memory);
+    timer->Attach(hart_id, this);
 
-    auto now = std::chrono::system_clock::now();
-    auto epoch = now.time_since_epoch();
-    auto dur_ms = std::chrono::duration_cast<std::chrono::microseconds>(epoch);
-    
-    double ms = dur_ms.count() / 1000000.0;
-    csr_mapped_memory->time = ms * CSRMappedMemory::TICKS_PER_SECOND;
-    
     Setup();
 }
 
@@ -755,9 +975,24 @@ VirtualMachine::VirtualMachine(VirtualMachine&& vm) : memory{vm.memory}, pc{vm.p
     regs = std::move(vm.regs);
     fregs = std::move(vm.fregs);
     csrs = std::move(vm.csrs);
-    tlb_cache = std::move(vm.tlb_cache);
-    running = std::move(vm.running);
-    paused = std::move(vm.paused);
+    dynamic_rounding_mode = vm.dynamic_rounding_mode;
+    instruction_tlb = vm.instruction_tlb;
+    data_tlb = vm.data_tlb;
+    page_walk_cache = vm.page_walk_cache;
+    decoded_pages = std::move(vm.decoded_pages);
+    last_decoded_page_number = vm.last_decoded_page_number;
+    last_decoded_page = vm.last_decoded_page;
+    decoded_generation = vm.decoded_generation;
+    flush_decoded_instructions = vm.flush_decoded_instructions;
+    vm.last_decoded_page_number = -1ULL;
+    vm.last_decoded_page = nullptr;
+    decoded_blocks = std::move(vm.decoded_blocks);
+    block_epoch = vm.block_epoch;
+    execution_engine = vm.execution_engine;
+    jit = std::move(vm.jit);
+    running = vm.running.load();
+    paused = vm.paused.load();
+    waiting_for_interrupt = vm.waiting_for_interrupt.load();
     pause_on_break = std::move(vm.pause_on_break);
     pause_on_restart = std::move(vm.pause_on_restart);
     err = std::move(vm.err);
@@ -765,16 +1000,285 @@ VirtualMachine::VirtualMachine(VirtualMachine&& vm) : memory{vm.memory}, pc{vm.p
     ticks = std::move(vm.ticks);
     history_delta = std::move(vm.history_delta);
     history_tick = std::move(vm.history_tick);
-    csr_mapped_memory = std::move(vm.csr_mapped_memory);
+    mip = vm.mip.load();
+    timer = std::move(vm.timer);
+    timer->Attach(csrs[CSR_MHARTID], this);
     cycles = std::move(vm.cycles);
     privilege_level = std::move(vm.privilege_level);
 }
 
 VirtualMachine::~VirtualMachine() {
     running = false;
+
+    if (timer)
+        timer->Detach(csrs[CSR_MHARTID], this);
 }
 
-bool VirtualMachine::SingleStep() {
+const RVInstruction* VirtualMachine::GetDecodedInstruction(Address phys_address) {
+    if (IsDecodedCodeStale())
+        FlushDecodedInstructions();
+
+    return DecodeInstruction(phys_address);
+}
+
+const RVInstruction* VirtualMachine::DecodeInstruction(Address phys_address) {
+    Address page_number = phys_address / Memory::PAGE_SIZE;
+    size_t index = (phys_address % Memory::PAGE_SIZE) / sizeof(Word);
+
+    if (page_number != last_decoded_page_number) {
+        auto& page = decoded_pages[page_number];
+        if (!page) {
+            page = std::make_unique<DecodedPage>();
+            memory.MarkCodePage(phys_address);
+        }
+
+        last_decoded_page_number = page_number;
+        last_decoded_page = page.get();
+    }
+
+    auto& page = *last_decoded_page;
+
+    if (!page.decoded[index]) {
+        auto [word, valid] = memory.PeekWord(phys_address);
+        if (!valid) return nullptr;
+
+        page.instructions[index] = RVInstruction::FromUInt32(word);
+        page.decoded[index] = true;
+    }
+
+    return &page.instructions[index];
+}
+
+void VirtualMachine::FlushDecodedInstructions() {
+    decoded_pages.clear();
+    last_decoded_page_number = -1ULL;
+    last_decoded_page = nullptr;
+
+    decoded_blocks.clear();
+    block_epoch++;
+
+    if (jit)
+        jit->Reset();
+
+    decoded_generation = memory.GetCodeGeneration();
+    flush_decoded_instructions = false;
+}
+
+bool VirtualMachine::IsDecodedBreakPoint(Address addr) {
+    if (break_points.contains(addr)) return true;
+
+    if (privilege_level == PrivilegeLevel::User)
+        return false;
+
+    if ((addr & 0b11) || addr >= memory.GetMaxAddress())
+        return false;
+
+    auto instr = GetDecodedInstruction(addr);
+
+    if (!instr)
+        return false;
+
+    return instr->type == RVInstruction::Type::EBREAK;
+}
+
+static bool IsBlockBranch(RVInstruction::Type type) {
+    using Type = RVInstruction::Type;
+
+    switch (type) {
+        case Type::JAL:
+        case Type::JALR:
+        case Type::BEQ:
+        case Type::BNE:
+        case Type::BLT:
+        case Type::BGE:
+        case Type::BLTU:
+        case Type::BGEU:
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+// Instructions that can trap, change the privilege level or change address
+// translation. Blocks end after them and are never chained across them.
+static bool IsBlockBarrier(RVInstruction::Type type) {
+    using Type = RVInstruction::Type;
+
+    switch (type) {
+        case Type::FENCE_I:
+        case Type::ECALL:
+        case Type::EBREAK:
+        case Type::CSRRW:
+        case Type::CSRRS:
+        case Type::CSRRC:
+        case Type::CSRRWI:
+        case Type::CSRRSI:
+        case Type::CSRRCI:
+        case Type::SRET:
+        case Type::MRET:
+        case Type::WFI:
+        case Type::SFENCE_VMA:
+        case Type::SFENCE_W_INVAL:
+        case Type::SFENCE_INVAL_IR:
+        case Type::CUST_TVA:
+        case Type::CUST_MTRAP:
+        case Type::CUST_STRAP:
+        case Type::INVALID:
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+VirtualMachine::DecodedBlock* VirtualMachine::GetDecodedBlock(Address phys_address) {
+    auto& block = decoded_blocks[phys_address];
+    if (block) return block.get();
+
+    block = std::make_unique<DecodedBlock>();
+    block->address = phys_address;
+
+    Address page_end = (phys_address / Memory::PAGE_SIZE + 1) * Memory::PAGE_SIZE;
+
+    for (Address address = phys_address; address < page_end; address += sizeof(Word)) {
+        auto instr = DecodeInstruction(address);
+
+        if (!instr) {
+            if (block->entries.empty()) {
+                decoded_blocks.erase(phys_address);
+                return nullptr;
+            }
+            
+            break;
+        }
+
+        // Stop in front of EBREAK so it is reported as a break point at the
+        // same point the interpreter would report it
+        if (instr->type == RVInstruction::Type::EBREAK && !block->entries.empty())
+            break;
+
+        bool is_branch = IsBlockBranch(instr->type);
+        block->entries.push_back({ResolveHandler(instr->type), instr, is_branch});
+
+        if (is_branch)
+            break;
+
+        if (IsBlockBarrier(instr->type)) {
+            block->ends_with_barrier = true;
+            break;
+        }
+    }
+
+    return block.get();
+}
+
+VirtualMachine::InstructionHandler VirtualMachine::ResolveHandler(RVInstruction::Type type) const {
+    using Type = RVInstruction::Type;
+
+    if (Is32BitMode())
+        return &VirtualMachine::ExecuteInstruction;
+
+    switch (type) {
+        case Type::LUI: return &VirtualMachine::ExecuteFast<Type::LUI>;
+        case Type::AUIPC: return &VirtualMachine::ExecuteFast<Type::AUIPC>;
+        case Type::ADDI: return &VirtualMachine::ExecuteFast<Type::ADDI>;
+        case Type::XORI: return &VirtualMachine::ExecuteFast<Type::XORI>;
+        case Type::ORI: return &VirtualMachine::ExecuteFast<Type::ORI>;
+        case Type::ANDI: return &VirtualMachine::ExecuteFast<Type::ANDI>;
+        case Type::SLLI: return &VirtualMachine::ExecuteFast<Type::SLLI>;
+        case Type::SRLI: return &VirtualMachine::ExecuteFast<Type::SRLI>;
+        case Type::ADD: return &VirtualMachine::ExecuteFast<Type::ADD>;
+        case Type::SUB: return &VirtualMachine::ExecuteFast<Type::SUB>;
+        case Type::XOR: return &VirtualMachine::ExecuteFast<Type::XOR>;
+        case Type::OR: return &VirtualMachine::ExecuteFast<Type::OR>;
+        case Type::AND: return &VirtualMachine::ExecuteFast<Type::AND>;
+        default: return &VirtualMachine::ExecuteInstruction;
+    }
+}
+
+template <RVInstruction::Type type>
+void VirtualMachine::ExecuteFast(const RVInstruction& instr) {
+    using Type = RVInstruction::Type;
+
+    Long rs1 = regs[instr.rs1].u64;
+    Long rs2 = regs[instr.rs2].u64;
+    Long value;
+
+    if constexpr (type == Type::LUI) value = instr.immediate;
+    else if constexpr (type == Type::AUIPC) value = pc + instr.immediate;
+    else if constexpr (type == Type::ADDI) value = rs1 + instr.immediate;
+    else if constexpr (type == Type::XORI) value = rs1 ^ instr.immediate;
+    else if constexpr (type == Type::ORI) value = rs1 | instr.immediate;
+    else if constexpr (type == Type::ANDI) value = rs1 & instr.immediate;
+    else if constexpr (type == Type::SLLI) value = rs1 << (instr.immediate & 0b111111);
+    else if constexpr (type == Type::SRLI) value = rs1 >> (instr.immediate & 0b111111);
+    else if constexpr (type == Type::ADD) value = rs1 + rs2;
+    else if constexpr (type == Type::SUB) value = rs1 - rs2;
+    else if constexpr (type == Type::XOR) value = rs1 ^ rs2;
+    else if constexpr (type == Type::OR) value = rs1 | rs2;
+    else if constexpr (type == Type::AND) value = rs1 & rs2;
+    else static_assert(type == Type::LUI, "No fast handler for this instruction");
+
+    if (instr.rd != 0)
+        regs[instr.rd].u64 = value;
+
+    pc += 4;
+}
+
+bool VirtualMachine::HandlePendingInterrupts() {
+    if (waiting_for_interrupt) {
+        bool delegated = (mie & mideleg) != 0 && (sie & mideleg) == 0;
+
+        if (CanLeaveWFI() || delegated) {
+            waiting_for_interrupt = false;
+            UpdateIdle();
+        }
+
+        if (!delegated)
+            return false;
+    }
+
+    if (mstatus.MIE) {
+        Long pending_interrupts = mip;
+        pending_interrupts &= mie;
+
+        auto delegated = pending_interrupts & mideleg;
+        sip |= delegated;
+
+        pending_interrupts &= ~delegated;
+
+        bool handled = false;
+
+        if (pending_interrupts) {
+            for (auto cause : INTERRUPT_PRIORITY) {
+                if (pending_interrupts & (1ULL << cause)) {
+                    RaiseMachineTrap(cause | TRAP_INTERRUPT_BIT);
+                    handled = true;
+                    break;
+                }
+            }
+        }
+
+        if (!handled && mstatus.SIE && sstatus.SIE) {
+            pending_interrupts = sip;
+            pending_interrupts &= sie;
+
+            if (pending_interrupts) {
+                for (auto cause : INTERRUPT_PRIORITY) {
+                    if (pending_interrupts & (1ULL << cause)) {
+                        RaiseSupervisorTrap(cause | TRAP_INTERRUPT_BIT);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void VirtualMachine::ExecuteInstruction(const RVInstruction& instr) {
     auto SignExtendUnsigned = [](Long value, Long bit) {
         Long sign = -1ULL << bit;
         if (value & (1ULL << bit)) return value | sign;
@@ -910,87 +1414,26 @@ bool VirtualMachine::SingleStep() {
         if (is_inf) *is_inf = exp == 0x7ff && frac == 0;
         if (is_nan) *is_nan = exp == 0x7ff && frac != 0 && !(frac & 0x8000000000000);
         if (is_qnan) *is_qnan = exp == 0x7ff && (frac & 0x8000000000000);
-        if (is_subnormal) *is_subnormal = exp == 0 && frac != 0;
-        if (is_zero) *is_zero = exp == 0 && frac == 0;
-        if (is_neg) *is_neg = sign != 0;
-    };
-
-    auto SetFloatFlags = [&](bool invalid_op, bool div_by_zero, bool overflow, bool underflow, bool inexact) {
-        if (invalid_op) csrs[CSR_FCSR] |= CSR_FCSR_NV;
-        if (div_by_zero) csrs[CSR_FCSR] |= CSR_FCSR_DZ;
-        if (overflow) csrs[CSR_FCSR] |= CSR_FCSR_OF;
-        if (underflow) csrs[CSR_FCSR] |= CSR_FCSR_UF;
-        if (inexact) csrs[CSR_FCSR] |= CSR_FCSR_NX;
-    };
-
-    ticks++;
-
-    using Type = RVInstruction::Type;
-
-    constexpr Long RV_F32_NAN = 0xffffffff7fc00000;
-    constexpr Long RV_F32_QNAN = 0xffffffffffc00000;
-    constexpr Long RV_F64_NAN = 0x7ff0000000000000;
-    constexpr Long RV_F64_QNAN = 0xfff0000000000000;
-    
-    cycles++;
-
-    if (waiting_for_interrupt) {
-        if (mip != 0 || sip != 0 || (mie & ~mideleg) == 0)
-            waiting_for_interrupt = false;
-
-        if ((mie & mideleg) != 0 && (sie & mideleg) == 0)
-            waiting_for_interrupt = false;
-
-        else
-            return false;
-    }
-
-    if (mstatus.MIE) {
-        auto pending_interrupts = mip;
-        pending_interrupts &= mie;
-
-        auto delegated = pending_interrupts & mideleg;
-        sip |= delegated;
-
-        pending_interrupts &= ~delegated;
-
-        bool handled = false;
-
-        if (pending_interrupts) {
-            for (Word cause = 31; cause > 32; cause--) {
-                if (pending_interrupts & (1ULL << cause)) {
-                    RaiseMachineTrap(cause | TRAP_INTERRUPT_BIT);
-                    handled = true;
-                    break;
-                }
-            }
-        }
+        if (is_subnormal) *is_subnormal = exp == 0 && frac != 0;
+        if (is_zero) *is_zero = exp == 0 && frac == 0;
+        if (is_neg) *is_neg = sign != 0;
+    };
 
-        if (!handled && mstatus.SIE && sstatus.SIE) {
-            pending_interrupts = sip;
-            pending_interrupts &= sie;
+    auto SetFloatFlags = [&](bool invalid_op, bool div_by_zero, bool overflow, bool underflow, bool inexact) {
+        if (invalid_op) csrs[CSR_FCSR] |= CSR_FCSR_NV;
+        if (div_by_zero) csrs[CSR_FCSR] |= CSR_FCSR_DZ;
+        if (overflow) csrs[CSR_FCSR] |= CSR_FCSR_OF;
+        if (underflow) csrs[CSR_FCSR] |= CSR_FCSR_UF;
+        if (inexact) csrs[CSR_FCSR] |= CSR_FCSR_NX;
+    };
 
-            if (pending_interrupts) {
-                for (Word cause = 31; cause > 32; cause--) {
-                    if (pending_interrupts & (1ULL << cause)) {
-                        RaiseSupervisorTrap(cause | TRAP_INTERRUPT_BIT);
-                        break;
-                    }
-                }
-            }
-        }
-    }
-    
-    if (pc & 0b11) {
-        RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
-        return false;
-    }
+    using Type = RVInstruction::Type;
 
-    auto [translated_address, translation_valid] = TranslateMemoryAddress(pc, false, true);
-    if (!translation_valid) return false;
+    constexpr Long RV_F32_NAN = 0xffffffff7fc00000;
+    constexpr Long RV_F32_QNAN = 0xffffffffffc00000;
+    constexpr Long RV_F64_NAN = 0x7ff0000000000000;
+    constexpr Long RV_F64_QNAN = 0xfff0000000000000;
     
-    auto instr = RVInstruction::FromUInt32(memory.ReadWord(translated_address));
-
     bool inc_pc = true;
 
     auto RS1 = [&]() {
@@ -1031,6 +1474,17 @@ bool VirtualMachine::SingleStep() {
             regs[instr.rd].u64 = value;
     };
 
+    // AMOs report their faults as store/AMO faults at the virtual address
+    auto SetAtomicRD = [&](auto result) {
+        if (!result) {
+            RaiseMemoryFault(result.Error(), RS1(), true);
+            return false;
+        }
+
+        SetRD(result.Value());
+        return true;
+    };
+
     auto SetSignedRD = [&](SLong value) {
         if (instr.rd == 0) return;
         
@@ -1041,6 +1495,17 @@ bool VirtualMachine::SingleStep() {
             regs[instr.rd].s64 = value;
     };
 
+    // .W AMOs sign extend the word they read, whatever operation they did
+    auto SetAtomicWordRD = [&](auto result) {
+        if (!result) {
+            RaiseMemoryFault(result.Error(), RS1(), true);
+            return false;
+        }
+
+        SetSignedRD(static_cast<SWord>(result.Value()));
+        return true;
+    };
+
     switch (instr.type) {
         case Type::LUI:
             SetRD(instr.immediate);
@@ -1128,9 +1593,10 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(SignExtendUnsigned(memory.ReadByte(translated_address), 7));
+            Byte value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(SignExtendUnsigned(value, 7));
             break;
         }
         
@@ -1138,9 +1604,10 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(SignExtendUnsigned(memory.ReadHalf(translated_address), 15));
+            Half value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(SignExtendUnsigned(value, 15));
             break;
         }
         
@@ -1148,9 +1615,10 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
             
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(SignExtendUnsigned(memory.ReadWord(translated_address), 31));
+            Word value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(SignExtendUnsigned(value, 31));
             break;
         }
 
@@ -1158,9 +1626,10 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(static_cast<Long>(memory.ReadByte(translated_address)));
+            Byte value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(static_cast<Long>(value));
             break;
         }
         
@@ -1168,9 +1637,10 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(static_cast<Long>(memory.ReadHalf(translated_address)));
+            Half value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(static_cast<Long>(value));
             break;
         }
         
@@ -1178,9 +1648,7 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xfffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-            if (!translation_valid) return false;
-            memory.WriteByte(translated_address, static_cast<uint8_t>(RS2()));
+            if (!StoreGuest<Byte>(addr, static_cast<uint8_t>(RS2()))) return;
             break;
         }
         
@@ -1188,9 +1656,7 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-            if (!translation_valid) return false;
-            memory.WriteHalf(translated_address, static_cast<uint16_t>(RS2()));
+            if (!StoreGuest<Half>(addr, static_cast<uint16_t>(RS2()))) return;
             break;
         }
         
@@ -1198,9 +1664,7 @@ bool VirtualMachine::SingleStep() {
             Long addr = regs[instr.rs1].u64 + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-            if (!translation_valid) return false;
-            memory.WriteWord(translated_address, RS2());
+            if (!StoreGuest<Word>(addr, RS2())) return;
             break;
         }
         
@@ -1309,6 +1773,10 @@ bool VirtualMachine::SingleStep() {
         case Type::FENCE:
             break;
         
+        case Type::FENCE_I:
+            flush_decoded_instructions = true;
+            break;
+        
         case Type::ECALL:
             switch (privilege_level) {
                 case PrivilegeLevel::Machine: {
@@ -1351,9 +1819,10 @@ bool VirtualMachine::SingleStep() {
             }
 
             Long addr = regs[instr.rs1].u64 + instr.immediate;
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(memory.ReadWord(translated_address));
+            Word value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(value);
             break;
         }
 
@@ -1365,9 +1834,10 @@ bool VirtualMachine::SingleStep() {
             }
 
             Long addr = regs[instr.rs1].u64 + instr.immediate;
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
-            SetRD(memory.ReadLong(translated_address));
+            Long value;
+            if (!LoadGuest(addr, value)) return;
+
+            SetRD(value);
             break;
         }
 
@@ -1379,9 +1849,7 @@ bool VirtualMachine::SingleStep() {
             }
 
             Long addr = regs[instr.rs1].u64 + instr.immediate;
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-            if (!translation_valid) return false;
-            memory.WriteLong(translated_address, regs[instr.rs2].u64);
+            if (!StoreGuest<Long>(addr, regs[instr.rs2].u64)) return;
             break;
         };
 
@@ -1807,17 +2275,29 @@ bool VirtualMachine::SingleStep() {
                 break;
             }
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
+
+            auto loaded = memory.LoadWordReserved(translated_address, csrs[CSR_MHARTID]);
+            if (!loaded) {
+                RaiseMemoryFault(loaded.Error(), RS1(), false);
+                return;
+            }
 
-            SetRD(memory.ReadWordReserved(translated_address, csrs[CSR_MHARTID]));
+            SetSignedRD(static_cast<SWord>(loaded.Value()));
             break;
         }
         
         case Type::SC_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), true, false);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
             
-            if (memory.WriteWordConditional(translated_address, RS2(), csrs[CSR_MHARTID]))
+            auto stored = memory.StoreWordConditional(translated_address, RS2(), csrs[CSR_MHARTID]);
+            if (!stored) {
+                RaiseMemoryFault(stored.Error(), RS1(), true);
+                return;
+            }
+
+            if (stored.Value())
                 SetRD(0);
             
             else
@@ -1828,73 +2308,82 @@ bool VirtualMachine::SingleStep() {
         
         case Type::AMOSWAP_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicSwapW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicSwapW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOADD_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicAddW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicAddW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOXOR_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicXorW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicXorW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOAND_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicAndW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicAndW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOOR_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
             
-            SetRD(memory.AtomicOrW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicOrW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOMIN_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMinW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicMinW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOMAX_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMaxW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicMaxW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOMINU_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMinUW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicMinUW(translated_address, RS2())))
+                return;
             break;
         }
         
         case Type::AMOMAXU_W: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMaxUW(translated_address, RS2()));
+            if (!SetAtomicWordRD(memory.AtomicMaxUW(translated_address, RS2())))
+                return;
             break;
         }
 
@@ -1905,17 +2394,29 @@ bool VirtualMachine::SingleStep() {
                 break;
             }
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
+
+            auto loaded = memory.LoadLongReserved(translated_address, csrs[CSR_MHARTID]);
+            if (!loaded) {
+                RaiseMemoryFault(loaded.Error(), RS1(), false);
+                return;
+            }
 
-            SetRD(memory.ReadLongReserved(translated_address, csrs[CSR_MHARTID]));
+            SetRD(loaded.Value());
             break;
         }
 
         case Type::SC_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), true, false);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            if (memory.WriteLongConditional(translated_address, RS2(), csrs[CSR_MHARTID]))
+            auto stored = memory.StoreLongConditional(translated_address, RS2(), csrs[CSR_MHARTID]);
+            if (!stored) {
+                RaiseMemoryFault(stored.Error(), RS1(), true);
+                return;
+            }
+
+            if (stored.Value())
                 SetRD(0);
             
             else
@@ -1926,73 +2427,82 @@ bool VirtualMachine::SingleStep() {
 
         case Type::AMOSWAP_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicSwapL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicSwapL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOADD_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicAddL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicAddL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOXOR_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicXorL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicXorL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOAND_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicAndL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicAndL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOOR_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicOrL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicOrL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOMIN_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMinL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicMinL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOMAX_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMaxL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicMaxL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOMINU_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMinUL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicMinUL(translated_address, RS2())))
+                return;
             break;
         }
 
         case Type::AMOMAXU_D: {
             auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-            if (!translation_valid) return false;
+            if (!translation_valid) return;
 
-            SetRD(memory.AtomicMaxUL(translated_address, RS2()));
+            if (!SetAtomicRD(memory.AtomicMaxUL(translated_address, RS2())))
+                return;
             break;
         }
         
@@ -2003,10 +2513,10 @@ bool VirtualMachine::SingleStep() {
             auto addr = RS1() + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
+            Word value;
+            if (!LoadGuest(addr, value)) return;
 
-            fregs[instr.rd] = ToFloat(translated_address);
+            fregs[instr.rd] = ToFloat(value);
             break;
         }
         
@@ -2014,9 +2524,7 @@ bool VirtualMachine::SingleStep() {
             auto addr = RS1() + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-            if (!translation_valid) return false;
-            memory.WriteWord(translated_address, ToUInt32(fregs[instr.rs2]));
+            if (!StoreGuest<Word>(addr, ToUInt32(fregs[instr.rs2]))) return;
             break;
         }
         
@@ -2042,7 +2550,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = fregs[instr.rs1].f * fregs[instr.rs2].f + fregs[instr.rs3].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
             
             else
@@ -2073,7 +2581,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = fregs[instr.rs1].f * fregs[instr.rs2].f - fregs[instr.rs3].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
             
             else
@@ -2104,7 +2612,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = -(fregs[instr.rs1].f * fregs[instr.rs2].f) + fregs[instr.rs3].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
             
             else
@@ -2135,7 +2643,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = -(fregs[instr.rs1].f * fregs[instr.rs2].f) - fregs[instr.rs3].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
             
             else
@@ -2155,7 +2663,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = fregs[instr.rs1].f + fregs[instr.rs2].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
 
             else
@@ -2175,7 +2683,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = fregs[instr.rs1].f - fregs[instr.rs2].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
 
             else
@@ -2195,7 +2703,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = fregs[instr.rs1].f * fregs[instr.rs2].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
 
             else
@@ -2215,7 +2723,7 @@ bool VirtualMachine::SingleStep() {
 
             float result = fregs[instr.rs1].f / fregs[instr.rs2].f;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F32_NAN;
 
             else
@@ -2694,12 +3202,10 @@ bool VirtualMachine::SingleStep() {
             auto addr = RS1() + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-            if (!translation_valid) return false;
+            Long value;
+            if (!LoadGuest(addr, value)) return;
 
-            Long val = memory.ReadWord(translated_address);
-            val |= static_cast<Long>(memory.ReadWord(translated_address + 4)) << 32;
-            fregs[instr.rd] = ToDouble(val);
+            fregs[instr.rd] = ToDouble(value);
             break;
         }
         
@@ -2707,12 +3213,7 @@ bool VirtualMachine::SingleStep() {
             auto addr = RS1() + instr.immediate;
             if (Is32BitMode()) addr &= 0xffffffff;
 
-            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-            if (!translation_valid) return false;
-            
-            auto val = ToUInt64(fregs[instr.rs2]);
-            memory.WriteWord(translated_address, static_cast<Word>(val));
-            memory.WriteWord(translated_address + 4, static_cast<Word>(val >> 32));
+            if (!StoreGuest<Long>(addr, ToUInt64(fregs[instr.rs2]))) return;
             break;
         }
         
@@ -2738,7 +3239,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = fregs[instr.rs1].d * fregs[instr.rs2].d + fregs[instr.rs3].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
             
             else
@@ -2769,7 +3270,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = fregs[instr.rs1].d * fregs[instr.rs2].d - fregs[instr.rs3].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
             
             else
@@ -2800,7 +3301,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = -(fregs[instr.rs1].d * fregs[instr.rs2].d) + fregs[instr.rs3].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
             
             else
@@ -2831,7 +3332,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = -(fregs[instr.rs1].d * fregs[instr.rs2].d) - fregs[instr.rs3].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
             
             else
@@ -2851,7 +3352,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = fregs[instr.rs1].d + fregs[instr.rs2].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
 
             else
@@ -2871,7 +3372,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = fregs[instr.rs1].d - fregs[instr.rs2].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
 
             else
@@ -2891,7 +3392,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = fregs[instr.rs1].d * fregs[instr.rs2].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
 
             else
@@ -2911,7 +3412,7 @@ bool VirtualMachine::SingleStep() {
 
             double result = fregs[instr.rs1].d / fregs[instr.rs2].d;
 
-            if (CheckFloatErrors())
+            if (std::isnan(result))
                 fregs[instr.rd].u64 = RV_F64_NAN;
 
             else
@@ -3443,7 +3944,7 @@ bool VirtualMachine::SingleStep() {
             else
                 privilege_level = PrivilegeLevel::User;
             
-            return false;
+            return;
         
         case Type::MRET:
             if (privilege_level == PrivilegeLevel::Supervisor) {
@@ -3475,14 +3976,23 @@ bool VirtualMachine::SingleStep() {
                 default:
                     throw std::runtime_error("Cannot MRET to hypervisor");
             }
-            return false;
+            return;
         
         case Type::WFI:
             waiting_for_interrupt = true;
+            UpdateIdle();
             break;
         
         case Type::SFENCE_VMA:
-            throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
+            if (privilege_level == PrivilegeLevel::User) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                return;
+            }
+
+            FlushTLB(instr.rs1 == 0, RS1(), instr.rs2 == 0, RS2());
+
+            // Block successors are chained by virtual address
+            block_epoch++;
             break;
         
         case Type::SINVAL_VMA:
@@ -3533,7 +4043,7 @@ bool VirtualMachine::SingleStep() {
             else
                 RaiseMachineTrap(regs[instr.rs1].u64);
             
-            return false;
+            return;
         
         case Type::CUST_STRAP:
             pc += 4;
@@ -3558,7 +4068,7 @@ bool VirtualMachine::SingleStep() {
             else
                 RaiseSupervisorTrap(regs[instr.rs1].u64);
             
-            return false;
+            return;
 
         case Type::INVALID:
         default:
@@ -3582,20 +4092,274 @@ bool VirtualMachine::SingleStep() {
             if (inc_pc)
                 pc += 4;
     }
+}
+
+bool VirtualMachine::SingleStep() {
+    ticks++;
+    cycles++;
+
+    if (!HandlePendingInterrupts()) return false;
+
+    if (pc & 0b11) {
+        RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
+        return false;
+    }
 
-    if (IsBreakPoint(pc)) return true;
+    auto [translated_address, translation_valid] = TranslateMemoryAddress(pc, false, true);
+    if (!translation_valid) return false;
     
+    auto decoded = GetDecodedInstruction(translated_address);
+    if (!decoded) {
+        RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT, pc);
+        return false;
+    }
+
+    if (profiler)
+        profiler->Count(translated_address);
+
+    ExecuteInstruction(*decoded);
+
+    return IsDecodedBreakPoint(pc);
+}
+
+bool VirtualMachine::CompileHotBlock(DecodedBlock& block) {
+    // Generated code only knows RV64 semantics
+    if (Is32BitMode())
+        return false;
+
+    if (block.compiled)
+        return true;
+
+    if (++block.executions < JIT_THRESHOLD)
+        return false;
+
+    if (!jit) {
+        jit = JIT::Create(&VirtualMachine::JITFallback);
+
+        if (!jit) {
+            execution_engine = ExecutionEngine::Block;
+            return false;
+        }
+    }
+
+    std::vector<const RVInstruction*> instrs;
+    for (const auto& entry : block.entries)
+        instrs.push_back(entry.instr);
+
+    block.compiled = jit->Compile(instrs);
+
+    // The code cache is full, start over with the next block lookup
+    if (!block.compiled) {
+        flush_decoded_instructions = true;
+        return false;
+    }
+
+    compiled_blocks++;
+
+    return true;
+}
+
+size_t VirtualMachine::RunCompiledBlock(DecodedBlock& block, bool& diverted) {
+    static_assert(sizeof(Reg) == sizeof(Long));
+
+    jit_block = &block;
+    jit_block_pc = pc;
+    jit_diverted = false;
+
+    size_t executed = block.compiled(this, &regs[0].u64);
+
+    jit_block = nullptr;
+
+    ticks += executed - 1;
+    cycles += executed - 1;
+
+    if (jit_exception) {
+        auto exception = jit_exception;
+        jit_exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+
+    diverted = jit_diverted;
+
+    // Inlined instructions do not update the pc
+    if (!diverted && JIT::CanInline(*block.entries[executed - 1].instr))
+        pc = jit_block_pc + executed * sizeof(Word);
+
+    return executed;
+}
+
+bool VirtualMachine::JITFallback(void* context, size_t index) {
+    auto vm = static_cast<VirtualMachine*>(context);
+    const auto& entry = vm->jit_block->entries[index];
+
+    vm->pc = vm->jit_block_pc + index * sizeof(Word);
+    Address next_pc = vm->pc + 4;
+
+    // Exceptions cannot unwind through generated code
+    try {
+        (vm->*entry.handler)(*entry.instr);
+    }
+    catch (...) {
+        vm->jit_exception = std::current_exception();
+        vm->jit_diverted = true;
+        return true;
+    }
+
+    if (entry.is_branch)
+        return true;
+
+    if (vm->pc != next_pc || vm->IsDecodedCodeStale() || !vm->running) {
+        vm->jit_diverted = true;
+        return true;
+    }
+
+    return false;
+}
+
+bool VirtualMachine::StepBlocks(Long steps) {
+    DecodedBlock* previous = nullptr;
+    Long previous_epoch = 0;
+
+    while (steps > 0 && running) {
+        ticks++;
+        cycles++;
+
+        Address start_pc = pc;
+
+        if (!HandlePendingInterrupts()) {
+            // Asleep in WFI, Run waits for a wake up instead of spinning
+            if (waiting_for_interrupt)
+                return false;
+
+            steps--;
+            previous = nullptr;
+            continue;
+        }
+
+        if (pc != start_pc)
+            block_epoch++;
+
+        if (pc & 0b11) {
+            RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
+            block_epoch++;
+            steps--;
+            continue;
+        }
+
+        if (IsDecodedCodeStale())
+            FlushDecodedInstructions();
+        
+        if (previous && previous_epoch != block_epoch)
+            previous = nullptr;
+
+        DecodedBlock* block = previous ? previous->FindSuccessor(pc, block_epoch) : nullptr;
+
+        if (!block) {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(pc, false, true);
+            if (!translation_valid) {
+                block_epoch++;
+                steps--;
+                continue;
+            }
+
+            block = GetDecodedBlock(translated_address);
+            if (!block) {
+                RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT, pc);
+                block_epoch++;
+                steps--;
+                continue;
+            }
+
+            if (previous) {
+                size_t slot = previous->successors[0] && previous->successor_epochs[0] == block_epoch ? 1 : 0;
+                previous->successor_pcs[slot] = pc;
+                previous->successors[slot] = block;
+                previous->successor_epochs[slot] = block_epoch;
+            }
+        }
+
+        size_t count = std::min<size_t>(block->entries.size(), steps);
+        size_t executed = 0;
+        bool diverted = false;
+
+        if (execution_engine == ExecutionEngine::JIT && count == block->entries.size() && CompileHotBlock(*block))
+            executed = count = RunCompiledBlock(*block, diverted);
+
+        while (executed < count) {
+            if (executed != 0) {
+                ticks++;
+                cycles++;
+            }
+
+            const auto& entry = block->entries[executed++];
+            Address next_pc = pc + 4;
+
+            (this->*entry.handler)(*entry.instr);
+
+            if (entry.is_branch)
+                break;
+
+            if (pc != next_pc || IsDecodedCodeStale() || !running) {
+                diverted = true;
+                break;
+            }
+        }
+
+        steps -= executed;
+
+        if (profiler)
+            profiler->CountBlock(block->address, executed);
+
+        if (diverted || (block->ends_with_barrier && executed == block->entries.size())) {
+            block_epoch++;
+            previous = nullptr;
+        }
+        else {
+            previous = block;
+            previous_epoch = block_epoch;
+        }
+
+        if (IsDecodedBreakPoint(pc)) return true;
+    }
 
     return false;
 }
 
 bool VirtualMachine::Step(Long steps) {
+    // The host flags only belong to this hart while it runs, anything raised
+    // in between steps is not its own
+    feclearexcept(FE_ALL_EXCEPT);
+
+    Long start_cycles = cycles;
+
     try {
-        for (Long i = 0; i < steps; i++)
-            if (SingleStep())
-                return true;
+        bool hit_break_point = false;
+
+        if (execution_engine != ExecutionEngine::Interpreter && break_points.empty())
+            hit_break_point = StepBlocks(steps);
+        
+        else {
+            // A stopped hart, for example after ecall_exit, does not finish
+            // its slice
+            for (Long i = 0; i < steps && !hit_break_point && running; i++) {
+                hit_break_point = SingleStep();
+
+                // Asleep in WFI, Run waits for a wake up instead of spinning
+                if (waiting_for_interrupt)
+                    break;
+            }
+        }
+
+        AccrueFloatFlags();
+
+        if (timer->GetSource() == Timer::Source::Instructions)
+            timer->Retire(cycles - start_cycles);
+
+        return hit_break_point;
     }
     catch (std::exception& e) {
+        AccrueFloatFlags();
+
         VMException vm_e;
         vm_e.hart_id = csrs[CSR_MHARTID];
         
@@ -3619,27 +4383,35 @@ bool VirtualMachine::Step(Long steps) {
 
         throw vm_e;
     }
-    
-    return false;
 }
 
-void VirtualMachine::Run() {
-    while (running) {
-        if (paused) {
-#if defined(_WIN32) || defined(_WIN64)
-            SwitchToThread();
-#else
-            sched_yield();
-#endif
+void VirtualMachine::Run(Long max_cycles) {
+    while (running && cycles < max_cycles) {
+        if (waiting_for_interrupt && !paused)
+            timer->SkipToDeadline();
+
+        if (paused || waiting_for_interrupt)
+            WaitForWake();
         
-        }
-        else {
-            if (Step() && pause_on_break)
-                paused = true;
+        if (running && !paused && Step() && pause_on_break) {
+            paused = true;
+            UpdateIdle();
         }
     }
 }
 
+bool VirtualMachine::RunFor(Long steps) {
+    if (IsRunnable() && Step(steps) && pause_on_break) {
+        paused = true;
+        UpdateIdle();
+    }
+
+    if (waiting_for_interrupt && !paused)
+        timer->SkipToDeadline();
+
+    return IsRunnable();
+}
+
 void VirtualMachine::GetSnapshot(std::array<Reg, REGISTER_COUNT>& registers, std::array<Float, REGISTER_COUNT>& fregisters, Long& pc) {
     registers = regs;
     fregisters = fregs;
@@ -3647,11 +4419,16 @@ void VirtualMachine::GetSnapshot(std::array<Reg, REGISTER_COUNT>& registers, std
 }
 
 void VirtualMachine::GetCSRSnapshot(std::unordered_map<Long, Long>& csrs) const {
-    csrs = this->csrs;
+    csrs.clear();
+
+    for (Long csr = 0; csr < CSR_COUNT; csr++)
+        if (csr_handlers[csr].stored)
+            csrs[csr] = this->csrs[csr];
+    
     csrs[CSR_MCYCLE] = cycles;
     csrs[CSR_CYCLE] = cycles;
 
-    csrs[CSR_TIME] = csr_mapped_memory->time;
+    csrs[CSR_TIME] = timer->Time();
 
     csrs[CSR_MIP] = mip;
     csrs[CSR_MIE] = mie;
@@ -3665,6 +4442,64 @@ void VirtualMachine::GetCSRSnapshot(std::unordered_map<Long, Long>& csrs) const
     csrs[CSR_SATP] = satp.raw;
 }
 
+void VirtualMachine::SaveState(HartState& state) const {
+    state.regs = regs;
+    state.fregs = fregs;
+    state.csrs = csrs;
+
+    state.pc = pc;
+    state.cycles = cycles;
+
+    state.mip = mip;
+    state.mie = mie;
+    state.mideleg = mideleg;
+    state.sip = sip;
+    state.sie = sie;
+
+    state.mstatus = mstatus.raw;
+    state.sstatus = sstatus.raw;
+    state.satp = satp.raw;
+
+    state.privilege_level = static_cast<Byte>(privilege_level);
+    state.waiting_for_interrupt = waiting_for_interrupt;
+    state.paused = paused;
+}
+
+void VirtualMachine::RestoreState(const HartState& state) {
+    if (state.csrs[CSR_MHARTID] != csrs[CSR_MHARTID])
+        throw std::runtime_error(std::format("Cannot restore the state of hart {} into hart {}", state.csrs[CSR_MHARTID], csrs[CSR_MHARTID]));
+
+    regs = state.regs;
+    fregs = state.fregs;
+    csrs = state.csrs;
+
+    pc = state.pc;
+    cycles = state.cycles;
+
+    mip = state.mip;
+    mie = state.mie;
+    mideleg = state.mideleg;
+    sip = state.sip;
+    sie = state.sie;
+
+    mstatus.raw = state.mstatus;
+    sstatus.raw = state.sstatus;
+    satp.raw = state.satp;
+
+    privilege_level = static_cast<PrivilegeLevel>(state.privilege_level);
+    waiting_for_interrupt = state.waiting_for_interrupt;
+
+    UpdateDynamicRoundingMode();
+
+    FlushTLB(true, 0, true, 0);
+    flush_decoded_instructions = true;
+    block_epoch++;
+
+    paused = state.paused;
+    UpdateIdle();
+    Wake();
+}
+
 size_t VirtualMachine::GetInstructionsPerSecond() {
     double total_time = 0.0;
     Word total_ticks = 0;
@@ -3693,14 +4528,10 @@ bool VirtualMachine::IsBreakPoint(Address addr) {
     return instr.type == RVInstruction::Type::EBREAK;
 }
 
-void VirtualMachine::UpdateTime(double delta_time) {
+void VirtualMachine::UpdateStatistics(double delta_time) {
     history_delta.push_back(delta_time);
     history_tick.push_back(ticks);
     ticks = 0;
-    
-    csr_mapped_memory->time += static_cast<Long>(delta_time * CSRMappedMemory::TICKS_PER_SECOND);
-    if (csr_mapped_memory->time >= csr_mapped_memory->time_cmp)
-        RaiseInterrupt(INTERRUPT_MACHINE_TIMER);
 
     while (history_delta.size() > MAX_HISTORY) {
         history_delta.erase(history_delta.begin());
@@ -0,0 +1,99 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(AMOADD_W) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(0x2000, 0x1000);
+
+    auto target = Random<Address>(0x2000, 0x2ff0) & ~3;
+    // Bit 31 set, rd has to get it sign extended
+    auto old_value = Random<Word>(0, UINT32_MAX) | 0x80000000;
+    auto operand = Random<Word>(0, UINT32_MAX);
+
+    memory.WriteWord(target, old_value);
+
+    vm.GetRegister(5).Value().u64 = target;
+    vm.GetRegister(6).Value().u64 = operand;
+
+    memory.WriteWord(0x1000, RV64_R(RVInstruction::OP_ATOMIC, 10, RVInstruction::FUNCT3_ATOMIC, 5, 6, RVInstruction::FUNCT7_AMOADD_W));
+
+    STEP_VMS(1);
+
+    auto x10 = vm.GetRegister(10).Value().u64;
+    auto value = memory.ReadWord(target);
+    Word expected = old_value + operand;
+
+    auto expected_x10 = static_cast<Long>(static_cast<SWord>(old_value));
+
+    ASSERT(x10 == expected_x10, "AMOADD.W returned {:x}, expected {:x}", x10, expected_x10);
+    ASSERT(value == expected, "Wrong sum in memory. Expected {:x}, got {:x}", expected, value);
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(AMOMIN_W) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(0x2000, 0x1000);
+
+    auto target = Random<Address>(0x2000, 0x2ff0) & ~3;
+    auto old_value = Random<SWord>(INT32_MIN, INT32_MAX);
+    auto operand = Random<SWord>(INT32_MIN, INT32_MAX);
+
+    memory.WriteWord(target, static_cast<Word>(old_value));
+
+    vm.GetRegister(5).Value().u64 = target;
+    vm.GetRegister(6).Value().s64 = operand;
+
+    memory.WriteWord(0x1000, RV64_R(RVInstruction::OP_ATOMIC, 10, RVInstruction::FUNCT3_ATOMIC, 5, 6, RVInstruction::FUNCT7_AMOMIN_W));
+
+    STEP_VMS(1);
+
+    auto x10 = vm.GetRegister(10).Value().s64;
+    auto value = static_cast<SWord>(memory.ReadWord(target));
+    auto expected = std::min(old_value, operand);
+
+    ASSERT(x10 == old_value, "AMOMIN.W returned {}, expected {}", x10, old_value);
+    ASSERT(value == expected, "Wrong minimum in memory. Expected {}, got {}", expected, value);
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(AMO_W_SignExtend) {
+    const Byte operations[] = {
+        RVInstruction::FUNCT7_AMOSWAP_W, RVInstruction::FUNCT7_AMOADD_W, RVInstruction::FUNCT7_AMOXOR_W,
+        RVInstruction::FUNCT7_AMOAND_W, RVInstruction::FUNCT7_AMOOR_W, RVInstruction::FUNCT7_AMOMIN_W,
+        RVInstruction::FUNCT7_AMOMAX_W, RVInstruction::FUNCT7_AMOMINU_W, RVInstruction::FUNCT7_AMOMAXU_W
+    };
+
+    for (auto funct7 : operations) {
+        SETUP_MEMORY;
+        SETUP_VM(0x1000);
+
+        ADD_RAM(0x1000, 0x1000);
+        ADD_RAM(0x2000, 0x1000);
+
+        auto target = Random<Address>(0x2000, 0x2ff0) & ~3;
+        auto old_value = Random<Word>(0, UINT32_MAX) | 0x80000000;
+
+        memory.WriteWord(target, old_value);
+
+        vm.GetRegister(5).Value().u64 = target;
+        vm.GetRegister(6).Value().u64 = Random<Word>(0, UINT32_MAX);
+
+        memory.WriteWord(0x1000, RV64_R(RVInstruction::OP_ATOMIC, 10, RVInstruction::FUNCT3_ATOMIC, 5, 6, funct7));
+
+        STEP_VMS(1);
+
+        auto x10 = vm.GetRegister(10).Value().u64;
+        auto expected = static_cast<Long>(static_cast<SWord>(old_value));
+
+        ASSERT(x10 == expected, "AMO with funct7 {:x} returned {:x}, expected {:x}", funct7, x10, expected);
+    }
+
+    SUCCESS;
+}
@@ -0,0 +1,115 @@
+#include "Test.hpp"
+
+constexpr size_t RANDOM_WORDS = 1 << 16;
+constexpr size_t STREAM_REPETITIONS = 4096;
+
+// Assembled from a few typical routines: copy and string loops, a floating
+// point dot product, a hash, a trap handler and a spin lock
+constexpr Word STREAM[] = {
+    // memcpy
+    0x02060063, // beqz a2, 0x20
+    0x00050693, // mv a3, a0
+    0x0005c703, // lbu a4, 0(a1)
+    0x00e68023, // sb a4, 0(a3)
+    0x00158593, // addi a1, a1, 1
+    0x00168693, // addi a3, a3, 1
+    0xfff60613, // addi a2, a2, -1
+    0xfe0616e3, // bnez a2, 0x8
+    0x00008067, // ret
+
+    // strlen
+    0x00050593, // mv a1, a0
+    0x0005c603, // lbu a2, 0(a1)
+    0x00158593, // addi a1, a1, 1
+    0xfe061ce3, // bnez a2, 0x28
+    0x40a58533, // sub a0, a1, a0
+    0xfff50513, // addi a0, a0, -1
+    0x00008067, // ret
+
+    // dot
+    0xfe010113, // addi sp, sp, -32
+    0x00113c23, // sd ra, 24(sp)
+    0x00813823, // sd s0, 16(sp)
+    0xf2000553, // fmv.d.x fa0, zero
+    0x00053587, // fld fa1, 0(a0)
+    0x0005b607, // fld fa2, 0(a1)
+    0x52c5f543, // fmadd.d fa0, fa1, fa2, fa0
+    0x00850513, // addi a0, a0, 8
+    0x00858593, // addi a1, a1, 8
+    0xfff6061b, // addiw a2, a2, -1
+    0xfec044e3, // bgtz a2, 0x50
+    0x01013403, // ld s0, 16(sp)
+    0x01813083, // ld ra, 24(sp)
+    0x02010113, // addi sp, sp, 32
+    0x00008067, // ret
+
+    // hash
+    0x010007b7, // lui a5, 4096
+    0x1937879b, // addiw a5, a5, 403
+    0x00000593, // li a1, 0
+    0x00054603, // lbu a2, 0(a0)
+    0x00060e63, // beqz a2, 0xa8
+    0x00c5c5b3, // xor a1, a1, a2
+    0x02f585bb, // mulw a1, a1, a5
+    0x02059693, // slli a3, a1, 32
+    0x0206d693, // srli a3, a3, 32
+    0x00150513, // addi a0, a0, 1
+    0xfe5ff06f, // j 0x88
+    0x00068513, // mv a0, a3
+    0x00008067, // ret
+
+    // trap
+    0x34011173, // csrrw sp, mscratch, sp
+    0x00513023, // sd t0, 0(sp)
+    0x342022f3, // csrr t0, mcause
+    0x0002c863, // bltz t0, 0xcc
+    0x341022f3, // csrr t0, mepc
+    0x00428293, // addi t0, t0, 4
+    0x34129073, // csrw mepc, t0
+    0x00013283, // ld t0, 0(sp)
+    0x34011173, // csrrw sp, mscratch, sp
+    0x30200073, // mret
+
+    // lock
+    0x00100293, // li t0, 1
+    0x0c55232f, // amoswap.w.aq t1, t0, (a0)
+    0xfe031ee3, // bnez t1, 0xdc
+    0x0ff0000f, // fence
+    0x00052023, // sw zero, 0(a0)
+    0x00000397, // auipc t2, 0
+    0x00008067, // ret
+};
+
+DEFINE_BENCHMARK(DecodeRandom) {
+    static std::vector<Word> words;
+
+    if (words.empty()) {
+        words.reserve(RANDOM_WORDS);
+
+        for (size_t i = 0; i < RANDOM_WORDS; i++)
+            words.push_back(static_cast<Word>(RandomInt()));
+    }
+
+    size_t checksum = 0;
+    for (auto word : words) {
+        auto instr = RVInstruction::FromUInt32(word);
+        checksum += static_cast<size_t>(instr.type) + instr.rd;
+    }
+
+    BenchmarkKeep(checksum);
+    return words.size();
+}
+
+DEFINE_BENCHMARK(DecodeStream) {
+    size_t checksum = 0;
+
+    for (size_t i = 0; i < STREAM_REPETITIONS; i++) {
+        for (auto word : STREAM) {
+            auto instr = RVInstruction::FromUInt32(word);
+            checksum += static_cast<size_t>(instr.type) + instr.rd;
+        }
+    }
+
+    BenchmarkKeep(checksum);
+    return STREAM_REPETITIONS * std::size(STREAM);
+}
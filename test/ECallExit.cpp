@@ -0,0 +1,62 @@
+#include "Test.hpp"
+
+#include <Lockstep.hpp>
+#include <Scheduler.hpp>
+
+// The handler index front ends register ecall_exit under
+constexpr Long ECALL_EXIT = -1ULL;
+
+// a0 = exit, a1 = 7, ecall, then count in x12 forever. Nothing after the
+// ecall may run once the handler stopped the hart.
+static bool RunUntilExit(int mode, Long& cycles, Long& exit_code, Long& x12) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, VirtualMachine::REG_A0, RVInstruction::FUNCT3_ADDI, 0, -1));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, VirtualMachine::REG_A1, RVInstruction::FUNCT3_ADDI, 0, 7));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 12, RVInstruction::FUNCT3_ADDI, 12, 1));
+    memory.WriteWord(0x1010, RV64_J(RVInstruction::OP_JAL, 0, -4));
+
+    exit_code = 0;
+
+    VirtualMachine::RegisterECall(ECALL_EXIT, [&](Hart, bool, Memory&, auto& regs, auto&) {
+        exit_code = regs[VirtualMachine::REG_A1].u64;
+        vm.Stop();
+    });
+
+    if (mode == 0)
+        vm.Step(1000);
+
+    else if (mode == 1)
+        Lockstep(memory, {&vm}).Run();
+
+    else
+        Scheduler({&vm}, 1).Run();
+
+    // The handler must not outlive the hart it stops
+    VirtualMachine::RegisterECall(ECALL_EXIT, [](Hart, bool, Memory&, auto&, auto&) {});
+
+    cycles = vm.GetCycles();
+    x12 = vm.GetRegister(12).Value().u64;
+
+    return !vm.IsRunning();
+}
+
+DEFINE_TESTCASE(ECallExitStopsSlice) {
+    const char* modes[] = { "Step", "Lockstep", "Scheduler" };
+
+    for (int mode = 0; mode < 3; mode++) {
+        Long cycles, exit_code, x12;
+        bool stopped = RunUntilExit(mode, cycles, exit_code, x12);
+
+        ASSERT(stopped, "{}: hart still running after ecall_exit", modes[mode]);
+        ASSERT(exit_code == 7, "{}: exit code is {}, expected 7", modes[mode], exit_code);
+        ASSERT(cycles == 3, "{}: counted {} instructions at exit, expected 3", modes[mode], cycles);
+        ASSERT(x12 == 0, "{}: ran {} instructions past ecall_exit", modes[mode], x12);
+    }
+
+    SUCCESS;
+}
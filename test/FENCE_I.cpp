@@ -0,0 +1,60 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(FENCE_I) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto old_imm = Random<Word>(0, 0x7ff);
+    auto new_imm = Random<Word>(0, 0x7ff);
+    if (new_imm == old_imm)
+        new_imm ^= 1;
+
+    auto sel_rd = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+    auto sel_rs1 = sel_rd % (VirtualMachine::REGISTER_COUNT - 1) + 1;
+    auto sel_rs2 = sel_rs1 % (VirtualMachine::REGISTER_COUNT - 1) + 1;
+
+    auto& rs1 = vm.GetRegister(sel_rs1).Value();
+    auto& rs2 = vm.GetRegister(sel_rs2).Value();
+    auto& rd = vm.GetRegister(sel_rd).Value();
+
+    rs1.u64 = 0x1008;
+    rs2.u64 = RV64_I(
+        RVInstruction::OP_MATH_IMMEDIATE,
+        sel_rd,
+        RVInstruction::FUNCT3_ADDI,
+        0,
+        new_imm
+    );
+
+    memory.WriteWord(0x1000, RV64_S(
+        RVInstruction::OP_STORE,
+        RVInstruction::FUNCT3_SW,
+        sel_rs1,
+        sel_rs2,
+        0
+    ));
+
+    memory.WriteWord(0x1004, RV64_I(
+        RVInstruction::OP_FENCE,
+        0,
+        RVInstruction::FUNCT3_FENCE_I,
+        0,
+        0
+    ));
+
+    memory.WriteWord(0x1008, RV64_I(
+        RVInstruction::OP_MATH_IMMEDIATE,
+        sel_rd,
+        RVInstruction::FUNCT3_ADDI,
+        0,
+        old_imm
+    ));
+
+    STEP_VMS(3);
+
+    ASSERT(rd.u64 == new_imm, " Stale instruction executed after FENCE.I. Expected {:x}, got {:x}", new_imm, rd.u64);
+
+    SUCCESS;
+}
@@ -0,0 +1,39 @@
+#include "Test.hpp"
+
+#include <cmath>
+
+DEFINE_TESTCASE(FFLAGS) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto FloatOp = [](Byte funct5, Byte rd, Byte rs1, Byte rs2) {
+        return RV64_R(RVInstruction::OP_FLOAT, rd, RVInstruction::RM_DYNAMIC, rs1, rs2, (funct5 << 2) | RVInstruction::FUNCT2_D);
+    };
+
+    vm.GetFloatRegister(2).Value().d = Random<Long>(1, 1000);
+    vm.GetFloatRegister(3).Value().d = 0.0;
+
+    // The flags of the division accrue across the exact add that follows
+    memory.WriteWord(0x1000, FloatOp(RVInstruction::FUNCT5_FDIV, 1, 2, 3));
+    memory.WriteWord(0x1004, FloatOp(RVInstruction::FUNCT5_FADD, 4, 2, 2));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_CSR, 10, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FFLAGS));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_CSR, 11, RVInstruction::FUNCT3_CSRRW, 0, VirtualMachine::CSR_FFLAGS));
+    memory.WriteWord(0x1010, RV64_I(RVInstruction::OP_CSR, 12, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FFLAGS));
+
+    for (size_t i = 0; i < 5; i++)
+        STEP_VMS(1);
+
+    auto f1 = vm.GetFloatRegister(1).Value().d;
+    auto x10 = vm.GetRegister(10).Value().u64;
+    auto x11 = vm.GetRegister(11).Value().u64;
+    auto x12 = vm.GetRegister(12).Value().u64;
+
+    ASSERT(std::isinf(f1) && f1 > 0, "Division by zero should give infinity, got {}", f1);
+    ASSERT(x10 == VirtualMachine::CSR_FCSR_DZ, "Expected only the divide by zero flag, got {:b}", x10);
+    ASSERT(x11 == VirtualMachine::CSR_FCSR_DZ, "CSRRW returned flags {:b}", x11);
+    ASSERT(x12 == 0, "Flags were not cleared by the write, got {:b}", x12);
+
+    SUCCESS;
+}
@@ -0,0 +1,41 @@
+#include "Test.hpp"
+
+constexpr Address FLOAT_CODE = 0x1000;
+constexpr size_t FLOAT_STEPS = 1 << 20;
+
+static Word FloatOp(Byte funct5, Byte rd, Byte rs1, Byte rs2, Byte rm) {
+    return RV64_R(RVInstruction::OP_FLOAT, rd, rm, rs1, rs2, (funct5 << 2) | RVInstruction::FUNCT2_D);
+}
+
+// Arithmetic in the dynamic rounding mode followed by a truncating convert,
+// like compiled code that casts its result to an integer
+static VirtualMachine& SetupFloat(Memory& memory, std::vector<VirtualMachine>& vms) {
+    memory.AddMemoryRegion(MemoryMappedRAM::Create(FLOAT_CODE, 0x1000));
+
+    vms.emplace_back(VirtualMachine(memory, FLOAT_CODE, 0));
+    auto& vm = vms[0];
+    vm.SetExecutionEngine(__Benchmark::execution_engine);
+    vm.Start();
+
+    vm.GetFloatRegister(1).Value().d = 0.0;
+    vm.GetFloatRegister(2).Value().d = 0.5;
+    vm.GetFloatRegister(3).Value().d = 1.0;
+
+    memory.WriteWord(FLOAT_CODE + 0x00, FloatOp(RVInstruction::FUNCT5_FMUL, 1, 1, 2, RVInstruction::RM_DYNAMIC));
+    memory.WriteWord(FLOAT_CODE + 0x04, FloatOp(RVInstruction::FUNCT5_FADD, 1, 1, 3, RVInstruction::RM_DYNAMIC));
+    memory.WriteWord(FLOAT_CODE + 0x08, FloatOp(RVInstruction::FUNCT5_FMUL, 4, 1, 1, RVInstruction::RM_DYNAMIC));
+    memory.WriteWord(FLOAT_CODE + 0x0c, FloatOp(RVInstruction::FUNCT5_FSUB, 4, 4, 3, RVInstruction::RM_DYNAMIC));
+    memory.WriteWord(FLOAT_CODE + 0x10, FloatOp(RVInstruction::FUNCT5_FCVT_W, 10, 4, RVInstruction::RS2_FCVT_W, RVInstruction::RM_ROUND_TO_ZERO));
+    memory.WriteWord(FLOAT_CODE + 0x14, RV64_J(RVInstruction::OP_JAL, 0, static_cast<Word>(-20)));
+
+    return vm;
+}
+
+DEFINE_BENCHMARK(GuestFloat) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupFloat(memory, vms);
+
+    vm.Step(FLOAT_STEPS);
+    return FLOAT_STEPS;
+}
@@ -0,0 +1,92 @@
+#include "Test.hpp"
+
+#include <ForkRunner.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+
+DEFINE_TESTCASE(ForkRunner) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, 1));
+    memory.WriteWord(0x1004, RV64_J(RVInstruction::OP_JAL, 0, -4));
+    memory.WriteLong(0x1800, 1);
+
+    constexpr size_t CHILDREN = 4;
+
+    // Every child continues the same hart with its own input and its own
+    // copy of memory
+    auto results = ForkRunner::Run(CHILDREN, [&](size_t child) {
+        vm.GetRegister(10).Value().u64 = child * 1000;
+        memory.WriteLong(0x1800, child);
+
+        STEP_VMS(100);
+
+        if (child == CHILDREN - 1)
+            throw std::runtime_error("failed on purpose");
+
+        return std::format("{} {}", vm.GetRegister(10).Value().u64, memory.ReadLong(0x1800));
+    }, 2);
+
+    ASSERT(results.size() == CHILDREN, "Got {} results for {} children", results.size(), CHILDREN);
+
+    for (size_t i = 0; i < CHILDREN - 1; i++) {
+        auto expected = std::format("{} {}", i * 1000 + 50, i);
+
+        ASSERT(results[i].completed, "Child {} did not complete: {}", i, results[i].output);
+        ASSERT(results[i].output == expected, "Child {} reported {}, expected {}", i, results[i].output, expected);
+    }
+
+    ASSERT(!results[CHILDREN - 1].completed, "Throwing child was reported as completed");
+    ASSERT(results[CHILDREN - 1].output == "failed on purpose", "Throwing child reported {}", results[CHILDREN - 1].output);
+
+    ASSERT(memory.ReadLong(0x1800) == 1, "A child's store reached the parent");
+    ASSERT(vm.GetRegister(10).Value().u64 == 0, "A child's register reached the parent");
+
+    SUCCESS;
+}
+
+// Child 0 only finishes once the last child ran, which needs the slots of
+// the children after it to be reused while it is still running
+DEFINE_TESTCASE(ForkRunnerSlowChild) {
+    constexpr size_t CHILDREN = 4;
+
+    auto path = std::filesystem::temp_directory_path() / std::format("rv64_fork_runner_test_{}", Random<Long>(0, 1ULL << 62));
+
+    auto results = ForkRunner::Run(CHILDREN, [&](size_t child) -> std::string {
+        if (child == CHILDREN - 1) {
+            std::ofstream file(path);
+            return "last";
+        }
+
+        if (child != 0)
+            return "fast";
+
+        for (int i = 0; i < 500; i++) {
+            if (std::filesystem::exists(path))
+                return "released";
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        return "timed out";
+    }, 2);
+
+    std::filesystem::remove(path);
+
+    ASSERT(results[0].output == "released", "Slow child reported {}, the last child did not run beside it", results[0].output);
+
+    for (size_t i = 1; i < CHILDREN; i++)
+        ASSERT(results[i].completed, "Child {} did not complete: {}", i, results[i].output);
+
+    SUCCESS;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include "Test.hpp"
+
+#include <InputLog.hpp>
+#include <Lockstep.hpp>
+#include <Timer.hpp>
+
+#include <filesystem>
+
+DEFINE_TESTCASE(InputLogReplay) {
+    auto path = (std::filesystem::temp_directory_path() / "rv64_input_log_test.bin").string();
+
+    InputLog::Header header = { 3, Random<Long>(1, 100000), Random<Long>(0, 1ULL << 62), Random<Long>(0, 1ULL << 62) };
+
+    // An empty line is an input too, unlike the end of stdin
+    std::vector<std::optional<std::string>> lines = { "hello", std::string(), std::string(300, 'x'), std::nullopt };
+    std::vector<Long> cycles = { 0, Random<Long>(1, 1000), Random<Long>(0, 1ULL << 62), 1ULL << 63 };
+
+    {
+        auto log = InputLog::Record(path, header);
+
+        for (size_t i = 0; i < lines.size(); i++)
+            log->Log(InputLog::Event::ConsoleInput, i % header.cores, cycles[i], [&]() { return lines[i]; });
+    }
+
+    auto log = InputLog::Replay(path);
+
+    ASSERT(log->IsReplaying(), "Loaded log is not replaying");
+    ASSERT(log->GetHeader().quantum == header.quantum && log->GetHeader().seed == header.seed && log->GetHeader().time == header.time, "Header changed on the way through the file");
+    ASSERT(log->GetRemaining() == lines.size(), "Log holds {} inputs, expected {}", log->GetRemaining(), lines.size());
+
+    bool asked = false;
+    auto read = [&]() -> std::optional<std::string> { asked = true; return "host"; };
+
+    for (size_t i = 0; i < lines.size() - 1; i++) {
+        auto line = log->Log(InputLog::Event::ConsoleInput, i % header.cores, cycles[i], read);
+        ASSERT(line == lines[i], "Input {} changed on the way through the file", i);
+    }
+
+    ASSERT(!asked, "Replay read from the host");
+
+    bool diverged = false;
+    try {
+        log->Log(InputLog::Event::ConsoleInput, 1, cycles.back(), read);
+    }
+    catch (std::runtime_error&) {
+        diverged = true;
+    }
+
+    std::filesystem::remove(path);
+
+    ASSERT(diverged, "Replay accepted an input from the wrong hart");
+
+    SUCCESS;
+}
+
+constexpr Long ECALL_READ_LINE = 0x100;
+
+// Reads time into x12, a line through the log into a0 and time again into
+// x13. A recording starts at time, a replay at the time in its header.
+static std::array<Long, 3> RunTimeGuest(InputLog& log, Long time) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 12, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_TIME));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, VirtualMachine::REG_A0, RVInstruction::FUNCT3_ADDI, 0, ECALL_READ_LINE));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_CSR, 13, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_TIME));
+    memory.WriteWord(0x1010, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    auto timer = Timer::Get(memory);
+    timer->SetSource(Timer::Source::Instructions, log.IsReplaying() ? log.GetHeader().time : time);
+
+    VirtualMachine::RegisterECall(ECALL_READ_LINE, [&](Hart hart, bool, Memory&, auto& regs, auto&) {
+        auto line = log.Log(InputLog::Event::ConsoleInput, hart, vm.GetCycles(), []() -> std::optional<std::string> { return "line"; });
+        regs[VirtualMachine::REG_A0].u64 = line ? line->size() : -1ULL;
+    });
+
+    Lockstep(memory, {&vm}).Run(100);
+
+    VirtualMachine::RegisterECall(ECALL_READ_LINE, [](Hart, bool, Memory&, auto&, auto&) {});
+
+    return { vm.GetRegister(VirtualMachine::REG_A0).Value().u64, vm.GetRegister(12).Value().u64, vm.GetRegister(13).Value().u64 };
+}
+
+DEFINE_TESTCASE(InputLogReplayTime) {
+    auto path = (std::filesystem::temp_directory_path() / "rv64_input_log_time_test.bin").string();
+
+    // As if the recording continued from a snapshot, mtime is not 0
+    auto time = Random<Long>(1, 1ULL << 40);
+
+    std::array<Long, 3> recorded;
+    {
+        auto log = InputLog::Record(path, { 1, Lockstep::QUANTUM, 0, time });
+        recorded = RunTimeGuest(*log, time);
+    }
+
+    auto log = InputLog::Replay(path);
+    auto replayed = RunTimeGuest(*log, 0);
+
+    std::filesystem::remove(path);
+
+    ASSERT(recorded[0] == 4, "Guest read {} bytes, expected 4", recorded[0]);
+    ASSERT(recorded[1] == time, "Recording read time {}, expected {}", recorded[1], time);
+
+    for (size_t i = 0; i < recorded.size(); i++)
+        ASSERT(recorded[i] == replayed[i], "Replay differs at {}: {} and {}", i, recorded[i], replayed[i]);
+
+    ASSERT(log->GetRemaining() == 0, "Replay left {} inputs", log->GetRemaining());
+
+    SUCCESS;
+}
@@ -0,0 +1,40 @@
+#include "Test.hpp"
+
+// Runs a loop often enough to cross the compile threshold. Only the JIT
+// engine may translate it, and the compiled block has to count the same
+// as the interpreter.
+DEFINE_TESTCASE(JITHotBlock) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Long LOOPS = 1000;
+    constexpr SWord STEP = 3;
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 11, RVInstruction::FUNCT3_ADDI, 0, LOOPS));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, STEP));
+    memory.WriteWord(0x1008, RV64_R(RVInstruction::OP_MATH, 12, RVInstruction::FUNCT3_XOR_DIV, 12, 10, RVInstruction::FUNCT7_XOR));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 13, RVInstruction::FUNCT3_ADDI, 13, 1));
+    memory.WriteWord(0x1010, RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BLT, 13, 11, -12));
+    memory.WriteWord(0x1014, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    STEP_VMS(1 + 4 * LOOPS);
+
+    Long x10 = 0, x12 = 0;
+    for (Long i = 0; i < LOOPS; i++) {
+        x10 += STEP;
+        x12 ^= x10;
+    }
+
+    ASSERT(vm.GetPC() == 0x1014, "Loop ended at {:x}, expected 0x1014", vm.GetPC());
+    ASSERT(vm.GetRegister(10).Value().u64 == x10, "x10 is {}, expected {}", vm.GetRegister(10).Value().u64, x10);
+    ASSERT(vm.GetRegister(12).Value().u64 == x12, "x12 is {}, expected {}", vm.GetRegister(12).Value().u64, x12);
+
+    bool jit = __TestCase::execution_engine == VirtualMachine::ExecutionEngine::JIT && JIT::IsSupported();
+
+    ASSERT(!jit || vm.GetCompiledBlocks() != 0, "The hot loop never ran as compiled code");
+    ASSERT(jit || vm.GetCompiledBlocks() == 0, "Compiled {} blocks without the JIT engine", vm.GetCompiledBlocks());
+
+    SUCCESS;
+}
@@ -0,0 +1,233 @@
+#include "Test.hpp"
+
+#include <thread>
+#include <utility>
+
+constexpr Address KERNEL_RAM = 0x1000;
+constexpr Address KERNEL_RAM_SIZE = 8 * 1024 * 1024;
+
+constexpr Address KERNEL_ROOT_TABLE = 0x2000;
+constexpr Address KERNEL_CODE = 0x3000;
+constexpr Address KERNEL_SOURCE = 0x100000;
+constexpr Address KERNEL_TARGET = 0x200000;
+constexpr Address KERNEL_PAGES = 0x400000;
+
+constexpr Long KERNEL_COPY_BYTES = 64 * 1024;
+constexpr Long KERNEL_PAGES_BYTES = 4 * 1024 * 1024;
+
+constexpr size_t KERNEL_STEPS = 1 << 20;
+constexpr Hart KERNEL_AMO_HARTS = 4;
+
+using KernelRegisters = std::vector<std::pair<Byte, Long>>;
+
+static Word Op(Word funct3, Byte rd, Byte rs1, Byte rs2, Word funct7 = 0) {
+    return RV64_R(RVInstruction::OP_MATH, rd, funct3, rs1, rs2, funct7);
+}
+
+static Word OpImm(Word funct3, Byte rd, Byte rs1, Word imm) {
+    return RV64_I(RVInstruction::OP_MATH_IMMEDIATE, rd, funct3, rs1, imm);
+}
+
+static Word Branch(Word funct3, Byte rs1, Byte rs2, SWord offset) {
+    return RV64_B(RVInstruction::OP_BRANCH, funct3, rs1, rs2, static_cast<Word>(offset));
+}
+
+static Word Jump(SWord offset) {
+    return RV64_J(RVInstruction::OP_JAL, 0, static_cast<Word>(offset));
+}
+
+static Word FloatOp(Byte funct5, Byte rd, Byte rs1, Byte rs2) {
+    return RV64_R(RVInstruction::OP_FLOAT, rd, RVInstruction::RM_DYNAMIC, rs1, rs2, (funct5 << 2) | RVInstruction::FUNCT2_D);
+}
+
+// Every hart starts at the kernel in machine mode. With paged set the
+// harts first drop to supervisor mode with Sv39 on, through an identity
+// mapped giga page split into 4 KiB TLB entries.
+static std::vector<VirtualMachine>& SetupKernel(Memory& memory, std::vector<VirtualMachine>& vms, const std::vector<Word>& code, const KernelRegisters& registers, Hart harts = 1, bool paged = false) {
+    memory.AddMemoryRegion(MemoryMappedRAM::Create(KERNEL_RAM, KERNEL_RAM_SIZE));
+
+    Address start = paged ? KERNEL_RAM : KERNEL_CODE;
+
+    for (Hart hart = 0; hart < harts; hart++) {
+        vms.emplace_back(VirtualMachine(memory, start, hart));
+        vms.back().SetExecutionEngine(__Benchmark::execution_engine);
+        vms.back().Start();
+    }
+
+    for (size_t i = 0; i < code.size(); i++)
+        memory.WriteWord(KERNEL_CODE + i * sizeof(Word), code[i]);
+
+    for (auto& vm : vms)
+        for (auto [reg, value] : registers)
+            vm.GetRegister(reg).Value().u64 = value;
+
+    if (paged) {
+        constexpr Long PTE_VRWXAD = 0b11001111;
+        memory.WriteLong(KERNEL_ROOT_TABLE, PTE_VRWXAD);
+
+        for (auto& vm : vms) {
+            vm.GetRegister(28).Value().u64 = (8ULL << 60) | (KERNEL_ROOT_TABLE >> 12);
+            vm.GetRegister(29).Value().u64 = 0b01 << 11;
+            vm.GetRegister(30).Value().u64 = KERNEL_CODE;
+        }
+
+        memory.WriteWord(KERNEL_RAM + 0x0, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 28, VirtualMachine::CSR_SATP));
+        memory.WriteWord(KERNEL_RAM + 0x4, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 29, VirtualMachine::CSR_MSTATUS));
+        memory.WriteWord(KERNEL_RAM + 0x8, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 30, VirtualMachine::CSR_MEPC));
+        memory.WriteWord(KERNEL_RAM + 0xc, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_MRET));
+
+        for (auto& vm : vms)
+            vm.Step(4);
+    }
+
+    return vms;
+}
+
+// Dependent integer arithmetic with no memory accesses
+DEFINE_BENCHMARK(GuestALU) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupKernel(memory, vms, {
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 5, 5, 6),                                    // add x5, x5, x6
+        Op(RVInstruction::FUNCT3_XOR_DIV, 6, 6, 5),                                        // xor x6, x6, x5
+        OpImm(RVInstruction::FUNCT3_SLLI, 7, 5, 3),                                        // slli x7, x5, 3
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 8, 7, 6, RVInstruction::FUNCT7_SUB),         // sub x8, x7, x6
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 9, 8, 5, RVInstruction::FUNCT7_MUL),         // mul x9, x8, x5
+        OpImm(RVInstruction::FUNCT3_SHIFT_RIGHT_IMMEDIATE, 10, 9, 7),                      // srli x10, x9, 7
+        Op(RVInstruction::FUNCT3_OR_REM, 5, 5, 10),                                        // or x5, x5, x10
+        OpImm(RVInstruction::FUNCT3_ANDI, 11, 5, 0x7ff),                                   // andi x11, x5, 0x7ff
+        Jump(-32),                                                                         // j 0
+    }, {{5, 1}, {6, 0x9e3779b97f4a7c15}})[0];
+
+    vm.Step(KERNEL_STEPS);
+    return KERNEL_STEPS;
+}
+
+// Pseudo random data dependent branches, taken about half of the time
+DEFINE_BENCHMARK(GuestBranches) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupKernel(memory, vms, {
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 5, 5, 6, RVInstruction::FUNCT7_MUL),         // mul x5, x5, x6
+        OpImm(RVInstruction::FUNCT3_ADDI, 5, 5, 1),                                        // addi x5, x5, 1
+        OpImm(RVInstruction::FUNCT3_SHIFT_RIGHT_IMMEDIATE, 7, 5, 33),                      // srli x7, x5, 33
+        OpImm(RVInstruction::FUNCT3_ANDI, 8, 7, 1),                                        // andi x8, x7, 1
+        Branch(RVInstruction::FUNCT3_BEQ, 8, 0, 12),                                       // beqz x8, 0x1c
+        OpImm(RVInstruction::FUNCT3_ADDI, 9, 9, 1),                                        // addi x9, x9, 1
+        Jump(8),                                                                           // j 0x20
+        OpImm(RVInstruction::FUNCT3_ADDI, 10, 10, 1),                                      // addi x10, x10, 1
+        OpImm(RVInstruction::FUNCT3_ANDI, 8, 7, 2),                                        // andi x8, x7, 2
+        Branch(RVInstruction::FUNCT3_BNE, 8, 0, 8),                                        // bnez x8, 0x2c
+        Op(RVInstruction::FUNCT3_XOR_DIV, 9, 9, 10),                                       // xor x9, x9, x10
+        Branch(RVInstruction::FUNCT3_BLT, 9, 10, 8),                                       // blt x9, x10, 0x34
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 9, 9, 10, RVInstruction::FUNCT7_SUB),        // sub x9, x9, x10
+        Jump(-52),                                                                         // j 0
+    }, {{5, 1}, {6, 6364136223846793005}})[0];
+
+    vm.Step(KERNEL_STEPS);
+    return KERNEL_STEPS;
+}
+
+// Copies 64 KiB a double word at a time, over and over
+DEFINE_BENCHMARK(GuestMemcpy) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupKernel(memory, vms, {
+        OpImm(RVInstruction::FUNCT3_ADDI, 13, 10, 0),                                      // mv x13, x10
+        OpImm(RVInstruction::FUNCT3_ADDI, 14, 11, 0),                                      // mv x14, x11
+        OpImm(RVInstruction::FUNCT3_ADDI, 15, 12, 0),                                      // mv x15, x12
+        RV64_I(RVInstruction::OP_LOAD, 16, RVInstruction::FUNCT3_LD, 13, 0),               // ld x16, 0(x13)
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 14, 16, 0),              // sd x16, 0(x14)
+        OpImm(RVInstruction::FUNCT3_ADDI, 13, 13, 8),                                      // addi x13, x13, 8
+        OpImm(RVInstruction::FUNCT3_ADDI, 14, 14, 8),                                      // addi x14, x14, 8
+        OpImm(RVInstruction::FUNCT3_ADDI, 15, 15, static_cast<Word>(-8)),                  // addi x15, x15, -8
+        Branch(RVInstruction::FUNCT3_BNE, 15, 0, -20),                                     // bnez x15, 0xc
+        Jump(-36),                                                                         // j 0
+    }, {{10, KERNEL_SOURCE}, {11, KERNEL_TARGET}, {12, KERNEL_COPY_BYTES}})[0];
+
+    vm.Step(KERNEL_STEPS);
+    return KERNEL_STEPS;
+}
+
+// Fills 64 KiB a double word at a time, over and over
+DEFINE_BENCHMARK(GuestMemset) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupKernel(memory, vms, {
+        OpImm(RVInstruction::FUNCT3_ADDI, 14, 11, 0),                                      // mv x14, x11
+        OpImm(RVInstruction::FUNCT3_ADDI, 15, 12, 0),                                      // mv x15, x12
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 14, 17, 0),              // sd x17, 0(x14)
+        OpImm(RVInstruction::FUNCT3_ADDI, 14, 14, 8),                                      // addi x14, x14, 8
+        OpImm(RVInstruction::FUNCT3_ADDI, 15, 15, static_cast<Word>(-8)),                  // addi x15, x15, -8
+        Branch(RVInstruction::FUNCT3_BNE, 15, 0, -12),                                     // bnez x15, 0x8
+        Jump(-24),                                                                         // j 0
+    }, {{11, KERNEL_TARGET}, {12, KERNEL_COPY_BYTES}, {17, 0x0101010101010101}})[0];
+
+    vm.Step(KERNEL_STEPS);
+    return KERNEL_STEPS;
+}
+
+static VirtualMachine& SetupFloatKernel(Memory& memory, std::vector<VirtualMachine>& vms) {
+    auto& vm = SetupKernel(memory, vms, {
+        RV64_R4(RVInstruction::OP_FMADD, 1, RVInstruction::RM_DYNAMIC, 2, 1, RVInstruction::FUNCT2_D, 3), // fmadd.d f1, f2, f1, f3
+        FloatOp(RVInstruction::FUNCT5_FDIV, 4, 1, 3),                                      // fdiv.d f4, f1, f3
+        FloatOp(RVInstruction::FUNCT5_FSQRT, 5, 4, RVInstruction::RS2_FSQRT),              // fsqrt.d f5, f4
+        RV64_I(RVInstruction::OP_FL, 6, RVInstruction::FUNCT3_FLD, 10, 0),                 // fld f6, 0(x10)
+        FloatOp(RVInstruction::FUNCT5_FADD, 6, 6, 5),                                      // fadd.d f6, f6, f5
+        RV64_S(RVInstruction::OP_FS, RVInstruction::FUNCT3_FSD, 10, 6, 0),                 // fsd f6, 0(x10)
+        Jump(-24),                                                                         // j 0
+    }, {{10, KERNEL_TARGET}})[0];
+
+    vm.GetFloatRegister(1).Value().d = 1.0;
+    vm.GetFloatRegister(2).Value().d = 0.5;
+    vm.GetFloatRegister(3).Value().d = 3.0;
+
+    return vm;
+}
+
+// Fused multiply add, division and square root with loads and stores
+DEFINE_BENCHMARK(GuestFloatMath) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupFloatKernel(memory, vms);
+
+    vm.Step(KERNEL_STEPS);
+    return KERNEL_STEPS;
+}
+
+// Every hart adds to the same counter from its own thread
+DEFINE_BENCHMARK(GuestAMOContention) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& harts = SetupKernel(memory, vms, {
+        RV64_R(RVInstruction::OP_ATOMIC, 10, RVInstruction::FUNCT3_ATOMIC, 5, 6, RVInstruction::FUNCT7_AMOADD_W), // amoadd.w x10, x6, (x5)
+        OpImm(RVInstruction::FUNCT3_ADDI, 7, 7, 1),                                        // addi x7, x7, 1
+        Jump(-8),                                                                          // j 0
+    }, {{5, KERNEL_TARGET}, {6, 1}}, KERNEL_AMO_HARTS);
+
+    std::vector<std::jthread> threads;
+    for (auto& vm : harts)
+        threads.emplace_back([&vm]() { vm.Step(KERNEL_STEPS); });
+
+    threads.clear();
+    return KERNEL_STEPS * harts.size();
+}
+
+// Loads and stores striding over 1024 pages with Sv39 on, more pages than
+// the TLB holds
+DEFINE_BENCHMARK(GuestSv39Pages) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupKernel(memory, vms, {
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 14, 8, 13),                                  // add x14, x8, x13
+        RV64_I(RVInstruction::OP_LOAD, 10, RVInstruction::FUNCT3_LD, 14, 0),               // ld x10, 0(x14)
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 11, 11, 10),                                 // add x11, x11, x10
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 14, 11, 8),              // sd x11, 8(x14)
+        Op(RVInstruction::FUNCT3_ADD_SUB_MUL, 13, 13, 9),                                  // add x13, x13, x9
+        Op(RVInstruction::FUNCT3_AND_REMU, 13, 13, 12),                                    // and x13, x13, x12
+        Jump(-24),                                                                         // j 0
+    }, {{8, KERNEL_PAGES}, {9, 0x1040}, {12, (KERNEL_PAGES_BYTES - 1) & ~0xfULL}}, 1, true)[0];
+
+    vm.Step(KERNEL_STEPS);
+    return KERNEL_STEPS;
+}
@@ -0,0 +1,78 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(LR_SC) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(0x2000, 0x1000);
+
+    auto target = Random<Address>(0x2000, 0x2ff0) & ~3;
+    // Bit 31 set, LR.W sign extends like LW
+    auto initial = Random<Word>(0, UINT32_MAX) | 0x80000000;
+    auto stored = Random<Word>(0, UINT32_MAX);
+
+    memory.WriteWord(target, initial);
+
+    vm.GetRegister(5).Value().u64 = target;
+    vm.GetRegister(12).Value().u64 = stored;
+
+    memory.WriteWord(0x1000, RV64_R(RVInstruction::OP_ATOMIC, 10, RVInstruction::FUNCT3_ATOMIC, 5, 0, RVInstruction::FUNCT7_LR_W));
+    memory.WriteWord(0x1004, RV64_R(RVInstruction::OP_ATOMIC, 11, RVInstruction::FUNCT3_ATOMIC, 5, 12, RVInstruction::FUNCT7_SC_W));
+    memory.WriteWord(0x1008, RV64_R(RVInstruction::OP_ATOMIC, 13, RVInstruction::FUNCT3_ATOMIC, 5, 12, RVInstruction::FUNCT7_SC_W));
+
+    STEP_VMS(3);
+
+    auto x10 = vm.GetRegister(10).Value().u64;
+    auto x11 = vm.GetRegister(11).Value().u64;
+    auto x13 = vm.GetRegister(13).Value().u64;
+    auto value = memory.ReadWord(target);
+
+    auto loaded = static_cast<Long>(static_cast<SWord>(initial));
+
+    ASSERT(x10 == loaded, "LR.W loaded {:x}, expected {:x}", x10, loaded);
+    ASSERT(x11 == 0, "SC.W failed with a valid reservation");
+    ASSERT(value == stored, "SC.W did not store. Expected {:x}, got {:x}", stored, value);
+    ASSERT(x13 == 1, "SC.W succeeded without a reservation");
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(SC_AfterRemoteStore) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(0x2000, 0x1000);
+    ADD_RAM(0x3000, 0x1000);
+
+    ADD_VM(1, 0x2000);
+
+    auto target = Random<Address>(0x3000, 0x3ff0) & ~3;
+    auto remote = Random<Word>(0, UINT32_MAX);
+
+    memory.WriteWord(target, ~remote);
+
+    for (auto& cur_vm : vms)
+        cur_vm.GetRegister(5).Value().u64 = target;
+
+    vms[0].GetRegister(12).Value().u64 = ~remote + 1;
+    vms[1].GetRegister(13).Value().u64 = remote;
+
+    memory.WriteWord(0x1000, RV64_R(RVInstruction::OP_ATOMIC, 10, RVInstruction::FUNCT3_ATOMIC, 5, 0, RVInstruction::FUNCT7_LR_W));
+    memory.WriteWord(0x1004, RV64_R(RVInstruction::OP_ATOMIC, 11, RVInstruction::FUNCT3_ATOMIC, 5, 12, RVInstruction::FUNCT7_SC_W));
+
+    memory.WriteWord(0x2000, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SW, 5, 13, 0));
+
+    // Hart 0 reserves, hart 1 stores to the granule, hart 0 tries to commit
+    STEP_VMS(1);
+    STEP_VMS(1);
+
+    auto x11 = vms[0].GetRegister(11).Value().u64;
+    auto value = memory.ReadWord(target);
+
+    ASSERT(x11 == 1, "SC.W succeeded after another hart stored to the reserved address");
+    ASSERT(value == remote, "Store of the other hart was overwritten. Expected {:x}, got {:x}", remote, value);
+
+    SUCCESS;
+}
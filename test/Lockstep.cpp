@@ -0,0 +1,84 @@
+#include "Test.hpp"
+
+#include <Lockstep.hpp>
+
+#include <chrono>
+#include <thread>
+
+constexpr Address COUNTER = 0x2000;
+
+// Four harts add 1 to a shared counter with AMOADD.W and fold every old value
+// they get back into x11, so x11 records the order the harts ran in
+static std::vector<Long> RunLockstepHarts(Long quantum, Long seed) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x2000);
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 0, 1));
+    memory.WriteWord(0x1004, RV64_U(RVInstruction::OP_LUI, 8, COUNTER >> 12));
+    memory.WriteWord(0x1008, RV64_R(RVInstruction::OP_ATOMIC, 6, RVInstruction::FUNCT3_ATOMIC, 8, 5, RVInstruction::FUNCT7_AMOADD_W));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 12, RVInstruction::FUNCT3_SLLI, 11, 5));
+    memory.WriteWord(0x1010, RV64_R(RVInstruction::OP_MATH, 11, RVInstruction::FUNCT3_ADD_SUB_MUL, 12, 6, RVInstruction::FUNCT7_ADD));
+    memory.WriteWord(0x1014, RV64_J(RVInstruction::OP_JAL, 0, -12));
+
+    for (Hart i = 1; i < 4; i++)
+        ADD_VM(i, 0x1000);
+
+    std::vector<VirtualMachine*> harts;
+    for (auto& cur_vm : vms)
+        harts.push_back(&cur_vm);
+
+    Lockstep lockstep(memory, harts, quantum, seed);
+    lockstep.Run(20000);
+
+    std::vector<Long> state = {memory.ReadWord(COUNTER)};
+    for (auto& cur_vm : vms) {
+        state.push_back(cur_vm.GetRegister(11).Value().u64);
+        state.push_back(cur_vm.GetCycles());
+    }
+
+    return state;
+}
+
+DEFINE_TESTCASE(LockstepDeterminism) {
+    auto quantum = Random<Long>(1, 100);
+    auto seed = Random<Long>(0, UINT32_MAX);
+
+    auto first = RunLockstepHarts(quantum, seed);
+    auto second = RunLockstepHarts(quantum, seed);
+
+    ASSERT(first[0] != 0, "Harts never incremented the counter");
+
+    for (size_t i = 0; i < first.size(); i++)
+        ASSERT(first[i] == second[i], "Runs with quantum {} and seed {} differ at {}: {:x} and {:x}", quantum, seed, i, first[i], second[i]);
+
+    // Every AMO a hart retired is in the counter, no update was lost
+    Long amos = 0;
+    for (size_t i = 2; i < first.size(); i += 2)
+        amos += first[i] > 2 ? (first[i] - 2 + 3) / 4 : 0;
+
+    ASSERT(first[0] == amos, "Counter holds {}, but the harts retired {} AMOs", first[0], amos);
+
+    SUCCESS;
+}
+
+// Host time that passed before the run must not show up in mtime
+DEFINE_TESTCASE(LockstepTime) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 10, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_TIME));
+    memory.WriteWord(0x1004, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    Lockstep lockstep(memory, {&vm});
+    lockstep.Run(100);
+
+    ASSERT(vm.GetRegister(10).Value().u64 == 0, "First instruction read time {}, expected 0", vm.GetRegister(10).Value().u64);
+
+    SUCCESS;
+}
@@ -0,0 +1,95 @@
+#include "Test.hpp"
+
+constexpr Address RAM_BASE = 0x1000;
+constexpr Address RAM_SIZE = 1024 * 1024;
+constexpr size_t ACCESSES = 1 << 20;
+
+// Strided loads and narrow stores over 1 MiB of RAM, 3 accesses per step
+static size_t AccessRAM(Memory& memory) {
+    size_t checksum = 0;
+    Address offset = 0;
+
+    for (size_t i = 0; i < ACCESSES / 3; i++) {
+        offset = (offset + 0x238) & (RAM_SIZE - 8);
+
+        checksum += memory.ReadLong(RAM_BASE + offset);
+        memory.WriteWord(RAM_BASE + offset, static_cast<Word>(i));
+        memory.WriteByte(RAM_BASE + offset + 5, static_cast<Byte>(i));
+    }
+
+    BenchmarkKeep(checksum);
+    return ACCESSES / 3 * 3;
+}
+
+DEFINE_BENCHMARK(PagedRAM) {
+    static Memory memory;
+
+    if (memory.GetMaxAddress() < RAM_BASE)
+        memory.AddMemoryRegion(MemoryRAM::Create(RAM_BASE, RAM_SIZE));
+
+    return AccessRAM(memory);
+}
+
+DEFINE_BENCHMARK(MappedRAM) {
+    static Memory memory;
+
+    if (memory.GetMaxAddress() < RAM_BASE)
+        memory.AddMemoryRegion(MemoryMappedRAM::Create(RAM_BASE, RAM_SIZE));
+
+    return AccessRAM(memory);
+}
+
+constexpr Address GUEST_ROOT_TABLE = 0x2000;
+constexpr Address GUEST_CODE = 0x3000;
+constexpr Address GUEST_DATA = 0x4000;
+constexpr size_t GUEST_STEPS = 1 << 20;
+
+// Runs a load, add, store loop in supervisor mode, either bare or through
+// an identity mapped Sv39 giga page
+static VirtualMachine& SetupGuest(Memory& memory, std::vector<VirtualMachine>& vms, bool paged) {
+    memory.AddMemoryRegion(MemoryMappedRAM::Create(RAM_BASE, RAM_SIZE));
+
+    vms.emplace_back(VirtualMachine(memory, RAM_BASE, 0));
+    auto& vm = vms[0];
+    vm.SetExecutionEngine(__Benchmark::execution_engine);
+    vm.Start();
+
+    constexpr Long PTE_VRWXAD = 0b11001111;
+    memory.WriteLong(GUEST_ROOT_TABLE, PTE_VRWXAD);
+
+    vm.GetRegister(5).Value().u64 = paged ? (8ULL << 60) | (GUEST_ROOT_TABLE >> 12) : 0;
+    vm.GetRegister(6).Value().u64 = GUEST_CODE;
+    vm.GetRegister(7).Value().u64 = 0b01 << 11;
+    vm.GetRegister(8).Value().u64 = GUEST_DATA;
+
+    memory.WriteWord(RAM_BASE + 0x0, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_SATP));
+    memory.WriteWord(RAM_BASE + 0x4, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, VirtualMachine::CSR_MSTATUS));
+    memory.WriteWord(RAM_BASE + 0x8, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MEPC));
+    memory.WriteWord(RAM_BASE + 0xc, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_MRET));
+
+    memory.WriteWord(GUEST_CODE + 0x0, RV64_I(RVInstruction::OP_LOAD, 10, RVInstruction::FUNCT3_LD, 8, 0));
+    memory.WriteWord(GUEST_CODE + 0x4, RV64_R(RVInstruction::OP_MATH, 11, RVInstruction::FUNCT3_ADD_SUB_MUL, 11, 10, RVInstruction::FUNCT7_ADD));
+    memory.WriteWord(GUEST_CODE + 0x8, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 11, 8));
+    memory.WriteWord(GUEST_CODE + 0xc, RV64_J(RVInstruction::OP_JAL, 0, static_cast<Word>(-12)));
+
+    vm.Step(4);
+    return vm;
+}
+
+DEFINE_BENCHMARK(GuestBareLoads) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupGuest(memory, vms, false);
+
+    vm.Step(GUEST_STEPS);
+    return GUEST_STEPS;
+}
+
+DEFINE_BENCHMARK(GuestSv39Loads) {
+    static Memory memory;
+    static std::vector<VirtualMachine> vms;
+    static auto& vm = SetupGuest(memory, vms, true);
+
+    vm.Step(GUEST_STEPS);
+    return GUEST_STEPS;
+}
@@ -0,0 +1,77 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(LoadAccessFault) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto base = Random<Address>(0x2000, 0xffffffffffffe000);
+    base &= ~3;
+
+    auto sel_rs1 = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+    auto sel_rd = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+
+    sel_rd = EnsureRegistersAreDifferent(sel_rs1, sel_rd);
+
+    auto& rs1 = vm.GetRegister(sel_rs1).Value();
+    auto& rd = vm.GetRegister(sel_rd).Value();
+
+    rs1.u64 = base;
+    rd.u64 = 0x1234;
+
+    memory.WriteWord(0x1000, RV64_I(
+        RVInstruction::OP_LOAD,
+        sel_rd,
+        RVInstruction::FUNCT3_LW,
+        sel_rs1,
+        0
+    ));
+
+    STEP_VMS(1);
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+
+    ASSERT(csrs[VirtualMachine::CSR_MCAUSE] == 5, "Expected a load access fault, got cause {}", csrs[VirtualMachine::CSR_MCAUSE]);
+    ASSERT(csrs[VirtualMachine::CSR_MEPC] == 0x1000, "Wrong faulting pc {:x}", csrs[VirtualMachine::CSR_MEPC]);
+    ASSERT(csrs[VirtualMachine::CSR_MTVAL] == static_cast<Long>(base), "Wrong fault address. Expected {:x}, got {:x}", base, csrs[VirtualMachine::CSR_MTVAL]);
+    ASSERT(rd.u64 == 0x1234, "Destination register was written by a faulting load");
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(StoreAddressMisaligned) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(0x2000, 0x1000);
+
+    auto target = Random<Address>(0x2000, 0x2ff0) | 1;
+
+    auto sel_rs1 = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+    auto sel_rs2 = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+
+    auto& rs1 = vm.GetRegister(sel_rs1).Value();
+
+    rs1.u64 = target;
+
+    memory.WriteWord(0x1000, RV64_S(
+        RVInstruction::OP_STORE,
+        RVInstruction::FUNCT3_SW,
+        sel_rs1,
+        sel_rs2,
+        0
+    ));
+
+    STEP_VMS(1);
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+
+    ASSERT(csrs[VirtualMachine::CSR_MCAUSE] == 6, "Expected a misaligned store, got cause {}", csrs[VirtualMachine::CSR_MCAUSE]);
+    ASSERT(csrs[VirtualMachine::CSR_MTVAL] == static_cast<Long>(target), "Wrong fault address. Expected {:x}, got {:x}", target, csrs[VirtualMachine::CSR_MTVAL]);
+
+    SUCCESS;
+}
@@ -0,0 +1,77 @@
+#include "Test.hpp"
+
+#include <Profiler.hpp>
+
+#include <thread>
+
+// Sets x11 to 100, counts x10 up to it, then spins
+DEFINE_TESTCASE(ProfilerCounts) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Long LOOPS = 100;
+    constexpr Long SPINS = 50;
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 11, RVInstruction::FUNCT3_ADDI, 0, LOOPS));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, 1));
+    memory.WriteWord(0x1008, RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BLT, 10, 11, -4));
+    memory.WriteWord(0x100c, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    vm.EnableProfiling(true);
+
+    // Small steps so the block engines also run partial blocks
+    Long remaining = 1 + 2 * LOOPS + SPINS;
+    while (remaining != 0) {
+        Long steps = std::min<Long>(remaining, Random<Long>(1, 8));
+        STEP_VMS(steps);
+        remaining -= steps;
+    }
+
+    auto profiler = vm.GetProfiler();
+
+    ASSERT(profiler->GetTotal() == 1 + 2 * LOOPS + SPINS, "Counted {} instructions, expected {}", profiler->GetTotal(), 1 + 2 * LOOPS + SPINS);
+    ASSERT(profiler->GetCount(0x1000) == 1, "0x1000 counted {} times, expected 1", profiler->GetCount(0x1000));
+    ASSERT(profiler->GetCount(0x1004) == LOOPS, "0x1004 counted {} times, expected {}", profiler->GetCount(0x1004), LOOPS);
+    ASSERT(profiler->GetCount(0x1008) == LOOPS, "0x1008 counted {} times, expected {}", profiler->GetCount(0x1008), LOOPS);
+    ASSERT(profiler->GetCount(0x100c) == SPINS, "0x100c counted {} times, expected {}", profiler->GetCount(0x100c), SPINS);
+
+    auto hot_spots = profiler->GetHotSpots(3);
+
+    ASSERT(hot_spots.size() == 3, "Got {} hot spots, expected 3", hot_spots.size());
+    ASSERT(hot_spots[0].pc == 0x1004 && hot_spots[1].pc == 0x1008 && hot_spots[2].pc == 0x100c, "Hot spots are out of order");
+
+    Profiler merged;
+    merged.Merge(*profiler);
+    merged.Merge(*profiler);
+
+    ASSERT(merged.GetCount(0x1004) == 2 * LOOPS, "Merged 0x1004 counted {} times, expected {}", merged.GetCount(0x1004), 2 * LOOPS);
+
+    SUCCESS;
+}
+
+// Clear lands while another thread counts. Whatever was counted before it
+// is gone for good, the counting thread must not write an old count back.
+DEFINE_TESTCASE(ProfilerClearWhileCounting) {
+    constexpr Long HITS = 1 << 22;
+    constexpr Address PC = 0x1000;
+
+    Profiler profiler;
+
+    std::thread counter([&profiler]() {
+        for (Long i = 0; i < HITS; i++)
+            profiler.Count(PC);
+    });
+
+    while (profiler.GetCount(PC) < HITS / 2);
+
+    profiler.Clear();
+    counter.join();
+
+    // At least half had been counted when Clear ran
+    auto count = profiler.GetCount(PC);
+    ASSERT(count <= HITS / 2, "Counted {} after the clear, more than the {} left to count", count, HITS / 2);
+
+    SUCCESS;
+}
@@ -0,0 +1,77 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(SFENCE_VMA) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(0x10000, 0x10000);
+
+    constexpr Long PTE_V = 1 << 0;
+    constexpr Long PTE_R = 1 << 1;
+    constexpr Long PTE_W = 1 << 2;
+    constexpr Long PTE_X = 1 << 3;
+    constexpr Long PTE_A = 1 << 6;
+    constexpr Long PTE_D = 1 << 7;
+
+    constexpr Address ROOT_TABLE = 0x10000;
+    constexpr Address MID_TABLE = 0x11000;
+    constexpr Address LEAF_TABLE = 0x12000;
+    constexpr Address CODE_PAGE = 0x13000;
+    constexpr Address OLD_DATA_PAGE = 0x14000;
+    constexpr Address NEW_DATA_PAGE = 0x15000;
+
+    // Code and data share their leaf table
+    auto virt_code = Random<Address>(0, 0x3fffffffff) & ~0x1fffffULL;
+    auto virt_data = virt_code + 0x1000;
+
+    auto VPN = [](Address address, Long level) { return (address >> (12 + level * 9)) & 0x1ff; };
+    auto PTE = [](Address address, Long flags) { return ((address >> 12) << 10) | flags; };
+
+    memory.WriteLong(ROOT_TABLE + VPN(virt_code, 2) * 8, PTE(MID_TABLE, PTE_V));
+    memory.WriteLong(MID_TABLE + VPN(virt_code, 1) * 8, PTE(LEAF_TABLE, PTE_V));
+    memory.WriteLong(LEAF_TABLE + VPN(virt_code, 0) * 8, PTE(CODE_PAGE, PTE_V | PTE_R | PTE_X | PTE_A));
+    memory.WriteLong(LEAF_TABLE + VPN(virt_data, 0) * 8, PTE(OLD_DATA_PAGE, PTE_V | PTE_R | PTE_W | PTE_A | PTE_D));
+
+    auto old_value = Random<Long>(0, LONG_MAX);
+    auto new_value = ~old_value;
+
+    memory.WriteLong(OLD_DATA_PAGE, old_value);
+    memory.WriteLong(NEW_DATA_PAGE, new_value);
+
+    vm.GetRegister(5).Value().u64 = (8ULL << 60) | (ROOT_TABLE >> 12);
+    vm.GetRegister(6).Value().u64 = virt_code;
+    vm.GetRegister(7).Value().u64 = 0b01 << 11;
+    vm.GetRegister(8).Value().u64 = virt_data;
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_SATP));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, VirtualMachine::CSR_MSTATUS));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MEPC));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_MRET));
+
+    memory.WriteWord(CODE_PAGE + 0x0, RV64_I(RVInstruction::OP_LOAD, 10, RVInstruction::FUNCT3_LD, 8, 0));
+    memory.WriteWord(CODE_PAGE + 0x4, RV64_I(RVInstruction::OP_LOAD, 11, RVInstruction::FUNCT3_LD, 8, 0));
+    memory.WriteWord(CODE_PAGE + 0x8, RV64_R(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, 0, RVInstruction::FUNCT7_SFENCE_VMA));
+    memory.WriteWord(CODE_PAGE + 0xc, RV64_I(RVInstruction::OP_LOAD, 12, RVInstruction::FUNCT3_LD, 8, 0));
+
+    for (size_t i = 0; i < 5; i++)
+        STEP_VMS(1);
+
+    ASSERT(vm.GetPC() == virt_code + 4, "Paged load did not execute, pc is {:x}", vm.GetPC());
+
+    // Remapping without a fence keeps using the cached translation
+    memory.WriteLong(LEAF_TABLE + VPN(virt_data, 0) * 8, PTE(NEW_DATA_PAGE, PTE_V | PTE_R | PTE_W | PTE_A | PTE_D));
+
+    for (size_t i = 0; i < 3; i++)
+        STEP_VMS(1);
+
+    auto x10 = vm.GetRegister(10).Value().u64;
+    auto x11 = vm.GetRegister(11).Value().u64;
+    auto x12 = vm.GetRegister(12).Value().u64;
+
+    ASSERT(x10 == old_value, "Wrong value loaded through the page table. Expected {:x}, got {:x}", old_value, x10);
+    ASSERT(x11 == old_value, "Translation was not cached. Expected {:x}, got {:x}", old_value, x11);
+    ASSERT(x12 == new_value, "SFENCE.VMA did not flush the translation. Expected {:x}, got {:x}", new_value, x12);
+
+    SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "Test.hpp"
+
+#include <Scheduler.hpp>
+
+#include <thread>
+
+// Harts 0 to 2 count in x10 forever, hart 3 waits for a software interrupt
+// and then sets x11
+static void SetupSchedulerHarts(Memory& memory, std::vector<VirtualMachine>& vms) {
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, 1));
+    memory.WriteWord(0x1004, RV64_J(RVInstruction::OP_JAL, 0, -4));
+
+    memory.WriteWord(0x1100, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 0, 1 << VirtualMachine::INTERRUPT_MACHINE_SOFTWARE));
+    memory.WriteWord(0x1104, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_MIE));
+    memory.WriteWord(0x1108, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_WFI));
+    memory.WriteWord(0x110c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 11, RVInstruction::FUNCT3_ADDI, 0, 1));
+    memory.WriteWord(0x1110, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    ADD_VM(1, 0x1000);
+    ADD_VM(2, 0x1000);
+    ADD_VM(3, 0x1100);
+}
+
+static std::vector<VirtualMachine*> GetHarts(std::vector<VirtualMachine>& vms) {
+    std::vector<VirtualMachine*> harts;
+    for (auto& cur_vm : vms)
+        harts.push_back(&cur_vm);
+
+    return harts;
+}
+
+DEFINE_TESTCASE(SchedulerWake) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    SetupSchedulerHarts(memory, vms);
+
+    // More harts than workers, with a short slice so they have to take turns
+    Scheduler scheduler(GetHarts(vms), 2, 100);
+    std::thread worker([&scheduler]() { scheduler.Run(); });
+
+    bool slept = WaitFor([&]() { return vms[3].IsWaitingForInterrupt(); });
+    bool progressed = WaitFor([&]() {
+        for (size_t i = 0; i < 3; i++)
+            if (vms[i].GetRegister(10).Value().u64 == 0)
+                return false;
+
+        return true;
+    });
+
+    vms[3].RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    bool woke = WaitFor([&]() { return vms[3].GetRegister(11).Value().u64 == 1; });
+
+    for (auto& cur_vm : vms)
+        cur_vm.Stop();
+
+    worker.join();
+
+    ASSERT(slept, "Hart 3 never started waiting for an interrupt");
+    ASSERT(progressed, "Not every running hart got a time slice");
+    ASSERT(woke, "Raising an interrupt did not requeue the parked hart");
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(SchedulerMaxCycles) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    SetupSchedulerHarts(memory, vms);
+
+    constexpr Long MAX_CYCLES = 5000;
+
+    // The parked hart must not keep the scheduler from returning
+    Scheduler scheduler(GetHarts(vms), 2, 100);
+    scheduler.Run(MAX_CYCLES);
+
+    for (auto& cur_vm : vms)
+        ASSERT(!cur_vm.IsRunning(), "Hart {} still running after the scheduler returned", &cur_vm - vms.data());
+
+    Long cycles = 0;
+    for (auto& cur_vm : vms)
+        cycles = std::max(cycles, cur_vm.GetCycles());
+
+    ASSERT(cycles >= MAX_CYCLES, "Scheduler returned after {} cycles", cycles);
+    ASSERT(vms[3].GetRegister(11).Value().u64 == 0, "Hart 3 ran past WFI without an interrupt");
+
+    SUCCESS;
+}
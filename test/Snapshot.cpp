@@ -0,0 +1,111 @@
+#include "Test.hpp"
+
+#include <Snapshot.hpp>
+
+#include <filesystem>
+
+constexpr Address SNAPSHOT_COUNTER = 0x2000;
+
+// Sets frm to round up, then counts in memory and in x10 while dividing
+// f2 by f3 into f1 with the dynamic rounding mode
+static void WriteSnapshotProgram(Memory& memory) {
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRWI, RVInstruction::RM_ROUND_UP, VirtualMachine::CSR_FRM));
+    memory.WriteWord(0x1004, RV64_U(RVInstruction::OP_LUI, 8, SNAPSHOT_COUNTER >> 12));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_LOAD, 6, RVInstruction::FUNCT3_LD, 8, 0));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_ADDI, 6, 1));
+    memory.WriteWord(0x1010, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 6, 0));
+    memory.WriteWord(0x1014, RV64_R(RVInstruction::OP_FLOAT, 1, RVInstruction::RM_DYNAMIC, 2, 3, (RVInstruction::FUNCT5_FDIV << 2) | RVInstruction::FUNCT2_D));
+    memory.WriteWord(0x1018, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, 1));
+    memory.WriteWord(0x101c, RV64_J(RVInstruction::OP_JAL, 0, -20));
+}
+
+DEFINE_TESTCASE(SnapshotRestore) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x3000);
+
+    WriteSnapshotProgram(memory);
+
+    vm.GetFloatRegister(2).Value().d = 1.0;
+    vm.GetFloatRegister(3).Value().d = 3.0;
+
+    STEP_VMS(Random<Long>(10, 1000));
+
+    auto snapshot = Snapshot::Capture(memory, {&vm});
+
+    auto x10 = vm.GetRegister(10).Value().u64;
+    auto pc = vm.GetPC();
+    auto counter = memory.ReadLong(SNAPSHOT_COUNTER);
+
+    // Also dirties a page that held only zeros when the snapshot was taken
+    auto steps = Random<Long>(10, 1000);
+    STEP_VMS(steps);
+    memory.WriteLong(0x3000, 0xdeadbeef);
+
+    auto later_x10 = vm.GetRegister(10).Value().u64;
+    auto later_counter = memory.ReadLong(SNAPSHOT_COUNTER);
+
+    snapshot.Restore(memory, {&vm});
+
+    ASSERT(vm.GetRegister(10).Value().u64 == x10, "x10 is {} after the restore, expected {}", vm.GetRegister(10).Value().u64, x10);
+    ASSERT(vm.GetPC() == pc, "pc is {:x} after the restore, expected {:x}", vm.GetPC(), pc);
+    ASSERT(memory.ReadLong(SNAPSHOT_COUNTER) == counter, "Counter is {} after the restore, expected {}", memory.ReadLong(SNAPSHOT_COUNTER), counter);
+    ASSERT(memory.ReadLong(0x3000) == 0, "Page written after the snapshot was not cleared");
+
+    // The restored hart takes the same path again
+    STEP_VMS(steps);
+
+    ASSERT(vm.GetRegister(10).Value().u64 == later_x10, "x10 is {} after running again, expected {}", vm.GetRegister(10).Value().u64, later_x10);
+    ASSERT(memory.ReadLong(SNAPSHOT_COUNTER) == later_counter, "Counter is {} after running again, expected {}", memory.ReadLong(SNAPSHOT_COUNTER), later_counter);
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(SnapshotFile) {
+    auto path = (std::filesystem::temp_directory_path() / "rv64_snapshot_test.bin").string();
+
+    Long x10, counter;
+    double quotient;
+
+    {
+        SETUP_MEMORY;
+        SETUP_VM(0x1000);
+
+        ADD_RAM(0x1000, 0x3000);
+
+        WriteSnapshotProgram(memory);
+
+        vm.GetFloatRegister(2).Value().d = 1.0;
+        vm.GetFloatRegister(3).Value().d = 3.0;
+
+        STEP_VMS(Random<Long>(10, 1000));
+
+        Snapshot::Capture(memory, {&vm}).Save(path);
+
+        x10 = vm.GetRegister(10).Value().u64;
+        counter = memory.ReadLong(SNAPSHOT_COUNTER);
+        quotient = vm.GetFloatRegister(1).Value().d;
+    }
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x3000);
+
+    Snapshot::Load(path).Restore(memory, {&vm});
+    std::filesystem::remove(path);
+
+    ASSERT(vm.GetRegister(10).Value().u64 == x10, "x10 is {} after loading, expected {}", vm.GetRegister(10).Value().u64, x10);
+    ASSERT(memory.ReadLong(SNAPSHOT_COUNTER) == counter, "Counter is {} after loading, expected {}", memory.ReadLong(SNAPSHOT_COUNTER), counter);
+
+    // 1 / 3 is only rounded up if frm took effect again
+    vm.GetFloatRegister(1).Value().d = 0.0;
+    while (vm.GetFloatRegister(1).Value().d == 0.0)
+        STEP_VMS(1);
+
+    ASSERT(vm.GetFloatRegister(1).Value().d == quotient, "Loaded hart divided to {}, expected {}", vm.GetFloatRegister(1).Value().d, quotient);
+    ASSERT(vm.GetFloatRegister(1).Value().d > 1.0 / 3.0, "Loaded hart did not round up, got {}", vm.GetFloatRegister(1).Value().d);
+
+    SUCCESS;
+}
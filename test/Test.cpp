@@ -1,11 +1,36 @@
 #include "Test.hpp"
 
 #include <ctime>
+#include <chrono>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
 
 std::vector<__TestCase*> __TestCase::test_cases;
+VirtualMachine::ExecutionEngine __TestCase::execution_engine = VirtualMachine::ExecutionEngine::Interpreter;
+std::vector<__Benchmark*> __Benchmark::benchmarks;
+VirtualMachine::ExecutionEngine __Benchmark::execution_engine = VirtualMachine::ExecutionEngine::Interpreter;
+
+std::string EngineName(VirtualMachine::ExecutionEngine engine) {
+    if (engine == VirtualMachine::ExecutionEngine::Block)
+        return "block";
+    
+    else if (engine == VirtualMachine::ExecutionEngine::JIT)
+        return "JIT";
+
+    return "interpreter";
+}
+
+void __TestCase::RunTestCases(size_t iterations, VirtualMachine::ExecutionEngine engine) {
+    execution_engine = engine;
+
+    auto engine_name = EngineName(engine);
 
-void __TestCase::RunTestCases(size_t iterations) {
-    std::cout << std::format("Running {} test cases", test_cases.size()) << std::endl;
+    std::cout << std::format("Running {} test cases with the {} engine", test_cases.size(), engine_name) << std::endl;
     std::vector<std::string> failed;
     std::vector<std::string> excepted;
     size_t passed = 0;
@@ -58,6 +83,70 @@ void __TestCase::RunTestCases(size_t iterations) {
     }
 }
 
+void __Benchmark::RunBenchmarks(size_t repetitions, bool machine_readable) {
+    auto engine_name = EngineName(execution_engine);
+
+    if (!machine_readable)
+        std::cout << std::format("Running {} benchmarks with the {} engine, best of {}", benchmarks.size(), engine_name, repetitions) << std::endl;
+
+    for (auto& benchmark : benchmarks) {
+        auto desc = benchmark->GetDescription();
+
+        // Guest benchmarks keep their machine in statics, so what the process
+        // grew by from here on is the memory this benchmark holds
+        auto resident_before = ResidentSetKiB();
+
+        // Warm up caches and lazily built state first
+        benchmark->Run();
+
+        size_t operations = 0;
+        double best = 0;
+
+        for (size_t i = 0; i < repetitions; i++) {
+            auto start = std::chrono::steady_clock::now();
+            operations = benchmark->Run();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (i == 0 || elapsed.count() < best)
+                best = elapsed.count();
+        }
+
+        double per_operation = operations ? best / operations : 0;
+        double mops = best ? operations * 1e3 / best : 0;
+        auto resident_after = ResidentSetKiB();
+        auto resident = resident_after > resident_before ? resident_after - resident_before : 0;
+
+        if (machine_readable)
+            std::cout << std::format(R"({{"benchmark":"{}","engine":"{}","operations":{},"ns":{:.0f},"ns_per_op":{:.3f},"mops":{:.2f},"resident_kib":{}}})", desc, engine_name, operations, best, per_operation, mops, resident) << std::endl;
+        
+        else
+            std::cout << std::format("Benchmark '{}': {} operations in {:.3f} ms, {:.2f} ns/op, {:.2f} Mop/s, {} KiB more resident", desc, operations, best / 1e6, per_operation, mops, resident) << std::endl;
+    }
+}
+
+size_t ResidentSetKiB() {
+#if defined(_WIN32) || defined(_WIN64)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return counters.WorkingSetSize / 1024;
+#else
+    std::ifstream statm("/proc/self/statm");
+
+    size_t total = 0, resident = 0;
+    if (!(statm >> total >> resident))
+        return 0;
+
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+#endif
+}
+
+void BenchmarkKeep(size_t value) {
+    static volatile size_t sink;
+    sink = sink + value;
+}
+
 size_t RandomInt() {
     static size_t state[4];
     static bool init = false;
@@ -0,0 +1,189 @@
+#include "Test.hpp"
+
+#include <thread>
+
+constexpr Address MTIMECMP_HART_0 = Timer::BASE + Timer::MTIMECMP_OFFSET;
+
+DEFINE_TESTCASE(TimerInterrupt) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    // Instruction driven time makes the moment of the interrupt exact
+    auto timer = Timer::Get(memory);
+    timer->SetSource(Timer::Source::Instructions);
+    memory.WriteLong(Timer::BASE + Timer::MTIME_OFFSET, 0);
+
+    auto compare = Random<Long>(100, 500);
+
+    vm.GetRegister(5).Value().u64 = 0x1100;
+    vm.GetRegister(6).Value().u64 = 1ULL << VirtualMachine::INTERRUPT_MACHINE_TIMER;
+    vm.GetRegister(7).Value().u64 = 1ULL << 3;
+    vm.GetRegister(8).Value().u64 = MTIMECMP_HART_0;
+    vm.GetRegister(9).Value().u64 = compare;
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_MTVEC));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MIE));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRS, 7, VirtualMachine::CSR_MSTATUS));
+    memory.WriteWord(0x100c, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 9, 0));
+    memory.WriteWord(0x1010, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    memory.WriteWord(0x1100, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, 1));
+    memory.WriteWord(0x1104, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    STEP_VMS(compare - 10);
+
+    ASSERT(timer->GetCompare(0) == compare, "mtimecmp holds {}, expected {}", timer->GetCompare(0), compare);
+    ASSERT(vm.GetRegister(10).Value().u64 == 0, "Timer fired at {}, before mtimecmp {}", timer->Time(), compare);
+
+    STEP_VMS(20);
+    STEP_VMS(1);
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+
+    ASSERT(vm.GetRegister(10).Value().u64 == 1, "Timer interrupt was not taken at {}", timer->Time());
+    ASSERT((csrs[VirtualMachine::CSR_MCAUSE] & 0xff) == VirtualMachine::INTERRUPT_MACHINE_TIMER, "Wrong cause {:x}", csrs[VirtualMachine::CSR_MCAUSE]);
+    ASSERT(csrs[VirtualMachine::CSR_MEPC] == 0x1010, "Interrupted at {:x}, expected 1010", csrs[VirtualMachine::CSR_MEPC]);
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(TimerWake) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    // Sleeps in WFI until half a millisecond of host time has passed
+    auto compare = memory.ReadLong(Timer::BASE + Timer::MTIME_OFFSET) + Timer::TICKS_PER_SECOND / 2000;
+
+    vm.GetRegister(6).Value().u64 = 1ULL << VirtualMachine::INTERRUPT_MACHINE_TIMER;
+    vm.GetRegister(8).Value().u64 = MTIMECMP_HART_0;
+    vm.GetRegister(9).Value().u64 = compare;
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MIE));
+    memory.WriteWord(0x1004, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 9, 0));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_WFI));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, 1));
+    memory.WriteWord(0x1010, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    std::thread worker([&vm]() { vm.Run(); });
+
+    bool woke = WaitFor([&vm]() { return vm.GetRegister(10).Value().u64 == 1; });
+    auto time = memory.ReadLong(Timer::BASE + Timer::MTIME_OFFSET);
+
+    vm.Stop();
+    worker.join();
+
+    ASSERT(woke, "Sleeping hart was not woken by its timer");
+    ASSERT(time >= compare, "Hart woke at {}, before mtimecmp {}", time, compare);
+
+    SUCCESS;
+}
+
+// Hart 1 sleeps in WFI until mtime reaches its mtimecmp, hart 0 keeps
+// counting. The sleeping hart must not pull the time forward while hart 0
+// still retires instructions.
+DEFINE_TESTCASE(TimerIdleHart) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto timer = Timer::Get(memory);
+    timer->SetSource(Timer::Source::Instructions, 0);
+
+    constexpr Long COMPARE = 20000;
+    constexpr Long SLICE = 100;
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, 1));
+    memory.WriteWord(0x1004, RV64_J(RVInstruction::OP_JAL, 0, -4));
+
+    memory.WriteWord(0x1100, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MIE));
+    memory.WriteWord(0x1104, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 9, 0));
+    memory.WriteWord(0x1108, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_WFI));
+    memory.WriteWord(0x110c, RV64_I(RVInstruction::OP_CSR, 11, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_TIME));
+    memory.WriteWord(0x1110, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    ADD_VM(1, 0x1100);
+
+    vms[1].GetRegister(6).Value().u64 = 1ULL << VirtualMachine::INTERRUPT_MACHINE_TIMER;
+    vms[1].GetRegister(8).Value().u64 = MTIMECMP_HART_0 + sizeof(Long);
+    vms[1].GetRegister(9).Value().u64 = COMPARE;
+
+    auto RunUntil = [&](Long time) {
+        while (timer->Time() < time && vms[1].GetRegister(11).Value().u64 == 0) {
+            vms[0].RunFor(SLICE);
+            vms[1].RunFor(SLICE);
+        }
+    };
+
+    RunUntil(COMPARE / 2);
+
+    ASSERT(vms[1].IsWaitingForInterrupt(), "Hart 1 is not asleep in WFI");
+    ASSERT(vms[1].GetRegister(11).Value().u64 == 0, "Hart 1 woke at {} while hart 0 ran, mtimecmp is {}", vms[1].GetRegister(11).Value().u64, COMPARE);
+
+    RunUntil(2 * COMPARE);
+
+    auto woke_at = vms[1].GetRegister(11).Value().u64;
+    ASSERT(woke_at >= COMPARE, "Hart 1 woke at {}, before mtimecmp {}", woke_at, COMPARE);
+    ASSERT(vms[0].GetCycles() + vms[1].GetCycles() + SLICE >= COMPARE, "Time reached {} after hart 0 ran only {} instructions", woke_at, vms[0].GetCycles());
+
+    // With hart 0 stopped nothing retires instructions, so a sleeping hart
+    // lets time jump to its deadline
+    timer->SetCompare(1, timer->Time() + COMPARE);
+    vms[1].SetPC(0x1108);
+    vms[1].GetRegister(11).Value().u64 = 0;
+    vms[0].Stop();
+
+    for (size_t i = 0; i < 3; i++)
+        vms[1].RunFor(SLICE);
+
+    ASSERT(vms[1].GetRegister(11).Value().u64 != 0, "Hart 1 kept sleeping with every other hart stopped");
+
+    SUCCESS;
+}
+
+// Machine software beats the machine timer although its cause is lower, and
+// software cannot clear a pending MTIP through mip
+DEFINE_TESTCASE(InterruptPriority) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    vm.GetRegister(5).Value().u64 = 0x1100;
+    vm.GetRegister(6).Value().u64 = (1ULL << VirtualMachine::INTERRUPT_MACHINE_TIMER) | (1ULL << VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_MTVEC));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 0, VirtualMachine::CSR_MIP));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MIE));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRSI, 8, VirtualMachine::CSR_MSTATUS));
+    memory.WriteWord(0x1010, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    memory.WriteWord(0x1100, RV64_J(RVInstruction::OP_JAL, 0, 0));
+
+    // mtimecmp 0 keeps MTIP pending for good
+    Timer::Get(memory)->SetCompare(0, 0);
+    vm.RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    STEP_VMS(2);
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+
+    ASSERT(csrs[VirtualMachine::CSR_MIP] == (1ULL << VirtualMachine::INTERRUPT_MACHINE_TIMER), "mip is {:x} after clearing it, MTIP has to stay", csrs[VirtualMachine::CSR_MIP]);
+
+    vm.RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    STEP_VMS(4);
+
+    vm.GetCSRSnapshot(csrs);
+
+    ASSERT(vm.GetPC() == 0x1100, "No interrupt taken, pc is {:x}", vm.GetPC());
+    ASSERT((csrs[VirtualMachine::CSR_MCAUSE] & 0xff) == VirtualMachine::INTERRUPT_MACHINE_SOFTWARE, "Took cause {}, expected the software interrupt", csrs[VirtualMachine::CSR_MCAUSE] & 0xff);
+
+    SUCCESS;
+}
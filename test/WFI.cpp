@@ -0,0 +1,73 @@
+#include "Test.hpp"
+
+#include <thread>
+
+// Enables the machine software interrupt, waits for it and then sets x10
+static void WriteWaitingProgram(Memory& memory) {
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 0, 1 << VirtualMachine::INTERRUPT_MACHINE_SOFTWARE));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_MIE));
+    memory.WriteWord(0x1008, RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_WFI));
+    memory.WriteWord(0x100c, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, 1));
+}
+
+DEFINE_TESTCASE(WFI) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    WriteWaitingProgram(memory);
+
+    for (size_t i = 0; i < 3; i++)
+        STEP_VMS(1);
+
+    ASSERT(vm.IsWaitingForInterrupt(), "Hart is not waiting after WFI");
+
+    std::unordered_map<Long, Long> before, after;
+    vm.GetCSRSnapshot(before);
+
+    // A waiting hart returns instead of spinning through its steps
+    STEP_VMS(1000);
+
+    vm.GetCSRSnapshot(after);
+
+    auto spent = after[VirtualMachine::CSR_MCYCLE] - before[VirtualMachine::CSR_MCYCLE];
+
+    ASSERT(vm.IsWaitingForInterrupt(), "Hart stopped waiting without an interrupt");
+    ASSERT(spent <= 1, "Waiting hart spent {} cycles", spent);
+    ASSERT(vm.GetRegister(10).Value().u64 == 0, "Hart ran past WFI without an interrupt");
+
+    vm.RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    STEP_VMS(2);
+
+    ASSERT(!vm.IsWaitingForInterrupt(), "Interrupt did not end WFI");
+    ASSERT(vm.GetRegister(10).Value().u64 == 1, "Hart did not continue after WFI");
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(WFI_Wake) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    WriteWaitingProgram(memory);
+
+    std::thread worker([&vm]() { vm.Run(); });
+
+    bool slept = WaitFor([&]() { return vm.IsWaitingForInterrupt(); });
+
+    vm.RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    bool woke = WaitFor([&]() { return vm.GetRegister(10).Value().u64 == 1; });
+
+    vm.Stop();
+    worker.join();
+
+    ASSERT(slept, "Hart never started waiting for an interrupt");
+    ASSERT(woke, "Raising an interrupt did not wake the sleeping hart");
+
+    SUCCESS;
+}
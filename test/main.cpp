@@ -1,11 +1,35 @@
 #include <RV64.hpp>
 
+#include <string_view>
+
 #include "Test.hpp"
 
 constexpr size_t ITERATIONS_PER_TESTCASE = 100;
 
-int main() {
+int main(int argc, char** argv) {
     RVInstruction::SetupCSRNames();
+
+    if (argc > 1 && std::string_view(argv[1]) == "bench") {
+        bool machine_readable = false;
+
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+
+            if (arg == "--json")
+                machine_readable = true;
+            
+            else if (arg == "--blocks")
+                __Benchmark::execution_engine = VirtualMachine::ExecutionEngine::Block;
+            
+            else if (arg == "--jit")
+                __Benchmark::execution_engine = VirtualMachine::ExecutionEngine::JIT;
+        }
+
+        __Benchmark::RunBenchmarks(5, machine_readable);
+        return 0;
+    }
     
-    __TestCase::RunTestCases(ITERATIONS_PER_TESTCASE);
+    __TestCase::RunTestCases(ITERATIONS_PER_TESTCASE, VirtualMachine::ExecutionEngine::Interpreter);
+    __TestCase::RunTestCases(ITERATIONS_PER_TESTCASE, VirtualMachine::ExecutionEngine::Block);
+    __TestCase::RunTestCases(ITERATIONS_PER_TESTCASE, VirtualMachine::ExecutionEngine::JIT);
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define TEST_HPP
 
 #include <vector>
+#include <chrono>
+#include <thread>
 #include <fstream>
 #include <iostream>
 #include <format>
@@ -23,7 +25,9 @@ public:
 
     virtual std::string GetDescription() const = 0;
 
-    static void RunTestCases(size_t iterations = 50);
+    static VirtualMachine::ExecutionEngine execution_engine;
+
+    static void RunTestCases(size_t iterations = 50, VirtualMachine::ExecutionEngine engine = VirtualMachine::ExecutionEngine::Interpreter);
 };
 
 #define DEFINE_TESTCASE(name)\
@@ -36,9 +40,49 @@ public:\
 __TestCase_##name __TestCase_##name##_Impl;\
 Expected<bool, std::string> __TestCase_##name::Run()
 
+class __Benchmark {
+private:
+    static std::vector<__Benchmark*> benchmarks;
+
+public:
+    __Benchmark(__Benchmark* benchmark) { benchmarks.push_back(benchmark); }
+
+    // Returns the number of operations that were performed
+    virtual size_t Run() = 0;
+
+    virtual std::string GetDescription() const = 0;
+
+    // Engine used by benchmarks that run guest code
+    static VirtualMachine::ExecutionEngine execution_engine;
+
+    // Guest benchmarks count retired instructions as operations, so their
+    // ns/op and Mop/s are ns per instruction and MIPS. The resident size is
+    // how much the process grew while the benchmark ran, not its total. The
+    // machine readable form prints one JSON object per line.
+    static void RunBenchmarks(size_t repetitions = 5, bool machine_readable = false);
+};
+
+#define DEFINE_BENCHMARK(name)\
+class __Benchmark_##name : public __Benchmark {\
+public:\
+    __Benchmark_##name() : __Benchmark(this) {}\
+    size_t Run() override;\
+    std::string GetDescription() const override { return #name; }\
+};\
+__Benchmark_##name __Benchmark_##name##_Impl;\
+size_t __Benchmark_##name::Run()
+
+// Keeps the compiler from optimizing away a benchmarked computation
+void BenchmarkKeep(size_t value);
+
+// Resident set size of the host process in KiB, 0 when unknown
+size_t ResidentSetKiB();
+
+std::string EngineName(VirtualMachine::ExecutionEngine engine);
+
 #define SETUP_MEMORY Memory memory;
 #define ADD_RAM(base, size) {\
-    auto ram = MemoryRAM::Create(base, size);\
+    auto ram = MemoryMappedRAM::Create(base, size);\
     memory.AddMemoryRegion(std::move(ram));\
 }
 
@@ -68,10 +112,12 @@ Expected<bool, std::string> __TestCase_##name::Run()
     std::vector<VirtualMachine> vms;\
     vms.emplace_back(VirtualMachine(memory, start, 0));\
     auto& vm = vms[0];\
+    vm.SetExecutionEngine(__TestCase::execution_engine);\
     vm.Start();
 
 #define ADD_VM(hart_id, start) {\
     auto new_vm = VirtualMachine(memory, start, hart_id);\
+    new_vm.SetExecutionEngine(__TestCase::execution_engine);\
     new_vm.Start();\
     vms.emplace_back(std::move(new_vm));\
 }
@@ -159,6 +205,18 @@ inline Type Random(Type min, Type max) {
     }
 }
 
+// Polls condition until it holds or five seconds have passed, for harts that
+// run on another thread
+template <typename Condition>
+inline bool WaitFor(Condition condition) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+    while (!condition() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    return condition();
+}
+
 template <typename Type>
 inline Type SignExtend(Type value, auto bit) {
     if constexpr (sizeof(value) < sizeof(uint64_t)) {